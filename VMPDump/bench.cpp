@@ -0,0 +1,1652 @@
+#include "bench.hpp"
+#include "prefilter.hpp"
+#include "lift_context.hpp"
+#include "disassembler.hpp"
+#include "simulated_source.hpp"
+#include "branch_encoder.hpp"
+#include "minidump_source.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+#include <chrono>
+#include <random>
+#include <string_view>
+#include <vtil/common>
+
+namespace vmpdump
+{
+    namespace bench
+    {
+        using namespace vtil::logger;
+
+        // Runs the given callable, returning the elapsed time in seconds.
+        //
+        template<typename F>
+        static double time_seconds( F&& function )
+        {
+            auto begin = std::chrono::steady_clock::now();
+            function();
+            return std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+        }
+
+        // Logs the throughput of a single benchmark.
+        //
+        static void log_throughput( const char* name, size_t bytes, double seconds )
+        {
+            double bytes_per_second = seconds > 0 ? bytes / seconds : 0.0;
+            log<CON_CYN>( "\t** %-24s %10.3f ms %14.0f bytes/s %10.2f MB/s\r\n", name, seconds * 1000.0, bytes_per_second, bytes_per_second / ( 1024.0 * 1024.0 ) );
+        }
+
+        // Linearly decodes [begin, end) with the given capstone handle, the same way the scanner sweeps,
+        // returning the number of instructions decoded.
+        //
+        static size_t sweep( csh handle, cs_insn* insn, const uint8_t* image, uint64_t begin, uint64_t end )
+        {
+            const uint8_t* code = image + begin;
+            size_t size = end - begin;
+            uint64_t offset = begin;
+            size_t count = 0;
+
+            while ( offset < end )
+            {
+                if ( !cs_disasm_iter( handle, &code, &size, &offset, insn ) )
+                {
+                    code++;
+                    size--;
+                    offset++;
+                    continue;
+                }
+                count++;
+            }
+            return count;
+        }
+
+        // Builds the image of a synthetic module exporting the given amount of functions, each 16 bytes apart.
+        // Every third function is exported by ordinal only.
+        //
+        static std::vector<uint8_t> build_export_module( uint32_t export_count, size_t module_size )
+        {
+            using namespace win;
+
+            std::vector<uint8_t> bytes( module_size );
+
+            dos_header_t* dos_header = ( dos_header_t* )bytes.data();
+            dos_header->e_lfanew = 0x80;
+
+            nt_headers_t<true>* nt = ( nt_headers_t<true>* )( bytes.data() + dos_header->e_lfanew );
+            nt->optional_header.size_image = ( uint32_t )module_size;
+            nt->optional_header.size_headers = 0x400;
+            nt->optional_header.num_data_directories = 16;
+
+            // Lay the tables out back to back after the export directory, followed by the names.
+            //
+            uint32_t directory_rva = 0x1000 + export_count * 16;
+            uint32_t functions_rva = directory_rva + sizeof( export_directory_t );
+            uint32_t names_rva = functions_rva + export_count * sizeof( uint32_t );
+            uint32_t name_ordinals_rva = names_rva + export_count * sizeof( uint32_t );
+            uint32_t string_rva = name_ordinals_rva + export_count * sizeof( uint16_t );
+
+            uint32_t name_count = 0;
+            for ( uint32_t i = 0; i < export_count; i++ )
+            {
+                ( ( uint32_t* )( bytes.data() + functions_rva ) )[ i ] = 0x1000 + i * 16;
+                if ( i % 3 == 0 )
+                    continue;
+
+                ( ( uint32_t* )( bytes.data() + names_rva ) )[ name_count ] = string_rva;
+                ( ( uint16_t* )( bytes.data() + name_ordinals_rva ) )[ name_count ] = ( uint16_t )i;
+                string_rva += snprintf( ( char* )bytes.data() + string_rva, 32, "Export%u", i ) + 1;
+                name_count++;
+            }
+
+            export_directory_t* directory = ( export_directory_t* )( bytes.data() + directory_rva );
+            directory->base = 1;
+            directory->num_functions = export_count;
+            directory->num_names = name_count;
+            directory->rva_functions = functions_rva;
+            directory->rva_names = names_rva;
+            directory->rva_name_ordinals = name_ordinals_rva;
+
+            nt->optional_header.data_directories.export_directory = { directory_rva, string_rva - directory_rva };
+            return bytes;
+        }
+
+        // Resolves an export by scanning the export address table and then the name ordinal table, as export
+        // resolution did before the export index.
+        //
+        static std::optional<export_id_t> find_export_linear( const export_view& view, remote_ea_t ea )
+        {
+            using namespace win;
+
+            uint64_t rva = ea - view.module_base;
+            if ( !view.within_bounds( ea ) )
+                return {};
+
+            const export_directory_t* export_dir = view.at<export_directory_t>( view.export_rva );
+            if ( !export_dir )
+                return {};
+
+            const uint32_t* eat = view.at<uint32_t>( export_dir->rva_functions, export_dir->num_functions );
+            const uint32_t* names = view.at<uint32_t>( export_dir->rva_names, export_dir->num_names );
+            const uint16_t* name_ordinals = view.at<uint16_t>( export_dir->rva_name_ordinals, export_dir->num_names );
+            if ( !eat || !names || !name_ordinals )
+                return {};
+
+            uint32_t function_ordinal = -1;
+            for ( uint32_t i = 0; i < export_dir->num_functions; i++ )
+                if ( eat[ i ] == rva )
+                    function_ordinal = i;
+            if ( function_ordinal == -1 )
+                return {};
+
+            uint32_t name_ordinal = -1;
+            for ( uint32_t i = 0; i < export_dir->num_names; i++ )
+                if ( name_ordinals[ i ] == function_ordinal )
+                    name_ordinal = i;
+
+            uint32_t ordinal = export_dir->base + function_ordinal;
+            if ( name_ordinal == -1 )
+                return { { { "" }, ordinal } };
+
+            return { { std::string( view.at<char>( names[ name_ordinal ] ) ), ordinal } };
+        }
+
+        // Times the exact linear sweep against the prefiltered sweep over all executable sections of the
+        // target module, as well as the raw prefilter for each supported vector instruction set and the raw
+        // decoding with and without capstone detail, logging the throughput of each.
+        //
+        void run_scan_benchmark( vmpdump& instance )
+        {
+            using namespace win;
+
+            module_view& view = *instance.target_module_view;
+            pe_image& image = view.local_module;
+
+            // Fetch the whole module first, so that the raw benchmarks below never see absent pages.
+            //
+            double fetch_seconds = time_seconds( [ & ] ()
+            {
+                view.ensure( 0, view.module_size );
+            } );
+
+            nt_headers_t<true>* nt = image.get_image()->get_nt_headers();
+
+            // Sum up the executable bytes, the same way the scanner selects the sections.
+            //
+            std::vector<rva_range_t> code_ranges;
+            size_t code_bytes = 0;
+            for ( int i = 0; i < nt->file_header.num_sections; i++ )
+            {
+                section_header_t* section = nt->get_section( i );
+
+                if ( section->characteristics.mem_read && section->characteristics.mem_execute && section->characteristics.cnt_code )
+                {
+                    code_ranges.push_back( { section->virtual_address, section->virtual_address + section->virtual_size } );
+                    code_bytes += section->virtual_size;
+                }
+            }
+
+            log<CON_GRN>( "** Benchmarking import scan over 0x%llx executable bytes\r\n", code_bytes );
+
+            log_throughput( "module fetch", view.module_size, fetch_seconds );
+            if ( view.pages )
+                log<CON_CYN>( "\t   %llu pages in %llu reads, %i unreadable\r\n", view.pages->fetched_page_count(), view.pages->read_count(), view.unreadable_pages().size() );
+
+            // Raw prefilter throughput, for each vector instruction set supported by the host.
+            //
+            std::vector<rva_range_t> stub_ranges = get_stub_ranges( image );
+            const std::pair<simd_level, const char*> levels[] = { { simd_level::scalar, "prefilter (scalar)" }, { simd_level::sse2, "prefilter (sse2)" }, { simd_level::avx2, "prefilter (avx2)" } };
+            for ( auto& [level, name] : levels )
+            {
+                if ( level > host_simd_level() )
+                    continue;
+
+                size_t candidate_count = 0;
+                double seconds = time_seconds( [ & ] ()
+                {
+                    for ( auto& [begin, end] : code_ranges )
+                        candidate_count += find_call_candidates( image.data(), begin, end - begin, end, stub_ranges, level ).size();
+                } );
+
+                log_throughput( name, code_bytes, seconds );
+                log<CON_CYN>( "\t   %i candidates\r\n", candidate_count );
+            }
+
+            // Raw linear sweep throughput, decoding the same bytes with and without detail.
+            //
+            disassembler& dasm = disassembler::get();
+            const std::tuple<csh, cs_insn*, const char*> decoders[] = { { dasm.get_handle(), dasm.get_insn(), "sweep (detail)" }, { dasm.get_fast_handle(), dasm.get_fast_insn(), "sweep (no detail)" } };
+            for ( auto& [handle, insn, name] : decoders )
+            {
+                size_t instruction_count = 0;
+                double seconds = time_seconds( [ & ] ()
+                {
+                    for ( auto& [begin, end] : code_ranges )
+                        instruction_count += sweep( handle, insn, image.data(), begin, end );
+                } );
+
+                log_throughput( name, code_bytes, seconds );
+                log<CON_CYN>( "\t   %i instructions\r\n", instruction_count );
+            }
+
+            // Full scans, including stub analysis.
+            //
+            const std::pair<uint32_t, const char*> modes[] = { { scan_none, "exact scan" }, { scan_prefilter, "prefiltered scan" } };
+            for ( auto& [flags, name] : modes )
+            {
+                std::map<uint64_t, resolved_import> resolved_imports;
+                std::vector<import_call> import_calls;
+
+                // Start each mode cold, so that it doesn't profit from the analyses of the previous one.
+                //
+                instance.analysis_cache->clear();
+                uint64_t lifts = lift_context::lift_count();
+
+                double seconds = time_seconds( [ & ] ()
+                {
+                    instance.scan_for_imports( resolved_imports, import_calls, flags );
+                } );
+
+                log_throughput( name, code_bytes, seconds );
+                log<CON_CYN>( "\t   %i calls to %i imports, %llu stub cache hits, %llu misses\r\n", import_calls.size(), resolved_imports.size(), instance.analysis_cache->hit_count(), instance.analysis_cache->miss_count() );
+                log<CON_CYN>( "\t   %llu stubs lifted, peak RSS %llu KB\r\n", lift_context::lift_count() - lifts, lift_context::peak_rss() / 1024 );
+            }
+        }
+
+        // Times export resolution through the export index against the linear scan of the export tables it
+        // replaces, on a synthetic module with 3,000 exports, checking that both agree on every export.
+        // Returns false if they disagree, or if an export is not resolved.
+        //
+        bool run_export_benchmark()
+        {
+            constexpr uint32_t export_count = 3000;
+            constexpr size_t module_size = 0x20000;
+            constexpr remote_ea_t module_base = 0x180000000;
+
+            simulated_memory_source source;
+            source.add_module( module_base, "synthetic.dll", build_export_module( export_count, module_size ) );
+
+            log<CON_GRN>( "** Benchmarking export resolution over %i exports\r\n", export_count );
+
+            // Fetching includes building the index.
+            //
+            std::optional<export_view> view;
+            double seconds = time_seconds( [ & ] ()
+            {
+                view.emplace( source, "synthetic.dll", module_base, module_size );
+            } );
+            log<CON_CYN>( "\t** %-24s %10.3f ms\r\n", "fetch and index", seconds * 1000.0 );
+
+            // Resolve every export once, plus as many eas which are not exports.
+            //
+            std::vector<remote_ea_t> eas;
+            for ( uint32_t i = 0; i < export_count; i++ )
+            {
+                eas.push_back( module_base + 0x1000 + i * 16 );
+                eas.push_back( module_base + 0x1000 + i * 16 + 8 );
+            }
+
+            std::vector<std::optional<export_id_t>> linear_results, indexed_results;
+            double linear_seconds = time_seconds( [ & ] ()
+            {
+                for ( remote_ea_t ea : eas )
+                    linear_results.push_back( find_export_linear( *view, ea ) );
+            } );
+            double indexed_seconds = time_seconds( [ & ] ()
+            {
+                for ( remote_ea_t ea : eas )
+                    indexed_results.push_back( view->get_export( ea ) );
+            } );
+
+            log<CON_CYN>( "\t** %-24s %10.3f ms %10.1f ns/lookup\r\n", "linear lookup", linear_seconds * 1000.0, linear_seconds * 1e9 / eas.size() );
+            log<CON_CYN>( "\t** %-24s %10.3f ms %10.1f ns/lookup\r\n", "indexed lookup", indexed_seconds * 1000.0, indexed_seconds * 1e9 / eas.size() );
+
+            // Every other ea is an export, and the rest are not.
+            //
+            size_t unresolved = 0;
+            for ( size_t i = 0; i < indexed_results.size(); i++ )
+            {
+                if ( indexed_results[ i ].has_value() != ( i % 2 == 0 ) )
+                    unresolved++;
+            }
+
+            bool result = linear_results == indexed_results && !unresolved;
+            if ( result )
+                log<CON_CYN>( "\t   %i lookups agree\r\n", eas.size() );
+            else
+                log<CON_RED>( "\t   indexed lookup disagrees with the linear lookup, %i lookups wrong\r\n", unresolved );
+            return result;
+        }
+
+        // Cross-checks the branch encoder byte for byte against Keystone, for every form emitted when patching calls, on
+        // randomized addresses, and times both. Indirect branches are also checked in modules based below 2 GB, where both
+        // their rip-relative and absolute forms are encodable, so the form chosen must match too. Returns false if any
+        // encoding disagrees.
+        //
+        bool run_encoder_benchmark()
+        {
+            constexpr size_t iterations = 2000;
+
+            // Where the branches of a form are placed, and what they target.
+            //
+            enum class branch_sites
+            {
+                // Sites within a module at a randomized high base, targeting the same module.
+                //
+                high_base,
+
+                // Sites at a high base, targeting a low absolute address out of rip-relative reach.
+                //
+                absolute_target,
+
+                // Sites within a module below 2 GB, targeting the same module, so that both the rip-relative and the
+                // absolute forms of indirect branches are encodable.
+                //
+                low_base,
+            };
+
+            // A branch form, as the assembly text given to Keystone, and the encoder call producing it.
+            //
+            struct branch_form
+            {
+                const char* name;
+                const char* format;
+                std::optional<encoded_branch>( *encode )( uint64_t address, uint64_t target );
+                branch_sites sites;
+                bool indirect;
+            };
+
+            static const branch_form forms[] =
+            {
+                { "call [rip+disp32]", "call [0x%p]", &branch_encoder::encode_indirect<branch_type::call>, branch_sites::high_base, true },
+                { "jmp [rip+disp32]", "jmp [0x%p]", &branch_encoder::encode_indirect<branch_type::jmp>, branch_sites::high_base, true },
+                { "jmp [abs]", "jmp [0x%p]", &branch_encoder::encode_indirect<branch_type::jmp>, branch_sites::absolute_target, true },
+                { "call [mem] (low base)", "call [0x%p]", &branch_encoder::encode_indirect<branch_type::call>, branch_sites::low_base, true },
+                { "jmp [mem] (low base)", "jmp [0x%p]", &branch_encoder::encode_indirect<branch_type::jmp>, branch_sites::low_base, true },
+                { "call rel32", "call 0x%p", &branch_encoder::encode_relative<branch_type::call>, branch_sites::high_base, false },
+                { "jmp rel", "jmp 0x%p", &branch_encoder::encode_relative<branch_type::jmp>, branch_sites::high_base, false },
+            };
+
+            log<CON_GRN>( "** Cross-checking the branch encoder against Keystone over %i addresses per form\r\n", iterations );
+
+            std::mt19937_64 random( 0x766D7064 );
+            size_t total_mismatches = 0;
+            for ( const branch_form& form : forms )
+            {
+                // Sites within a module at a randomized base, targeting the same module, or a low absolute address.
+                // The rel8 range is covered by targets close to the site.
+                //
+                std::vector<std::pair<uint64_t, uint64_t>> branches;
+                for ( size_t i = 0; i < iterations; i++ )
+                {
+                    uint64_t module_base = form.sites == branch_sites::low_base ? 0x400000 + ( random() % 0x4000 ) * 0x10000
+                                                                                : 0x7FF000000000 + ( random() % 0x1000000 ) * 0x10000;
+                    uint64_t address = module_base + random() % 0x4000000;
+                    uint64_t target = ( i % 4 == 0 ) ? address + random() % 0x100 - 0x80 : module_base + random() % 0x4000000;
+                    if ( form.sites == branch_sites::absolute_target )
+                        target = 0x1000 + random() % 0x70000000;
+                    branches.push_back( { address, target } );
+                }
+
+                std::vector<std::vector<uint8_t>> keystone_results, encoder_results;
+                double keystone_seconds = time_seconds( [ & ] ()
+                {
+                    for ( auto& [address, target] : branches )
+                        keystone_results.push_back( vtil::amd64::assemble( vtil::format::str( form.format, target ), address ) );
+                } );
+                double encoder_seconds = time_seconds( [ & ] ()
+                {
+                    for ( auto& [address, target] : branches )
+                    {
+                        std::optional<encoded_branch> branch = form.encode( address, target );
+                        encoder_results.push_back( branch ? std::vector<uint8_t>{ branch->begin(), branch->end() } : std::vector<uint8_t>{} );
+                    }
+                } );
+
+                log<CON_CYN>( "\t** %-24s keystone %10.1f ns/branch, encoder %10.1f ns/branch\r\n", form.name, keystone_seconds * 1e9 / iterations, encoder_seconds * 1e9 / iterations );
+
+                // For indirect branches, the ModRM byte tells the rip-relative form from the absolute one, so tell a different
+                // choice of form apart from a wrong encoding of the same form.
+                //
+                size_t mismatches = 0;
+                size_t form_mismatches = 0;
+                size_t rip_relative = 0;
+                for ( size_t i = 0; i < iterations; i++ )
+                {
+                    const std::vector<uint8_t>& keystone = keystone_results[ i ];
+                    const std::vector<uint8_t>& encoder = encoder_results[ i ];
+                    if ( form.indirect && encoder.size() >= 2 && ( encoder[ 1 ] & 0b111 ) == 0b101 )
+                        rip_relative++;
+
+                    if ( keystone == encoder )
+                        continue;
+
+                    bool other_form = form.indirect && keystone.size() >= 2 && encoder.size() >= 2 && keystone[ 1 ] != encoder[ 1 ];
+                    form_mismatches += other_form;
+
+                    if ( !mismatches++ )
+                        log<CON_RED>( "\t   encoder disagrees with keystone @ 0x%llx -> 0x%llx: %i bytes vs %i bytes%s\r\n", branches[ i ].first, branches[ i ].second, encoder.size(), keystone.size(),
+                                      other_form ? ", in a different form" : "" );
+                }
+
+                if ( mismatches )
+                    log<CON_RED>( "\t   %i of %i encodings disagree, %i of them in form\r\n", mismatches, iterations, form_mismatches );
+                else if ( form.indirect )
+                    log<CON_CYN>( "\t   %i encodings agree, %i of them rip-relative\r\n", iterations, rip_relative );
+                else
+                    log<CON_CYN>( "\t   %i encodings agree\r\n", iterations );
+                total_mismatches += mismatches;
+            }
+            return total_mismatches == 0;
+        }
+
+        // Checks that committing a module view to a simulated module writes exactly its patched bytes, with adjacent patches
+        // coalesced into a single write, leaving the rest of their pages as they are remotely, and clears the dirty bits of
+        // the pages written, but not of those which failed. Returns false on any mismatch.
+        //
+        bool run_commit_check()
+        {
+            constexpr size_t module_size = 0xF800;
+            constexpr remote_ea_t module_base = 0x180000000;
+            constexpr size_t page_size = page_cache::page_size;
+
+            log<CON_GRN>( "** Checking the writes of committing a module view\r\n" );
+
+            std::shared_ptr<simulated_memory_source> source = std::make_shared<simulated_memory_source>();
+            source->add_module( module_base, "synthetic.dll", build_export_module( 16, module_size ) );
+            module_view view( source, "synthetic.dll", module_base, module_size, true );
+
+            // Two adjacent patches on page 2, a patch straddling pages 3 and 4, a patch on page 8, a byte on page 12, which cannot
+            // be written, and a patch ending the module.
+            //
+            const uint8_t bytes[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+            bool patched = view.patch( 2 * page_size + 0x10, bytes, sizeof( bytes ) ) &&
+                           view.patch( 2 * page_size + 0x14, bytes, sizeof( bytes ) ) &&
+                           view.patch( 4 * page_size - 2, bytes, sizeof( bytes ) ) &&
+                           view.patch( 8 * page_size + 0x100, bytes, sizeof( bytes ) ) &&
+                           view.mark_dirty( 12 * page_size, 1 ) &&
+                           view.patch( module_size - sizeof( bytes ), bytes, sizeof( bytes ) );
+            source->add_hole( module_base + 12 * page_size, page_size );
+
+            // Meanwhile, the process changes a byte next to a patch.
+            //
+            const uint8_t changed = 0x5A;
+            source->write( module_base + 2 * page_size + 0x20, &changed, sizeof( changed ) );
+
+            // The patches on page 2 are written as one.
+            //
+            std::vector<std::pair<remote_ea_t, size_t>> expected_writes =
+            {
+                { module_base + 2 * page_size + 0x10, 2 * sizeof( bytes ) },
+                { module_base + 4 * page_size - 2, sizeof( bytes ) },
+                { module_base + 8 * page_size + 0x100, sizeof( bytes ) },
+                { module_base + 12 * page_size, 1 },
+                { module_base + module_size - sizeof( bytes ), sizeof( bytes ) },
+            };
+
+            source->writes.clear();
+            bool committed = view.commit();
+            bool writes_match = source->writes == expected_writes;
+            for ( auto& [ea, size] : source->writes )
+                log<CON_CYN>( "\t   write 0x%llx, 0x%llx bytes\r\n", ea, size );
+
+            // Only the page which failed is still dirty, the patched bytes now match the local module, and the byte the process
+            // changed was left alone.
+            //
+            bool dirty_match = true;
+            for ( size_t i = 0; i < view.dirty_pages.size(); i++ )
+                dirty_match &= view.dirty_pages[ i ] == ( i == 12 );
+
+            uint8_t remote[ sizeof( bytes ) ];
+            uint8_t neighbour = 0;
+            bool bytes_match = source->read( module_base + 4 * page_size - 2, remote, sizeof( remote ) ) && !memcmp( remote, bytes, sizeof( bytes ) ) &&
+                               source->read( module_base + module_size - sizeof( bytes ), remote, sizeof( remote ) ) && !memcmp( remote, bytes, sizeof( bytes ) ) &&
+                               source->read( module_base + 2 * page_size + 0x20, &neighbour, sizeof( neighbour ) ) && neighbour == changed;
+
+            // Committing again only retries the byte which failed.
+            //
+            source->writes.clear();
+            view.commit();
+            bool retry_match = source->writes == std::vector<std::pair<remote_ea_t, size_t>>{ { module_base + 12 * page_size, 1 } };
+
+            bool result = patched && !committed && writes_match && dirty_match && bytes_match && retry_match;
+            if ( result )
+                log<CON_CYN>( "\t   %i writes as expected, dirty pages cleared\r\n", expected_writes.size() );
+            else
+                log<CON_RED>( "\t   commit mismatch: patched %i, writes %i, dirty pages %i, bytes %i, retry %i\r\n", patched, writes_match, dirty_match, bytes_match, retry_match );
+            return result;
+        }
+
+        // Builds the image of a synthetic module with an executable .text section at 0x1000, filled with int3s, and an
+        // empty .rdata section at 0x3000. The page in between is left out, so that the sections are never written at once.
+        //
+        static std::vector<uint8_t> build_code_module( size_t module_size )
+        {
+            using namespace win;
+
+            std::vector<uint8_t> bytes( module_size );
+
+            dos_header_t* dos_header = ( dos_header_t* )bytes.data();
+            dos_header->e_lfanew = 0x80;
+
+            nt_headers_t<true>* nt = ( nt_headers_t<true>* )( bytes.data() + dos_header->e_lfanew );
+            nt->file_header.num_sections = 2;
+            nt->file_header.size_optional_header = sizeof( nt->optional_header );
+            nt->optional_header.size_image = ( uint32_t )module_size;
+            nt->optional_header.size_headers = 0x400;
+            nt->optional_header.section_alignment = 0x1000;
+            nt->optional_header.num_data_directories = 16;
+
+            section_header_t* text = nt->get_section( 0 );
+            memcpy( text->name, ".text", 5 );
+            text->virtual_address = 0x1000;
+            text->virtual_size = 0x1000;
+            text->characteristics.flags = 0x60000020;
+            memset( bytes.data() + 0x1000, 0xCC, 0x1000 );
+
+            section_header_t* rdata = nt->get_section( 1 );
+            memcpy( rdata->name, ".rdata", 6 );
+            rdata->virtual_address = 0x3000;
+            rdata->virtual_size = 0x1000;
+            rdata->characteristics.flags = 0x40000040;
+            return bytes;
+        }
+
+        // Follows the indirect branch at rva in a copy of a module, or the relative branch to the stub holding one, returning
+        // the ea read from the thunk it goes through, or empty {} if there is no such branch there.
+        //
+        static std::optional<remote_ea_t> follow_branch( const std::vector<uint8_t>& bytes, uint64_t rva, bool through_stub )
+        {
+            if ( rva + 6 > bytes.size() )
+                return {};
+
+            const uint8_t* code = bytes.data() + rva;
+            if ( code[ 0 ] == 0xFF && ( code[ 1 ] == 0x15 || code[ 1 ] == 0x25 ) )
+            {
+                int32_t displacement;
+                memcpy( &displacement, code + 2, sizeof( displacement ) );
+
+                uint64_t thunk_rva = rva + 6 + displacement;
+                if ( thunk_rva + sizeof( remote_ea_t ) > bytes.size() )
+                    return {};
+
+                remote_ea_t ea;
+                memcpy( &ea, bytes.data() + thunk_rva, sizeof( ea ) );
+                return ea;
+            }
+
+            if ( through_stub && ( code[ 0 ] == 0xE8 || code[ 0 ] == 0xE9 ) )
+            {
+                int32_t displacement;
+                memcpy( &displacement, code + 1, sizeof( displacement ) );
+                return follow_branch( bytes, rva + 5 + displacement, false );
+            }
+
+            return {};
+        }
+
+        // Runs fix_live on a simulated process, checking the order of its writes. If occupied, the range the thunks were laid
+        // out in holds data, which must be left untouched.
+        //
+        static bool check_live_fix( bool occupied )
+        {
+            constexpr size_t module_size = 0x4000;
+            constexpr remote_ea_t module_base = 0x140000000;
+            constexpr size_t thunk_range_size = 0x18;
+
+            // A call after a push, which has room for an indirect call, a bare call, which must go through a stub, and a padded
+            // jump, each to its own import. The calls target the int3s, standing in for the VMP stubs.
+            //
+            std::vector<uint8_t> original = build_code_module( module_size );
+            const uint8_t pushed_call[] = { 0x50, 0xE8, 0xFA, 0x07, 0x00, 0x00 };
+            memcpy( original.data() + 0x1000, pushed_call, sizeof( pushed_call ) );
+            const uint8_t bare_call[] = { 0xE8, 0xEB, 0x07, 0x00, 0x00 };
+            memcpy( original.data() + 0x1010, bare_call, sizeof( bare_call ) );
+            const uint8_t padded_jump[] = { 0xE9, 0xDB, 0x07, 0x00, 0x00, 0xCC };
+            memcpy( original.data() + 0x1020, padded_jump, sizeof( padded_jump ) );
+            if ( occupied )
+                memset( original.data() + 0x3000, 0x5A, thunk_range_size );
+
+            std::shared_ptr<simulated_memory_source> source = std::make_shared<simulated_memory_source>();
+            source->add_module( module_base, "synthetic.exe", original );
+            source->set_protection( module_base, 0x1000, protected_memory_source::page_readonly );
+            source->set_protection( module_base + 0x1000, 0x1000, protected_memory_source::page_execute_read );
+            source->set_protection( module_base + 0x3000, 0x1000, protected_memory_source::page_readonly );
+            vmpdump instance( source, source->get_modules(), std::make_unique<module_view>( source, "synthetic.exe", module_base, module_size ), "synthetic.exe" );
+
+            const resolved_import imports[] =
+            {
+                { 0x3000, 0x7FF800001000 },
+                { 0x3008, 0x7FF800002000 },
+                { 0x3010, 0x7FF800003000 },
+            };
+            std::optional<compact_instruction> push = disassembler::get().decode( ( uint64_t )original.data(), 0x1000, 0x10 );
+            std::vector<import_call> import_calls =
+            {
+                { 0x1001, 5, &imports[ 0 ], 8, false, false, push },
+                { 0x1010, 5, &imports[ 1 ], 0, false, false, {} },
+                { 0x1020, 5, &imports[ 2 ], 0, false, true, {} },
+            };
+            const uint64_t sites[] = { 0x1000, 0x1010, 0x1020 };
+
+            std::map<remote_ea_t, uint32_t> thunk_rvas;
+            for ( const resolved_import& import : imports )
+                thunk_rvas.insert( { import.target_ea, ( uint32_t )import.thunk_rva } );
+
+            // Take a copy of the module after every write.
+            //
+            std::vector<std::vector<uint8_t>> states;
+            source->on_write = [ & ] ( remote_ea_t ea, size_t size )
+            {
+                std::vector<uint8_t> state( module_size );
+                source->read( module_base, state.data(), module_size );
+                states.push_back( std::move( state ) );
+            };
+            size_t redirected = instance.fix_live( import_calls, thunk_rvas );
+            source->on_write = nullptr;
+
+            if ( states.empty() )
+            {
+                log<CON_RED>( "\t   nothing was written\r\n" );
+                return false;
+            }
+
+            // Find the stubs the calls were dispatched through in the end.
+            //
+            const std::vector<uint8_t>& final_state = states.back();
+            std::vector<std::optional<uint64_t>> stubs;
+            for ( uint64_t site : sites )
+            {
+                stubs.push_back( {} );
+                if ( final_state[ site ] == 0xE8 || final_state[ site ] == 0xE9 )
+                {
+                    int32_t displacement;
+                    memcpy( &displacement, final_state.data() + site + 1, sizeof( displacement ) );
+                    stubs.back() = site + 5 + displacement;
+                }
+            }
+
+            // Check every intermediate state.
+            //
+            size_t violations = 0;
+            for ( size_t i = 0; i < states.size(); i++ )
+            {
+                const std::vector<uint8_t>& state = states[ i ];
+                for ( size_t j = 0; j < import_calls.size(); j++ )
+                {
+                    if ( stubs[ j ] && !memcmp( state.data() + *stubs[ j ], final_state.data() + *stubs[ j ], 6 ) &&
+                         follow_branch( state, *stubs[ j ], false ) != imports[ j ].target_ea )
+                    {
+                        if ( !violations++ )
+                            log<CON_RED>( "\t   stub @ RVA 0x%llx written before its thunk, at write %i\r\n", *stubs[ j ], i );
+                    }
+
+                    if ( memcmp( state.data() + sites[ j ], original.data() + sites[ j ], 6 ) &&
+                         follow_branch( state, sites[ j ], true ) != imports[ j ].target_ea )
+                    {
+                        if ( !violations++ )
+                            log<CON_RED>( "\t   call @ RVA 0x%llx redirected before its stub or thunk, at write %i\r\n", sites[ j ], i );
+                    }
+                }
+            }
+
+            // Every call must have been redirected in the end, one of them through a stub.
+            //
+            bool complete = redirected == import_calls.size() && std::count_if( stubs.begin(), stubs.end(), [ ] ( auto& stub ) { return stub.has_value(); } ) == 1;
+            for ( size_t j = 0; j < import_calls.size(); j++ )
+                complete &= follow_branch( final_state, sites[ j ], true ) == imports[ j ].target_ea;
+
+            // Data in the thunks' range must have been left alone.
+            //
+            bool preserved = !memcmp( final_state.data() + 0x3000, original.data() + 0x3000, thunk_range_size ) || !occupied;
+
+            // Every page must be back to its own protection.
+            //
+            bool protected_again = source->get_protection( module_base ) == protected_memory_source::page_readonly &&
+                                   source->get_protection( module_base + 0x1000 ) == protected_memory_source::page_execute_read &&
+                                   source->get_protection( module_base + 0x3000 ) == protected_memory_source::page_readonly;
+
+            bool result = complete && preserved && protected_again && !violations;
+            if ( result )
+                log<CON_CYN>( "\t   %i calls redirected in order over %i writes%s\r\n", redirected, states.size(), occupied ? ", thunks moved out of data in use" : "" );
+            else
+                log<CON_RED>( "\t   %i of %i calls redirected, %i order violations, data %s, protections %s\r\n", redirected, import_calls.size(), violations,
+                              preserved ? "preserved" : "overwritten", protected_again ? "restored" : "changed" );
+            return result;
+        }
+
+        // Commits a patch straddling the headers and the first page of .text, which is written at once, checking that each page
+        // is restored to its own protection rather than to that of the first, and that the instruction cache is flushed.
+        //
+        static bool check_live_protection()
+        {
+            constexpr size_t module_size = 0x4000;
+            constexpr remote_ea_t module_base = 0x140000000;
+
+            std::shared_ptr<simulated_memory_source> source = std::make_shared<simulated_memory_source>();
+            source->add_module( module_base, "synthetic.exe", build_code_module( module_size ) );
+            source->set_protection( module_base, 0x1000, protected_memory_source::page_readonly );
+            source->set_protection( module_base + 0x1000, 0x1000, protected_memory_source::page_execute_read );
+            module_view view( source, "synthetic.exe", module_base, module_size, true );
+
+            const uint8_t bytes[] = { 0x90, 0x90, 0x90, 0x90 };
+            bool committed = view.patch( 0x1000 - 2, bytes, sizeof( bytes ) ) && view.commit() && source->writes.size() == 1;
+
+            bool protected_again = source->get_protection( module_base ) == protected_memory_source::page_readonly &&
+                                   source->get_protection( module_base + 0x1000 ) == protected_memory_source::page_execute_read;
+            bool flushed = !source->flushes.empty();
+
+            bool result = committed && protected_again && flushed;
+            if ( result )
+                log<CON_CYN>( "\t   headers and .text written at once, each restored to its own protection\r\n" );
+            else
+                log<CON_RED>( "\t   protection mismatch: committed %i, restored %i, flushed %i\r\n", committed, protected_again, flushed );
+            return result;
+        }
+
+        // Checks the order in which fix_live writes to a simulated process: at every write, each call already redirected
+        // must lead, through its stub if it has one, to a thunk already holding the import, and each stub written must
+        // lead to such a thunk too. Also checks that thunks are moved elsewhere if the range they were laid out in holds data,
+        // and that writes spanning pages of different protections restore each. Returns false on any violation.
+        //
+        bool run_live_check()
+        {
+            log<CON_GRN>( "** Checking the write order of fixing calls in a running process\r\n" );
+
+            bool passed = check_live_fix( false );
+            passed &= check_live_fix( true );
+            passed &= check_live_protection();
+            return passed;
+        }
+
+        // The byte a synthetic dump holds at the given ea.
+        //
+        static uint8_t synthetic_byte( remote_ea_t ea )
+        {
+            return ( uint8_t )( ea * 7 + 3 );
+        }
+
+        // Builds a synthetic minidump of a process with two modules, target.exe at 0x140000000 and ntdll.dll at
+        // 0x7FF800000000. The first 0x2000 bytes of target.exe and all of ntdll.dll are in the Memory64ListStream,
+        // and the last 0x1000 bytes of target.exe are in the MemoryListStream, stored before the others.
+        //
+        static std::vector<uint8_t> build_minidump()
+        {
+            std::vector<uint8_t> dump;
+            auto append = [ & ] ( const auto& value ) { dump.insert( dump.end(), ( const uint8_t* )&value, ( const uint8_t* )&value + sizeof( value ) ); };
+            auto patch = [ & ] ( size_t offset, const auto& value ) { memcpy( dump.data() + offset, &value, sizeof( value ) ); };
+            auto append_memory = [ & ] ( remote_ea_t ea, size_t size )
+            {
+                for ( size_t i = 0; i < size; i++ )
+                    dump.push_back( synthetic_byte( ea + i ) );
+            };
+
+            // Header, and the directory of the module list, memory list and memory64 list streams.
+            //
+            append( uint32_t( 0x504D444D ) );
+            append( uint32_t( 0xA793 ) );
+            append( uint32_t( 3 ) );
+            append( uint32_t( 32 ) );
+            append( uint32_t( 0 ) );
+            append( uint32_t( 0 ) );
+            append( uint64_t( 0 ) );
+            size_t directory = dump.size();
+            dump.resize( dump.size() + 3 * 12 );
+
+            // The module names.
+            //
+            auto append_string = [ & ] ( const char* string )
+            {
+                uint32_t offset = ( uint32_t )dump.size();
+                append( uint32_t( strlen( string ) * 2 ) );
+                for ( const char* it = string; *it; it++ )
+                    append( uint16_t( *it ) );
+                append( uint16_t( 0 ) );
+                return offset;
+            };
+            uint32_t image_name = append_string( "C:\\app\\target.exe" );
+            uint32_t ntdll_name = append_string( "C:\\Windows\\System32\\ntdll.dll" );
+
+            // The module list: base, size, checksum, timestamp, name, and the version info and records, all zero.
+            //
+            uint32_t module_list = ( uint32_t )dump.size();
+            append( uint32_t( 2 ) );
+            for ( auto [base, size, name] : { std::tuple{ 0x140000000ull, 0x3000u, image_name }, std::tuple{ 0x7FF800000000ull, 0x1000u, ntdll_name } } )
+            {
+                size_t module = dump.size();
+                dump.resize( dump.size() + 108 );
+                patch( module, uint64_t( base ) );
+                patch( module + 8, uint32_t( size ) );
+                patch( module + 20, uint32_t( name ) );
+            }
+
+            // The memory list, with its bytes right after it.
+            //
+            uint32_t memory_list = ( uint32_t )dump.size();
+            append( uint32_t( 1 ) );
+            append( uint64_t( 0x140002000 ) );
+            append( uint32_t( 0x1000 ) );
+            append( uint32_t( dump.size() + 4 ) );
+            append_memory( 0x140002000, 0x1000 );
+
+            // The memory64 list, with the bytes of all of its ranges back to back at its base rva.
+            //
+            uint32_t memory64_list = ( uint32_t )dump.size();
+            append( uint64_t( 2 ) );
+            append( uint64_t( dump.size() + 8 + 2 * 16 ) );
+            append( uint64_t( 0x140000000 ) );
+            append( uint64_t( 0x2000 ) );
+            append( uint64_t( 0x7FF800000000 ) );
+            append( uint64_t( 0x1000 ) );
+            append_memory( 0x140000000, 0x2000 );
+            append_memory( 0x7FF800000000, 0x1000 );
+
+            // Fill in the directory: type, size and rva.
+            //
+            const uint32_t streams[][ 3 ] =
+            {
+                { 4, 4 + 2 * 108, module_list },
+                { 5, 4 + 16, memory_list },
+                { 9, 16 + 2 * 16, memory64_list },
+            };
+            for ( size_t i = 0; i < 3; i++ )
+            {
+                for ( size_t j = 0; j < 3; j++ )
+                    patch( directory + i * 12 + j * 4, streams[ i ][ j ] );
+            }
+            return dump;
+        }
+
+        // Checks the minidump source against a small synthetic dump, built in memory and written to a temporary file: the
+        // module list, ranges from both the Memory64ListStream and the MemoryListStream, a read spanning two ranges which are
+        // adjacent in memory but not in the dump, and mapping. Returns false on any mismatch.
+        //
+        bool run_minidump_check()
+        {
+            log<CON_GRN>( "** Checking the minidump source on a synthetic dump\r\n" );
+
+            std::error_code error;
+            std::string path = mapped_file::temporary_path( ( std::filesystem::temp_directory_path( error ) / "vmpdump.dmp" ).string() );
+            {
+                std::vector<uint8_t> dump = build_minidump();
+                std::ofstream file( path, std::ios::binary | std::ios::trunc );
+                file.write( ( const char* )dump.data(), dump.size() );
+                if ( !file )
+                {
+                    log<CON_RED>( "\t   failed to write %s\r\n", path );
+                    return false;
+                }
+            }
+
+            // Returns whether [ea, ea + size) reads as the synthetic bytes.
+            //
+            auto check_read = [ ] ( memory_source& source, remote_ea_t ea, size_t size )
+            {
+                std::vector<uint8_t> bytes( size );
+                if ( !source.read( ea, bytes.data(), size ) )
+                    return false;
+                for ( size_t i = 0; i < size; i++ )
+                {
+                    if ( bytes[ i ] != synthetic_byte( ea + i ) )
+                        return false;
+                }
+                return true;
+            };
+
+            std::vector<std::pair<const char*, bool>> checks;
+            if ( std::shared_ptr<minidump_memory_source> source = minidump_memory_source::open( path ) )
+            {
+                module_list_t expected_modules =
+                {
+                    { 0x140000000, { "target.exe", 0x3000 } },
+                    { 0x7FF800000000, { "ntdll.dll", 0x1000 } },
+                };
+                checks.push_back( { "module list", source->get_modules() == expected_modules } );
+                checks.push_back( { "image path", source->get_image_path() == "C:\\app\\target.exe" } );
+                checks.push_back( { "memory64 range", check_read( *source, 0x140000000, 0x2000 ) && check_read( *source, 0x7FF800000000, 0x1000 ) } );
+                checks.push_back( { "memory range", check_read( *source, 0x140002000, 0x1000 ) } );
+                checks.push_back( { "read spanning two ranges", check_read( *source, 0x140001FF0, 0x20 ) } );
+
+                uint8_t byte;
+                checks.push_back( { "uncaptured reads fail", !source->read( 0x140003000, &byte, 1 ) && !source->read( 0x140002FFF, &byte, 2 ) && !source->read( 0x13FFFFFFF, &byte, 1 ) } );
+
+                // A mapping is a copy-on-write view of a single range.
+                //
+                std::shared_ptr<uint8_t> view = source->map( 0x140000000, 0x2000 );
+                bool mapped = view && view.get()[ 0x1234 ] == synthetic_byte( 0x140001234 );
+                if ( mapped )
+                    view.get()[ 0x1234 ]++;
+                checks.push_back( { "map", mapped && check_read( *source, 0x140001230, 0x10 ) } );
+                checks.push_back( { "map spanning two ranges fails", !source->map( 0x140000000, 0x3000 ) } );
+            }
+            else
+            {
+                checks.push_back( { "open", false } );
+            }
+            std::filesystem::remove( path, error );
+
+            bool result = true;
+            for ( auto& [name, passed] : checks )
+            {
+                if ( !passed )
+                    log<CON_RED>( "\t   %s failed\r\n", name );
+                result &= passed;
+            }
+            if ( result )
+                log<CON_CYN>( "\t   %i checks passed\r\n", checks.size() );
+            return result;
+        }
+
+        // Checks the page cache against a synthetic module of 256 pages with every eighth page unreadable, fetched lazily: only the
+        // batch holding the headers is read up front, ensuring a range fails exactly if it overlaps a hole, exactly the holes are
+        // recorded as unreadable and left zero, and every other byte matches. Also times fetching the whole module. Returns false
+        // on any mismatch.
+        //
+        bool run_page_cache_check()
+        {
+            constexpr size_t module_size = 0x100000;
+            constexpr remote_ea_t module_base = 0x140000000;
+            constexpr size_t page_size = page_cache::page_size;
+
+            log<CON_GRN>( "** Checking the page cache against a module with holes\r\n" );
+
+            std::vector<uint8_t> bytes = build_code_module( module_size );
+            for ( size_t rva = page_size; rva < module_size; rva++ )
+                bytes[ rva ] = synthetic_byte( module_base + rva );
+
+            std::shared_ptr<simulated_memory_source> source = std::make_shared<simulated_memory_source>();
+            source->add_module( module_base, "synthetic.exe", bytes );
+
+            std::vector<uint64_t> holes;
+            for ( uint64_t rva = 7 * page_size; rva < module_size; rva += 8 * page_size )
+            {
+                source->add_hole( module_base + rva, page_size );
+                holes.push_back( rva );
+            }
+
+            module_view view( source, "synthetic.exe", module_base, module_size, true );
+            bool lazy = view.pages && view.pages->fetched_page_count() <= page_cache::batch_pages;
+
+            // Ranges clear of the holes are readable, and those overlapping one are not.
+            //
+            bool ensure_match = view.ensure( 0, 7 * page_size ) && !view.ensure( 6 * page_size, 2 * page_size ) && view.ensure( 8 * page_size + 0x10, 0x100 );
+
+            double seconds = time_seconds( [ & ] ()
+            {
+                view.ensure( 0, module_size );
+            } );
+            bool holes_match = view.unreadable_pages() == holes;
+
+            size_t mismatches = 0;
+            for ( uint64_t rva = 0; rva < module_size; rva += page_size )
+            {
+                const uint8_t* local = view.local_module.cdata() + rva;
+                if ( std::binary_search( holes.begin(), holes.end(), rva ) ? std::any_of( local, local + page_size, [ ] ( uint8_t value ) { return value != 0; } )
+                                                                           : memcmp( local, bytes.data() + rva, page_size ) != 0 )
+                    mismatches++;
+            }
+
+            log_throughput( "page cache (holes)", module_size, seconds );
+
+            bool result = lazy && ensure_match && holes_match && !mismatches;
+            if ( result )
+                log<CON_CYN>( "\t   %llu reads, %i holes recorded, every other page matches\r\n", source->read_count.load(), holes.size() );
+            else
+                log<CON_RED>( "\t   page cache mismatch: lazy %i, ensure %i, holes %i, %i mismatching pages\r\n", lazy, ensure_match, holes_match, mismatches );
+            return result;
+        }
+
+        // Builds a synthetic module for the scan, with a .text section of pseudo-random bytes and a .vmp0 section holding import
+        // stubs and their thunks. Calls to the stubs are planted at random rvas, and right around every chunk_size-th rva of .text.
+        //
+        static std::vector<uint8_t> build_scan_module( size_t text_size, size_t chunk_size )
+        {
+            using namespace win;
+
+            constexpr uint64_t text_rva = 0x1000;
+            constexpr size_t stub_count = 16;
+            constexpr size_t stub_spacing = 0x40;
+            const uint64_t vmp_rva = text_rva + text_size;
+            const uint64_t thunks_rva = vmp_rva + stub_count * stub_spacing;
+
+            std::vector<uint8_t> bytes( vmp_rva + 0x1000 );
+
+            dos_header_t* dos_header = ( dos_header_t* )bytes.data();
+            dos_header->e_lfanew = 0x80;
+
+            nt_headers_t<true>* nt = ( nt_headers_t<true>* )( bytes.data() + dos_header->e_lfanew );
+            nt->file_header.num_sections = 2;
+            nt->file_header.size_optional_header = sizeof( nt->optional_header );
+            nt->optional_header.size_image = ( uint32_t )bytes.size();
+            nt->optional_header.size_headers = 0x400;
+            nt->optional_header.section_alignment = 0x1000;
+            nt->optional_header.num_data_directories = 16;
+
+            section_header_t* text = nt->get_section( 0 );
+            memcpy( text->name, ".text", 5 );
+            text->virtual_address = text_rva;
+            text->virtual_size = ( uint32_t )text_size;
+            text->characteristics.flags = 0x60000020;
+
+            section_header_t* vmp = nt->get_section( 1 );
+            memcpy( vmp->name, ".vmp0", 5 );
+            vmp->virtual_address = ( uint32_t )vmp_rva;
+            vmp->virtual_size = 0x1000;
+            vmp->characteristics.flags = 0x60000020;
+
+            // push rax; mov rax, [thunk]; lea rax, [rax+constant]; xchg [rsp], rax; ret, with every fourth stub a jump.
+            //
+            for ( size_t i = 0; i < stub_count; i++ )
+            {
+                uint64_t stub_rva = vmp_rva + i * stub_spacing;
+                uint64_t thunk_rva = thunks_rva + i * 8;
+                int32_t thunk_displacement = ( int32_t )( thunk_rva - ( stub_rva + 8 ) );
+                int32_t constant = 0x1000 + ( int32_t )i;
+
+                uint8_t stub[] = { 0x50, 0x48, 0x8B, 0x05, 0, 0, 0, 0, 0x48, 0x8D, 0x80, 0, 0, 0, 0, 0x48, 0x87, 0x04, 0x24, 0xC3, 0x00, 0x00 };
+                memcpy( stub + 4, &thunk_displacement, 4 );
+                memcpy( stub + 11, &constant, 4 );
+                if ( i % 4 == 3 )
+                {
+                    stub[ 19 ] = 0xC2;
+                    stub[ 20 ] = 0x08;
+                }
+                memcpy( bytes.data() + stub_rva, stub, sizeof( stub ) );
+
+                remote_ea_t thunk = 0x7FF800000000 + i * 0x1000;
+                memcpy( bytes.data() + thunk_rva, &thunk, sizeof( thunk ) );
+            }
+
+            std::mt19937_64 rng( 0x5CA9 );
+            for ( uint64_t rva = text_rva; rva < vmp_rva; rva++ )
+                bytes[ rva ] = ( uint8_t )rng();
+
+            auto plant_call = [ & ] ( uint64_t rva )
+            {
+                if ( rva < text_rva || rva + 5 > vmp_rva )
+                    return;
+
+                uint64_t stub_rva = vmp_rva + rng() % stub_count * stub_spacing;
+                int32_t displacement = ( int32_t )( stub_rva - ( rva + 5 ) );
+                bytes[ rva ] = 0xE8;
+                memcpy( bytes.data() + rva + 1, &displacement, 4 );
+            };
+
+            for ( uint64_t boundary = text_rva + chunk_size; boundary < vmp_rva; boundary += chunk_size )
+                plant_call( boundary - 8 + rng() % 16 );
+            for ( size_t i = 0; i < text_size / 0x40; i++ )
+                plant_call( text_rva + rng() % text_size );
+            return bytes;
+        }
+
+        // Checks that the parallel scan yields exactly the calls and imports of the serial scan, in the same order, both sweeping
+        // every byte and prefiltered, on a synthetic module of pseudo-random code with calls planted around the chunk boundaries.
+        // Returns false on any mismatch.
+        //
+        bool run_parallel_scan_check()
+        {
+            constexpr size_t text_size = 0x10000;
+            constexpr size_t chunk_size = 0x400;
+            constexpr remote_ea_t module_base = 0x140000000;
+
+            log<CON_GRN>( "** Checking the parallel scan against the serial scan\r\n" );
+
+            std::vector<uint8_t> bytes = build_scan_module( text_size, chunk_size );
+            std::shared_ptr<simulated_memory_source> source = std::make_shared<simulated_memory_source>();
+            source->add_module( module_base, "synthetic.exe", bytes );
+            vmpdump instance( source, source->get_modules(), std::make_unique<module_view>( source, "synthetic.exe", module_base, bytes.size() ), "synthetic.exe" );
+            instance.worker_count = 4;
+            instance.chunk_size = chunk_size;
+
+            const uint32_t flag_sets[] = { scan_emulate, scan_emulate | scan_prefilter };
+
+            bool passed = true;
+            for ( uint32_t flags : flag_sets )
+            {
+                std::map<uint64_t, resolved_import> serial_imports, parallel_imports;
+                std::vector<import_call> serial_calls, parallel_calls;
+                instance.scan_for_imports( serial_imports, serial_calls, flags );
+                instance.scan_for_imports( parallel_imports, parallel_calls, flags | scan_parallel );
+
+                auto same_call = [ ] ( const import_call& a, const import_call& b )
+                {
+                    return a.call_rva == b.call_rva && a.call_size == b.call_size && a.import->thunk_rva == b.import->thunk_rva && a.import->target_ea == b.import->target_ea &&
+                           a.stack_adjustment == b.stack_adjustment && a.padded == b.padded && a.is_jmp == b.is_jmp &&
+                           a.prev_instruction.has_value() == b.prev_instruction.has_value() && ( !a.prev_instruction || a.prev_instruction->address == b.prev_instruction->address );
+                };
+                bool calls_match = std::equal( serial_calls.begin(), serial_calls.end(), parallel_calls.begin(), parallel_calls.end(), same_call );
+                bool imports_match = std::equal( serial_imports.begin(), serial_imports.end(), parallel_imports.begin(), parallel_imports.end(), [ ] ( const auto& a, const auto& b )
+                {
+                    return a.first == b.first && a.second.target_ea == b.second.target_ea;
+                } );
+
+                const char* name = flags & scan_prefilter ? "prefiltered" : "exact";
+                if ( calls_match && imports_match && !serial_calls.empty() )
+                {
+                    log<CON_CYN>( "\t   %s: %llu calls to %llu imports over %llu chunks, identical\r\n", name, serial_calls.size(), serial_imports.size(), text_size / chunk_size );
+                    continue;
+                }
+
+                passed = false;
+                log<CON_RED>( "\t   %s: serial found %llu calls to %llu imports, parallel %llu calls to %llu imports\r\n", name, serial_calls.size(), serial_imports.size(),
+                              parallel_calls.size(), parallel_imports.size() );
+                for ( size_t i = 0; i < std::max( serial_calls.size(), parallel_calls.size() ); i++ )
+                {
+                    if ( i < serial_calls.size() && i < parallel_calls.size() && same_call( serial_calls[ i ], parallel_calls[ i ] ) )
+                        continue;
+
+                    log<CON_RED>( "\t   first mismatch at call #%llu: serial @ RVA 0x%llx, parallel @ RVA 0x%llx\r\n", i, i < serial_calls.size() ? serial_calls[ i ].call_rva : 0,
+                                  i < parallel_calls.size() ? parallel_calls[ i ].call_rva : 0 );
+                    break;
+                }
+            }
+            return passed;
+        }
+
+        // Builds an operand of the given register.
+        //
+        static cs_x86_op register_operand( x86_reg reg )
+        {
+            cs_x86_op op = {};
+            op.type = X86_OP_REG;
+            op.reg = reg;
+            op.size = get_register_info( reg ).size;
+            return op;
+        }
+
+        // Builds an immediate operand.
+        //
+        static cs_x86_op immediate_operand( int64_t value )
+        {
+            cs_x86_op op = {};
+            op.type = X86_OP_IMM;
+            op.imm = value;
+            op.size = 8;
+            return op;
+        }
+
+        // Builds a memory operand of the given base and displacement. For rip-relative operands, the displacement is the
+        // rva referenced, which stub_builder turns into a displacement once the address of the instruction is known.
+        //
+        static cs_x86_op memory_operand( x86_reg base, int64_t disp, uint8_t size = 8 )
+        {
+            cs_x86_op op = {};
+            op.type = X86_OP_MEM;
+            op.mem.base = base;
+            op.mem.disp = disp;
+            op.size = size;
+            op.access = CS_AC_READ | CS_AC_WRITE;
+            return op;
+        }
+
+        // Helper used to build instruction streams by hand, without decoding them. Every instruction is given the same length.
+        //
+        struct stub_builder
+        {
+            static constexpr uint8_t instruction_size = 4;
+
+            compact_stream stream;
+            uint64_t address;
+
+            stub_builder( uint64_t rva ) : address( rva ) {}
+
+            // Appends an instruction, along with the registers it writes besides its operands.
+            //
+            stub_builder& emit( uint32_t id, std::initializer_list<cs_x86_op> operands = {}, std::initializer_list<x86_reg> written = {} )
+            {
+                compact_instruction ins = {};
+                ins.address = address;
+                ins.id = id;
+                ins.size = instruction_size;
+
+                for ( cs_x86_op op : operands )
+                {
+                    if ( op.type == X86_OP_MEM && op.mem.base == X86_REG_RIP )
+                        op.mem.disp -= address + instruction_size;
+                    ins.operands[ ins.op_count++ ] = op;
+                }
+                for ( x86_reg reg : written )
+                    ins.regs_written.insert( reg );
+
+                stream.push_back( ins );
+                address += instruction_size;
+                return *this;
+            }
+        };
+
+        // The stub shapes written by build_stub, named after the classifier templates they match.
+        //
+        static const char* const stub_shapes[] = { "call", "call_padded", "call_padded_add", "jmp", "call_pushed", "call_pushed_padded" };
+
+        // A hand-written stub, along with the analysis it must be given.
+        //
+        struct stub_case
+        {
+            compact_stream stream;
+            import_stub_analysis expected;
+        };
+
+        // Writes a stub of the given shape at the given rva, loading the given thunk and adding the given constant to it.
+        // If mutated, flag-only instructions and self-moves are mixed in, the constants are added with sub and inc instead of
+        // lea and add, the exchange has its operands swapped, and r11 is used instead of rax. Returns empty {} for an unknown shape.
+        //
+        static std::optional<stub_case> build_stub( std::string_view shape, bool mutated, uint64_t rva, uint64_t thunk, int64_t constant )
+        {
+            const x86_reg reg = mutated ? X86_REG_R11 : X86_REG_RAX;
+            const cs_x86_op scratch = register_operand( reg );
+
+            stub_builder builder( rva );
+            auto junk = [ & ] ()
+            {
+                if ( mutated )
+                {
+                    builder.emit( X86_INS_CMP, { register_operand( X86_REG_RCX ), immediate_operand( 0x10 ) } );
+                    builder.emit( X86_INS_MOV, { register_operand( X86_REG_RDX ), register_operand( X86_REG_RDX ) } );
+                    builder.emit( X86_INS_TEST, { scratch, scratch } );
+                }
+            };
+            auto load_thunk = [ & ] ()
+            {
+                builder.emit( X86_INS_MOV, { scratch, memory_operand( X86_REG_RIP, thunk ) } );
+                junk();
+                if ( mutated )
+                    builder.emit( X86_INS_SUB, { scratch, immediate_operand( -constant ) } );
+                else
+                    builder.emit( X86_INS_LEA, { scratch, memory_operand( reg, constant ) } );
+                if ( mutated )
+                    builder.emit( X86_INS_XCHG, { memory_operand( X86_REG_RSP, 0 ), scratch } );
+                else
+                    builder.emit( X86_INS_XCHG, { scratch, memory_operand( X86_REG_RSP, 0 ) } );
+            };
+            auto pad = [ & ] ()
+            {
+                if ( mutated )
+                    builder.emit( X86_INS_INC, { scratch } );
+                else
+                    builder.emit( X86_INS_LEA, { scratch, memory_operand( reg, 1 ) } );
+            };
+            auto ret = [ & ] ( int64_t released )
+            {
+                if ( released )
+                    builder.emit( X86_INS_RET, { immediate_operand( released ) } );
+                else
+                    builder.emit( X86_INS_RET );
+            };
+
+            builder.emit( X86_INS_PUSH, { scratch } );
+            junk();
+
+            import_stub_analysis expected = { thunk, ( uintptr_t )constant, 0, false, false };
+            if ( shape == "call" )
+            {
+                load_thunk();
+                ret( 0 );
+            }
+            else if ( shape == "call_padded" )
+            {
+                builder.emit( X86_INS_MOV, { scratch, memory_operand( X86_REG_RSP, 8 ) } );
+                pad();
+                builder.emit( X86_INS_MOV, { memory_operand( X86_REG_RSP, 8 ), scratch } );
+                load_thunk();
+                ret( 0 );
+                expected.padding = true;
+            }
+            else if ( shape == "call_padded_add" )
+            {
+                if ( mutated )
+                    builder.emit( X86_INS_INC, { memory_operand( X86_REG_RSP, 8 ) } );
+                else
+                    builder.emit( X86_INS_ADD, { memory_operand( X86_REG_RSP, 8 ), immediate_operand( 1 ) } );
+                load_thunk();
+                ret( 0 );
+                expected.padding = true;
+            }
+            else if ( shape == "jmp" )
+            {
+                load_thunk();
+                ret( 8 );
+                expected.is_jmp = true;
+            }
+            else if ( shape == "call_pushed" || shape == "call_pushed_padded" )
+            {
+                builder.emit( X86_INS_MOV, { scratch, memory_operand( X86_REG_RSP, 8 ) } );
+                if ( shape == "call_pushed_padded" )
+                    pad();
+                builder.emit( X86_INS_MOV, { memory_operand( X86_REG_RSP, 0x10 ), scratch } );
+                load_thunk();
+                ret( 8 );
+                expected.stack_adjustment = 8;
+                expected.padding = shape == "call_pushed_padded";
+            }
+            else
+            {
+                return {};
+            }
+
+            return stub_case { builder.stream, expected };
+        }
+
+        // A hand-written stream which is not a stub, or which the emulator does not model, along with the status it must be given.
+        //
+        struct non_stub_case
+        {
+            const char* name;
+            compact_stream stream;
+            emulation_status expected;
+        };
+
+        // Writes streams which are not stubs, and streams using forms the emulator does not model, at the given rva.
+        //
+        static std::vector<non_stub_case> build_non_stubs( uint64_t rva, uint64_t thunk )
+        {
+            std::vector<non_stub_case> cases;
+            auto add = [ & ] ( const char* name, emulation_status expected, auto&& write )
+            {
+                stub_builder builder( rva );
+                write( builder );
+                cases.push_back( { name, builder.stream, expected } );
+            };
+
+            const cs_x86_op rax = register_operand( X86_REG_RAX );
+            const cs_x86_op top = memory_operand( X86_REG_RSP, 0 );
+
+            add( "constant destination", emulation_status::not_stub, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_MOV, { rax, immediate_operand( 0x140001000 ) } ).emit( X86_INS_XCHG, { rax, top } ).emit( X86_INS_RET );
+            } );
+            add( "stack destination", emulation_status::not_stub, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_LEA, { rax, memory_operand( X86_REG_RSP, 0x10 ) } ).emit( X86_INS_XCHG, { rax, top } ).emit( X86_INS_RET );
+            } );
+            add( "plain return", emulation_status::not_stub, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_RET );
+            } );
+            add( "global write", emulation_status::unsupported, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_MOV, { memory_operand( X86_REG_RIP, thunk + 8 ), rax } ).emit( X86_INS_MOV, { rax, memory_operand( X86_REG_RIP, thunk ) } );
+                builder.emit( X86_INS_XCHG, { rax, top } ).emit( X86_INS_RET );
+            } );
+            add( "partial stack write", emulation_status::unsupported, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_MOV, { memory_operand( X86_REG_RSP, 4, 4 ), register_operand( X86_REG_EAX ) } ).emit( X86_INS_MOV, { rax, memory_operand( X86_REG_RIP, thunk ) } );
+                builder.emit( X86_INS_XCHG, { rax, top } ).emit( X86_INS_RET );
+            } );
+            add( "clobbered thunk", emulation_status::unsupported, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_MOV, { rax, memory_operand( X86_REG_RIP, thunk ) } ).emit( X86_INS_SHL, { rax, immediate_operand( 1 ) }, { X86_REG_RAX } );
+                builder.emit( X86_INS_XCHG, { rax, top } ).emit( X86_INS_RET );
+            } );
+            add( "clobbered stack pointer", emulation_status::unsupported, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_SHR, { register_operand( X86_REG_RSP ), immediate_operand( 1 ) }, { X86_REG_RSP } ).emit( X86_INS_RET );
+            } );
+            add( "unmodeled instruction", emulation_status::unsupported, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_CALL, { memory_operand( X86_REG_RIP, thunk ) } ).emit( X86_INS_RET );
+            } );
+            add( "no return", emulation_status::unsupported, [ & ] ( stub_builder& builder )
+            {
+                builder.emit( X86_INS_PUSH, { rax } ).emit( X86_INS_MOV, { rax, memory_operand( X86_REG_RIP, thunk ) } ).emit( X86_INS_XCHG, { rax, top } );
+            } );
+            return cases;
+        }
+
+        // Checks the stub emulator against hand-written streams: every known stub shape, plain and mutated, must be resolved to
+        // exactly the analysis it implies, streams which are not stubs must be rejected, and streams using forms the emulator does
+        // not model must be reported as unsupported. Returns false on any mismatch.
+        //
+        bool run_emulator_check()
+        {
+            log<CON_GRN>( "** Checking the stub emulator on hand-written stubs\r\n" );
+
+            stub_emulator emulator;
+            size_t cases = 0;
+            size_t failures = 0;
+            uint64_t rva = 0x1000;
+
+            for ( const char* shape : stub_shapes )
+            {
+                for ( bool mutated : { false, true } )
+                {
+                    std::optional<stub_case> stub = build_stub( shape, mutated, rva, 0x9000 + rva, 0x7FF612340000 + rva );
+                    emulation_result result = emulator.emulate( stub->stream );
+                    cases++;
+
+                    if ( result.status != emulation_status::resolved || result.analysis != stub->expected )
+                    {
+                        failures++;
+                        log<CON_RED>( "\t   %s%s stub @ RVA 0x%llx: expected [%s], got [%s]\r\n", shape, mutated ? " (mutated)" : "", rva, describe_analysis( stub->expected ), describe_analysis( result.analysis ) );
+                    }
+                    rva += 0x100;
+                }
+            }
+
+            for ( const non_stub_case& stream : build_non_stubs( rva, 0x9000 + rva ) )
+            {
+                emulation_result result = emulator.emulate( stream.stream );
+                cases++;
+
+                if ( result.status != stream.expected || result.analysis )
+                {
+                    failures++;
+                    log<CON_RED>( "\t   %s: expected status %i, got status %i [%s]\r\n", stream.name, ( int )stream.expected, ( int )result.status, describe_analysis( result.analysis ) );
+                }
+            }
+
+            if ( !failures )
+                log<CON_CYN>( "\t   %llu streams emulated as expected\r\n", cases );
+            return failures == 0;
+        }
+
+        // Checks the stub classifier against hand-written streams: every template must match its own shape, plain and mutated,
+        // with exactly the analysis it implies, and streams which are not stubs must match none. Returns false on any mismatch.
+        //
+        bool run_classifier_check()
+        {
+            log<CON_GRN>( "** Checking the stub classifier on hand-written stubs\r\n" );
+
+            stub_classifier classifier;
+            const std::vector<stub_template>& templates = stub_classifier::templates();
+            size_t cases = 0;
+            size_t failures = 0;
+            uint64_t rva = 0x1000;
+
+            for ( size_t i = 0; i < templates.size(); i++ )
+            {
+                for ( bool mutated : { false, true } )
+                {
+                    std::optional<stub_case> stub = build_stub( templates[ i ].name, mutated, rva, 0x9000 + rva, 0x7FF612340000 + rva );
+                    if ( !stub )
+                    {
+                        failures++;
+                        log<CON_RED>( "\t   template %s has no hand-written stub\r\n", templates[ i ].name );
+                        break;
+                    }
+
+                    std::optional<import_stub_analysis> analysis = classifier.classify( stub->stream );
+                    cases++;
+
+                    if ( analysis != stub->expected )
+                    {
+                        failures++;
+                        log<CON_RED>( "\t   %s%s stub @ RVA 0x%llx: expected [%s], got [%s]\r\n", templates[ i ].name, mutated ? " (mutated)" : "", rva, describe_analysis( stub->expected ), describe_analysis( analysis ) );
+                    }
+                    rva += 0x100;
+                }
+
+                // Both variants must have matched this template, rather than another one implying the same analysis.
+                //
+                if ( classifier.hit_count( i ) != 2 )
+                {
+                    failures++;
+                    log<CON_RED>( "\t   template %s matched %llu times, expected 2\r\n", templates[ i ].name, classifier.hit_count( i ) );
+                }
+            }
+
+            for ( const non_stub_case& stream : build_non_stubs( rva, 0x9000 + rva ) )
+            {
+                std::optional<import_stub_analysis> analysis = classifier.classify( stream.stream );
+                cases++;
+
+                if ( analysis )
+                {
+                    failures++;
+                    log<CON_RED>( "\t   %s: expected no match, got [%s]\r\n", stream.name, describe_analysis( analysis ) );
+                }
+            }
+
+            if ( !failures )
+                log<CON_CYN>( "\t   %llu streams classified as expected\r\n", cases );
+            return failures == 0;
+        }
+
+        // Checks the stub clusters against hand-written streams: the rule of a shape must be learnt from its first members and
+        // confirmed, the analysis of the rest derived from their own operands, except for the spot checks, and a spot check which
+        // disagrees must drop the rule and hand back every member derived from it. Shapes which are not stubs must be derived as
+        // such, and shapes whose analysis cannot be derived from their operands must always be analyzed in full. When verifying,
+        // every member must be analyzed in full and checked against the rule. Returns false on any mismatch.
+        //
+        bool run_cluster_check()
+        {
+            log<CON_GRN>( "** Checking the stub clusters on hand-written stubs\r\n" );
+
+            stub_clusters clusters;
+            size_t failures = 0;
+            uint64_t rva = 0x1000;
+
+            // Analyzes the stream through the clusters, with the given result for the full analysis, checking whether
+            // it was run and the analysis returned.
+            //
+            auto check = [ & ] ( const char* name, const compact_stream& stream, const std::optional<import_stub_analysis>& full_result,
+                                 bool expect_full, const std::optional<import_stub_analysis>& expected )
+            {
+                bool full = false;
+                std::optional<import_stub_analysis> analysis = clusters.analyze( stream, [ & ] () { full = true; return full_result; } );
+
+                if ( full != expect_full || analysis != expected )
+                {
+                    failures++;
+                    log<CON_RED>( "\t   %s @ RVA 0x%llx: expected %s [%s], got %s [%s]\r\n", name, stream.rva(), expect_full ? "full analysis" : "derivation", describe_analysis( expected ),
+                                  full ? "full analysis" : "derivation", describe_analysis( analysis ) );
+                }
+                return full;
+            };
+
+            // The members of a shape, alternating between the plain and mutated forms, which normalize alike. The first members
+            // are analyzed in full, and the rest derived, but for the spot check on the last one, whose full analysis disagrees.
+            //
+            std::vector<uint64_t> derived_rvas;
+            for ( uint64_t member = 1; member <= stub_clusters::spot_check_interval; member++, rva += 0x100 )
+            {
+                stub_case stub = *build_stub( "call", member % 2, rva, 0x9000 + rva, 0x7FF612340000 + rva );
+                bool spot_check = member == stub_clusters::spot_check_interval;
+
+                std::optional<import_stub_analysis> full_result = stub.expected;
+                if ( spot_check )
+                    full_result->stack_adjustment = 8;
+
+                if ( !check( "call", stub.stream, full_result, member <= stub_clusters::confirm_count || spot_check, full_result ) )
+                    derived_rvas.push_back( rva );
+            }
+
+            std::vector<uint64_t> invalidated = clusters.take_invalidated();
+            bool invalidated_match = invalidated == derived_rvas && !derived_rvas.empty() && clusters.take_invalidated().empty();
+            if ( !invalidated_match )
+            {
+                failures++;
+                log<CON_RED>( "\t   %llu members invalidated after the disagreement, expected %llu\r\n", invalidated.size(), derived_rvas.size() );
+            }
+
+            // Once the rule was dropped, every later member is analyzed in full.
+            //
+            for ( uint64_t member = 0; member < stub_clusters::confirm_count + 1; member++, rva += 0x100 )
+            {
+                stub_case stub = *build_stub( "call", false, rva, 0x9000 + rva, 0x7FF612340000 + rva );
+                check( "call after disagreement", stub.stream, stub.expected, true, stub.expected );
+            }
+
+            // A shape which is not a stub is derived as such once confirmed.
+            //
+            for ( uint64_t member = 1; member <= stub_clusters::confirm_count + 1; member++, rva += 0x100 )
+            {
+                const non_stub_case& stream = build_non_stubs( rva, 0x9000 + rva ).front();
+                check( stream.name, stream.stream, std::nullopt, member <= stub_clusters::confirm_count, std::nullopt );
+            }
+
+            // A shape whose analysis names a thunk none of its operands reference has no rule.
+            //
+            for ( uint64_t member = 1; member <= stub_clusters::confirm_count + 1; member++, rva += 0x100 )
+            {
+                stub_case stub = *build_stub( "jmp", false, rva, 0x9000 + rva, 0x7FF612340000 + rva );
+                stub.expected.thunk_rva = 0x20000 + rva;
+                check( "jmp with a foreign thunk", stub.stream, stub.expected, true, stub.expected );
+            }
+
+            // When verifying, every member is analyzed in full and checked against the rule, so a disagreement drops the rule
+            // without any derived member to hand back.
+            //
+            stub_clusters verified;
+            uint64_t verified_analyses = 0;
+            for ( uint64_t member = 1; member <= stub_clusters::confirm_count + 2; member++, rva += 0x100 )
+            {
+                stub_case stub = *build_stub( "call", member % 2, rva, 0x9000 + rva, 0x7FF612340000 + rva );
+                if ( member == stub_clusters::confirm_count + 2 )
+                    stub.expected.is_jmp = true;
+
+                std::optional<import_stub_analysis> analysis = verified.analyze( stub.stream, [ & ] () { verified_analyses++; return std::optional{ stub.expected }; }, true );
+                if ( analysis != stub.expected )
+                {
+                    failures++;
+                    log<CON_RED>( "\t   verified call @ RVA 0x%llx: expected [%s], got [%s]\r\n", rva, describe_analysis( stub.expected ), describe_analysis( analysis ) );
+                }
+            }
+
+            bool verified_match = verified_analyses == stub_clusters::confirm_count + 2 && verified.derived_count() == 0 && verified.disagreement_count() == 1 &&
+                                  verified.take_invalidated().empty();
+            if ( !verified_match )
+            {
+                failures++;
+                log<CON_RED>( "\t   verifying: %llu full analyses, %llu derived, %llu disagreements\r\n", verified_analyses, verified.derived_count(), verified.disagreement_count() );
+            }
+
+            bool counts_match = clusters.cluster_count() == 3 && clusters.disagreement_count() == 1 && clusters.spot_check_count() == 1 &&
+                                clusters.derived_count() == derived_rvas.size() + 1;
+            if ( !counts_match )
+            {
+                failures++;
+                log<CON_RED>( "\t   %llu clusters, %llu disagreements, %llu spot checks, %llu derived\r\n", clusters.cluster_count(), clusters.disagreement_count(),
+                              clusters.spot_check_count(), clusters.derived_count() );
+            }
+
+            if ( !failures )
+                log<CON_CYN>( "\t   %llu analyses derived and %llu run in full as expected\r\n", clusters.derived_count(), clusters.analyzed_count() );
+            return failures == 0;
+        }
+
+        // Runs every check which needs no target: the encoder and export cross-checks, and the page cache, parallel scan, commit,
+        // live, minidump, stub emulator, stub classifier and stub cluster checks. Returns false if any of them failed.
+        //
+        bool run_self_tests()
+        {
+            bool passed = run_encoder_benchmark();
+            passed &= run_export_benchmark();
+            passed &= run_page_cache_check();
+            passed &= run_parallel_scan_check();
+            passed &= run_commit_check();
+            passed &= run_live_check();
+            passed &= run_minidump_check();
+            passed &= run_emulator_check();
+            passed &= run_classifier_check();
+            passed &= run_cluster_check();
+
+            if ( passed )
+                log<CON_GRN>( "** All checks passed\r\n" );
+            else
+                log<CON_RED>( "** Some checks failed\r\n" );
+            return passed;
+        }
+    }
+}
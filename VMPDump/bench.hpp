@@ -0,0 +1,83 @@
+#pragma once
+#include "vmpdump.hpp"
+
+namespace vmpdump
+{
+    namespace bench
+    {
+        // Times the exact linear sweep against the prefiltered sweep over all executable sections of the
+        // target module, as well as the raw prefilter for each supported vector instruction set, logging
+        // the throughput of each in bytes per second. Also times fetching the module.
+        //
+        void run_scan_benchmark( vmpdump& instance );
+
+        // Times export resolution through the export index against the linear scan of the export tables it
+        // replaces, on a synthetic module with 3,000 exports, checking that both agree on every export.
+        // Returns false if they disagree, or if an export is not resolved.
+        //
+        bool run_export_benchmark();
+
+        // Cross-checks the branch encoder byte for byte against Keystone, for every form emitted when patching calls, on
+        // randomized addresses, and times both. Indirect branches are also checked in modules based below 2 GB, where both
+        // their rip-relative and absolute forms are encodable, so the form chosen must match too. Returns false if any
+        // encoding disagrees.
+        //
+        bool run_encoder_benchmark();
+
+        // Checks that committing a module view to a simulated module writes exactly its patched bytes, with adjacent patches
+        // coalesced into a single write, leaving the rest of their pages as they are remotely, and clears the dirty bits of
+        // the pages written, but not of those which failed. Returns false on any mismatch.
+        //
+        bool run_commit_check();
+
+        // Checks the order in which fix_live writes to a simulated process: at every write, each call already redirected
+        // must lead, through its stub if it has one, to a thunk already holding the import, and each stub written must
+        // lead to such a thunk too. Also checks that thunks are moved elsewhere if the range they were laid out in holds data,
+        // and that writes spanning pages of different protections restore each. Returns false on any violation.
+        //
+        bool run_live_check();
+
+        // Checks the minidump source against a small synthetic dump, built in memory and written to a temporary file: the
+        // module list, ranges from both the Memory64ListStream and the MemoryListStream, a read spanning two ranges which are
+        // adjacent in memory but not in the dump, and mapping. Returns false on any mismatch.
+        //
+        bool run_minidump_check();
+
+        // Checks the page cache against a synthetic module of 256 pages with every eighth page unreadable, fetched lazily: only the
+        // batch holding the headers is read up front, ensuring a range fails exactly if it overlaps a hole, exactly the holes are
+        // recorded as unreadable and left zero, and every other byte matches. Also times fetching the whole module. Returns false
+        // on any mismatch.
+        //
+        bool run_page_cache_check();
+
+        // Checks that the parallel scan yields exactly the calls and imports of the serial scan, in the same order, both sweeping
+        // every byte and prefiltered, on a synthetic module of pseudo-random code with calls planted around the chunk boundaries.
+        // Returns false on any mismatch.
+        //
+        bool run_parallel_scan_check();
+
+        // Checks the stub emulator against hand-written streams: every known stub shape, plain and mutated, must be resolved to
+        // exactly the analysis it implies, streams which are not stubs must be rejected, and streams using forms the emulator does
+        // not model must be reported as unsupported. Returns false on any mismatch.
+        //
+        bool run_emulator_check();
+
+        // Checks the stub classifier against hand-written streams: every template must match its own shape, plain and mutated,
+        // with exactly the analysis it implies, and streams which are not stubs must match none. Returns false on any mismatch.
+        //
+        bool run_classifier_check();
+
+        // Checks the stub clusters against hand-written streams: the rule of a shape must be learnt from its first members and
+        // confirmed, the analysis of the rest derived from their own operands, except for the spot checks, and a spot check which
+        // disagrees must drop the rule and hand back every member derived from it. Shapes which are not stubs must be derived as
+        // such, and shapes whose analysis cannot be derived from their operands must always be analyzed in full. When verifying,
+        // every member must be analyzed in full and checked against the rule. Returns false on any mismatch.
+        //
+        bool run_cluster_check();
+
+        // Runs every check which needs no target: the encoder and export cross-checks, and the page cache, parallel scan, commit,
+        // live, minidump, stub emulator, stub classifier and stub cluster checks. Returns false if any of them failed.
+        //
+        bool run_self_tests();
+    }
+}
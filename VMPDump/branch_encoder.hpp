@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+
+namespace vmpdump
+{
+    // The branch instructions emitted when patching calls.
+    //
+    enum class branch_type
+    {
+        call,
+        jmp,
+    };
+
+    // A branch, encoded in place without allocating.
+    //
+    struct encoded_branch
+    {
+        // The longest form emitted is call/jmp [disp32], at 7 bytes.
+        //
+        static constexpr size_t max_size = 7;
+
+        uint8_t bytes[ max_size ] = {};
+        uint8_t size = 0;
+
+        constexpr const uint8_t* begin() const { return bytes; }
+        constexpr const uint8_t* end() const { return bytes + size; }
+    };
+
+    // A direct encoder for the few branch forms the patcher emits, replacing a round-trip through assembly text and Keystone.
+    // The forms chosen for a given address and target are the ones Keystone picks.
+    //
+    namespace branch_encoder
+    {
+        constexpr bool fits_int8( int64_t value ) { return value >= INT8_MIN && value <= INT8_MAX; }
+        constexpr bool fits_int32( int64_t value ) { return value >= INT32_MIN && value <= INT32_MAX; }
+
+        // Appends the little-endian 32-bit value to the encoding.
+        //
+        constexpr void append_int32( encoded_branch& branch, int32_t value )
+        {
+            for ( int i = 0; i < 4; i++ )
+                branch.bytes[ branch.size++ ] = ( uint8_t )( ( uint32_t )value >> ( i * 8 ) );
+        }
+
+        // Encodes a branch at the given address through the pointer at the given address: call/jmp [rip + disp32] if it is
+        // within reach, or call/jmp [disp32] if the address fits a sign-extended disp32. Returns nullopt if neither does.
+        //
+        template<branch_type type>
+        constexpr std::optional<encoded_branch> encode_indirect( uint64_t address, uint64_t pointer )
+        {
+            // FF /2 is an indirect call, FF /4 an indirect jump.
+            //
+            constexpr uint8_t reg = type == branch_type::call ? 2 : 4;
+
+            encoded_branch branch = {};
+            branch.bytes[ branch.size++ ] = 0xFF;
+
+            int64_t displacement = ( int64_t )( pointer - ( address + 6 ) );
+            if ( fits_int32( displacement ) )
+            {
+                branch.bytes[ branch.size++ ] = ( reg << 3 ) | 0b101;
+                append_int32( branch, ( int32_t )displacement );
+                return branch;
+            }
+
+            if ( fits_int32( ( int64_t )pointer ) )
+            {
+                branch.bytes[ branch.size++ ] = ( reg << 3 ) | 0b100;
+                branch.bytes[ branch.size++ ] = 0x25;
+                append_int32( branch, ( int32_t )pointer );
+                return branch;
+            }
+
+            return {};
+        }
+
+        // Encodes a relative branch at the given address to the target: call rel32, or jmp rel8 if the target is within reach
+        // and jmp rel32 otherwise. Returns nullopt if the target is out of reach.
+        //
+        template<branch_type type>
+        constexpr std::optional<encoded_branch> encode_relative( uint64_t address, uint64_t target )
+        {
+            encoded_branch branch = {};
+
+            if constexpr ( type == branch_type::jmp )
+            {
+                int64_t displacement = ( int64_t )( target - ( address + 2 ) );
+                if ( fits_int8( displacement ) )
+                {
+                    branch.bytes[ branch.size++ ] = 0xEB;
+                    branch.bytes[ branch.size++ ] = ( uint8_t )displacement;
+                    return branch;
+                }
+            }
+
+            int64_t displacement = ( int64_t )( target - ( address + 5 ) );
+            if ( !fits_int32( displacement ) )
+                return {};
+
+            branch.bytes[ branch.size++ ] = type == branch_type::call ? 0xE8 : 0xE9;
+            append_int32( branch, ( int32_t )displacement );
+            return branch;
+        }
+
+        // Encodes either branch type, selected at runtime.
+        //
+        inline std::optional<encoded_branch> encode_indirect( branch_type type, uint64_t address, uint64_t pointer )
+        {
+            return type == branch_type::call ? encode_indirect<branch_type::call>( address, pointer ) : encode_indirect<branch_type::jmp>( address, pointer );
+        }
+
+        inline std::optional<encoded_branch> encode_relative( branch_type type, uint64_t address, uint64_t target )
+        {
+            return type == branch_type::call ? encode_relative<branch_type::call>( address, target ) : encode_relative<branch_type::jmp>( address, target );
+        }
+
+        static_assert( encode_indirect<branch_type::call>( 0x140001000, 0x140003000 )->size == 6 );
+        static_assert( encode_indirect<branch_type::jmp>( 0x7FF600001000, 0x10000 )->bytes[ 2 ] == 0x25 );
+        static_assert( encode_relative<branch_type::jmp>( 0x1000, 0x1010 )->size == 2 );
+        static_assert( encode_relative<branch_type::call>( 0x1000, 0x1010 )->bytes[ 1 ] == 0x0B );
+    }
+}
@@ -0,0 +1,180 @@
+#include "code_cave_allocator.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace vmpdump
+{
+    // Returns where the padding within the run of zeros [begin, end) starts, or empty {} if it cannot be told apart from data.
+    // The run is padding if it ends the section, at section_end, or if it ends at an aligned function start of the exception
+    // directory, in which case the padding starts after the end of the function before it.
+    //
+    static std::optional<uint64_t> find_zero_padding( const std::vector<std::pair<uint32_t, uint32_t>>& functions, uint64_t begin, uint64_t end, uint64_t section_end )
+    {
+        if ( end == section_end )
+            return begin;
+
+        if ( end % code_cave_allocator::function_alignment )
+            return {};
+
+        auto next = std::lower_bound( functions.begin(), functions.end(), std::pair<uint32_t, uint32_t>{ ( uint32_t )end, 0 } );
+        if ( next == functions.end() || next->first != end )
+            return {};
+
+        if ( next != functions.begin() )
+            begin = std::max<uint64_t>( begin, std::prev( next )->second );
+        return std::min( begin, end );
+    }
+
+    // Indexes the caves of every executable section which is not a VMP section.
+    //
+    void code_cave_allocator::index()
+    {
+        using namespace win;
+
+        nt_headers_x64_t* nt = view.local_module.get_image()->get_nt_headers();
+        const uint8_t* bytes = view.local_module.cdata();
+        uint32_t section_alignment = nt->optional_header.section_alignment;
+
+        // Gather the functions of the exception directory, sorted, which tell padding between functions apart from data.
+        //
+        std::vector<std::pair<uint32_t, uint32_t>> functions;
+        if ( nt->optional_header.num_data_directories > ( uint32_t )directory_id::directory_entry_exception )
+        {
+            data_directory_t& exception_directory = nt->optional_header.data_directories.exception_directory;
+            if ( exception_directory.present() && view.ensure( exception_directory.rva, exception_directory.size ) )
+            {
+                const runtime_function_t* entries = ( const runtime_function_t* )( bytes + exception_directory.rva );
+                for ( size_t i = 0; i < exception_directory.size / sizeof( runtime_function_t ); i++ )
+                    functions.push_back( { entries[ i ].rva_begin, entries[ i ].rva_end } );
+                std::sort( functions.begin(), functions.end() );
+            }
+        }
+
+        for ( int i = 0; i < nt->file_header.num_sections; i++ )
+        {
+            section_header_t* section = nt->get_section( i );
+            if ( !section->characteristics.mem_execute || is_vmp_section( section ) || !section->virtual_size )
+                continue;
+
+            // The section may grow up to its aligned end, or the next section, whichever comes first.
+            //
+            uint64_t begin = section->virtual_address;
+            uint64_t end = begin + section->virtual_size;
+            uint64_t aligned_end = ( end + section_alignment - 1 ) & ~( uint64_t )( section_alignment - 1 );
+            for ( int j = 0; j < nt->file_header.num_sections; j++ )
+            {
+                uint64_t other = nt->get_section( j )->virtual_address;
+                if ( other >= end && other < aligned_end )
+                    aligned_end = other;
+            }
+            aligned_end = std::min<uint64_t>( aligned_end, view.module_size );
+            if ( end > aligned_end )
+                continue;
+
+            // Skip sections we cannot read fully, as their unreadable pages would look like padding.
+            //
+            if ( !view.ensure( begin, aligned_end - begin ) )
+                continue;
+
+            if ( aligned_end > end )
+            {
+                tail_caves.insert( { ( uint32_t )( aligned_end - end ), ( uint32_t )end } );
+                tail_sections[ ( uint32_t )end ] = i;
+            }
+
+            // Index the runs of int3 or zero bytes within the section.
+            //
+            for ( uint64_t rva = begin; rva < end; )
+            {
+                uint8_t pad = bytes[ rva ];
+                if ( pad != 0xCC && pad != 0x00 )
+                {
+                    rva++;
+                    continue;
+                }
+
+                uint64_t run_end = rva;
+                while ( run_end < end && bytes[ run_end ] == pad )
+                    run_end++;
+
+                uint64_t run_begin = rva;
+                rva = run_end;
+
+                // Zeros within code are as likely to be jump tables or other data, so only take those confirmed as padding.
+                //
+                if ( pad == 0x00 )
+                {
+                    std::optional<uint64_t> padding_begin = find_zero_padding( functions, run_begin, run_end, end );
+                    if ( !padding_begin )
+                        continue;
+                    run_begin = *padding_begin;
+                }
+
+                if ( run_end - run_begin >= padding_guard + ( pad == 0xCC ? min_int3_run : min_zero_run ) )
+                    padding_caves.insert( { ( uint32_t )( run_end - run_begin - padding_guard ), ( uint32_t )( run_begin + padding_guard ) } );
+            }
+        }
+    }
+
+    // Takes size bytes from the best fitting cave, growing its section if it is a tail cave, which sets grown.
+    //
+    std::optional<uint32_t> code_cave_allocator::allocate( uint32_t size, bool& grown )
+    {
+        // Prefer padding, which leaves the headers untouched.
+        //
+        if ( auto it = padding_caves.lower_bound( { size, 0 } ); it != padding_caves.end() )
+        {
+            auto [cave_size, rva] = *it;
+            padding_caves.erase( it );
+            if ( cave_size > size )
+                padding_caves.insert( { cave_size - size, rva + size } );
+
+            grown = false;
+            return rva;
+        }
+
+        auto it = tail_caves.lower_bound( { size, 0 } );
+        if ( it == tail_caves.end() )
+            return {};
+
+        auto [cave_size, rva] = *it;
+        tail_caves.erase( it );
+        int section_index = tail_sections[ rva ];
+        tail_sections.erase( rva );
+        if ( cave_size > size )
+        {
+            tail_caves.insert( { cave_size - size, rva + size } );
+            tail_sections[ rva + size ] = section_index;
+        }
+
+        // Grow the section over the stub. Tail caves are always taken from their front, so the section stays contiguous.
+        //
+        win::section_header_t* section = view.local_module.get_image()->get_nt_headers()->get_section( section_index );
+        section->virtual_size = std::max( section->virtual_size, rva + size - section->virtual_address );
+        view.mark_dirty( ( uint8_t* )&section->virtual_size - view.local_module.data(), sizeof( section->virtual_size ) );
+
+        grown = true;
+        return rva;
+    }
+
+    // Allocates an 8-byte aligned cave of the given size for data rather than a stub, e.g. import thunks which have
+    // nowhere else to go. Returns its rva.
+    //
+    std::optional<uint32_t> code_cave_allocator::reserve( uint32_t size )
+    {
+        std::lock_guard _g( lock );
+
+        if ( !indexed )
+        {
+            index();
+            indexed = true;
+        }
+
+        constexpr uint32_t alignment = sizeof( uint64_t );
+        bool grown = false;
+        std::optional<uint32_t> rva = allocate( size + alignment - 1, grown );
+        if ( !rva )
+            return {};
+        return ( *rva + alignment - 1 ) & ~( alignment - 1 );
+    }
+}
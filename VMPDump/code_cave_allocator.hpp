@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <utility>
+#include "module_view.hpp"
+
+namespace vmpdump
+{
+    // A thread-safe allocator of code caves in the executable sections of a module, for the stubs calls are dispatched through.
+    // Two kinds of caves are indexed, on first use:
+    //
+    //      padding caves, runs of int3 bytes within the sections, which can be used as is, and runs of zero bytes which
+    //      are known to be padding: those ending the section, and those up to an aligned function start of the exception directory.
+    //      tail caves, the slack between the end of a section and its aligned end, used by growing the section.
+    //
+    // Padding caves are preferred, as they leave the headers untouched. Either kind is found in O(log n), best fit.
+    // VMP sections are never used, as their contents may be stripped from the output.
+    //
+    class code_cave_allocator
+    {
+    public:
+        // The number of padding bytes left untouched at the beginning of each padding run, in case the run was
+        // not padding after all, but the tail of the preceding instruction.
+        //
+        static constexpr uint32_t padding_guard = 1;
+
+        // The shortest padding runs indexed, excluding the guard. Shorter runs are mostly part of instructions, and zeros
+        // are more likely to be data than int3s are, so their runs must be longer.
+        //
+        static constexpr uint32_t min_int3_run = 8;
+        static constexpr uint32_t min_zero_run = 32;
+
+        // The alignment of the function starts runs of zeros must end at.
+        //
+        static constexpr uint32_t function_alignment = 16;
+
+    private:
+        // The module the caves are in.
+        //
+        module_view& view;
+
+        // Lock guarding the caves and the stubs.
+        //
+        std::mutex lock;
+        bool indexed = false;
+
+        // The free caves, as { size, rva }, and the section each tail cave grows.
+        //
+        std::set<std::pair<uint32_t, uint32_t>> padding_caves;
+        std::set<std::pair<uint32_t, uint32_t>> tail_caves;
+        std::map<uint32_t, int> tail_sections;
+
+        // Map of { thunk ea, stub rva }.
+        //
+        std::map<remote_ea_t, uint32_t> stubs;
+
+        // Statistics.
+        //
+        std::atomic<uint64_t> padding_stubs = { 0 };
+        std::atomic<uint64_t> tail_stubs = { 0 };
+
+        // Indexes the caves of every executable section which is not a VMP section.
+        //
+        void index();
+
+        // Takes size bytes from the best fitting cave, growing its section if it is a tail cave, which sets grown.
+        //
+        std::optional<uint32_t> allocate( uint32_t size, bool& grown );
+
+    public:
+        code_cave_allocator( module_view& view ) : view( view ) {}
+
+        // Returns the rva of the stub for the given thunk. On first use, a cave of the given size is allocated for it,
+        // and the stub is written into it by emit( rva ), which returns false on failure. Emitting is serialized.
+        //
+        template<typename F>
+        std::optional<uint32_t> get_or_emit( remote_ea_t thunk, uint32_t size, F&& emit )
+        {
+            std::lock_guard _g( lock );
+
+            auto it = stubs.find( thunk );
+            if ( it != stubs.end() )
+                return it->second;
+
+            if ( !indexed )
+            {
+                index();
+                indexed = true;
+            }
+
+            bool grown = false;
+            std::optional<uint32_t> rva = allocate( size, grown );
+            if ( !rva || !emit( *rva ) )
+                return {};
+
+            ( grown ? tail_stubs : padding_stubs )++;
+
+            stubs.insert( { thunk, *rva } );
+            return rva;
+        }
+
+        // Allocates an 8-byte aligned cave of the given size for data rather than a stub, e.g. import thunks which have
+        // nowhere else to go. Returns its rva.
+        //
+        std::optional<uint32_t> reserve( uint32_t size );
+
+        // Statistics.
+        //
+        inline uint64_t padding_stub_count() const { return padding_stubs.load(); }
+        inline uint64_t tail_stub_count() const { return tail_stubs.load(); }
+    };
+}
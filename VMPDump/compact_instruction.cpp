@@ -0,0 +1,55 @@
+#include "compact_instruction.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace vmpdump
+{
+    // Construct from a capstone instruction decoded with detail.
+    //
+    compact_instruction::compact_instruction( const cs_insn* ins )
+    {
+        const cs_detail* detail = ins->detail;
+
+        address = ins->address;
+        id = ins->id;
+        size = ( uint8_t )ins->size;
+        memcpy( bytes, ins->bytes, sizeof( bytes ) );
+
+        op_count = std::min<uint8_t>( detail->x86.op_count, max_operands );
+        truncated = detail->x86.op_count > max_operands;
+        memcpy( operands, detail->x86.operands, op_count * sizeof( cs_x86_op ) );
+
+        jump = false;
+        for ( int i = 0; i < detail->groups_count; i++ )
+            if ( detail->groups[ i ] == X86_GRP_JUMP )
+                jump = true;
+
+        // Collect the implicitly accessed registers.
+        //
+        for ( int i = 0; i < detail->regs_read_count; i++ )
+            regs_read.insert( ( x86_reg )detail->regs_read[ i ] );
+        for ( int i = 0; i < detail->regs_write_count; i++ )
+            regs_written.insert( ( x86_reg )detail->regs_write[ i ] );
+
+        // Collect the explicitly accessed registers, as cs_regs_access would.
+        //
+        for ( int i = 0; i < detail->x86.op_count; i++ )
+        {
+            const cs_x86_op& op = detail->x86.operands[ i ];
+
+            if ( op.type == X86_OP_REG )
+            {
+                if ( op.access & CS_AC_READ )
+                    regs_read.insert( op.reg );
+                if ( op.access & CS_AC_WRITE )
+                    regs_written.insert( op.reg );
+            }
+            else if ( op.type == X86_OP_MEM )
+            {
+                regs_read.insert( op.mem.segment );
+                regs_read.insert( op.mem.base );
+                regs_read.insert( op.mem.index );
+            }
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <capstone/capstone.h>
+#include <cstdint>
+#include "registers.hpp"
+
+namespace vmpdump
+{
+    // A decoded instruction, keeping only what VMPDump needs from the cs_insn and cs_detail.
+    // It is small, trivially copyable, and never allocates.
+    //
+    struct compact_instruction
+    {
+        // The maximum number of operands kept.
+        //
+        static constexpr int max_operands = 4;
+
+        // The address, which is the rva for instructions decoded by the disassembler.
+        //
+        uint64_t address;
+
+        // The capstone instruction id.
+        //
+        uint32_t id;
+
+        // The length and raw bytes of the instruction.
+        //
+        uint8_t size;
+        uint8_t bytes[ sizeof( cs_insn::bytes ) ];
+
+        // The number of operands kept, and whether the instruction had more operands than that.
+        //
+        uint8_t op_count;
+        bool truncated;
+
+        // Whether the instruction is in the jump group.
+        //
+        bool jump;
+
+        // The operands.
+        //
+        cs_x86_op operands[ max_operands ];
+
+        // The registers read from and written to, both explicitly and implicitly.
+        //
+        register_set regs_read;
+        register_set regs_written;
+
+        // Construct as empty.
+        //
+        compact_instruction() = default;
+
+        // Construct from a capstone instruction decoded with detail.
+        //
+        compact_instruction( const cs_insn* ins );
+
+        // Useful utilities.
+        //
+        inline int                 operand_count()         const { return op_count; }
+        inline const cs_x86_op&    operand( int i )        const { return operands[ i ]; }
+        inline x86_op_type         operand_type( int i )   const { return operands[ i ].type; }
+
+        inline bool                is_jmp()                const { return jump; }
+        inline bool                is_uncond_jmp()         const { return id == X86_INS_JMP; };
+        inline bool                is_branch()             const { return jump; }
+        inline bool                is_cond_jump()          const { return jump && id != X86_INS_JMP; }
+    };
+
+    // An instruction stream with inline storage for a stub window, used for import stub analysis.
+    // The stream is filled by disassembler::disassemble_compact, and never allocates.
+    //
+    class compact_stream
+    {
+    public:
+        // The number of instructions a stub may consist of.
+        //
+        static constexpr size_t capacity = 25;
+
+    private:
+        // The backing storage.
+        //
+        compact_instruction instructions[ capacity ];
+
+        // The number of instructions in the stream.
+        //
+        uint32_t count = 0;
+
+    public:
+        // Appends an instruction, returning false if the stream is full.
+        //
+        inline bool push_back( const compact_instruction& ins )
+        {
+            if ( count == capacity )
+                return false;
+            instructions[ count++ ] = ins;
+            return true;
+        }
+
+        // Removes every instruction.
+        //
+        inline void clear() { count = 0; }
+
+        // Accessors.
+        //
+        inline size_t size() const { return count; }
+        inline bool empty() const { return count == 0; }
+        inline const compact_instruction& operator[]( size_t i ) const { return instructions[ i ]; }
+        inline const compact_instruction& back() const { return instructions[ count - 1 ]; }
+        inline const compact_instruction* begin() const { return instructions; }
+        inline const compact_instruction* end() const { return instructions + count; }
+
+        // Disassembler bases instructions via RVA, thus base == rva.
+        //
+        inline uint64_t rva() const { return instructions[ 0 ].address; }
+    };
+}
@@ -2,33 +2,29 @@
 
 namespace vmpdump
 {
-    // Disassembles at the offset from the base, negotating jumps according to the flags.
-    // NOTE: The offset is used for the disassembled instructions' addresses.
-    // If the number of instructions disassembled exceeds the provided max amount, en empty instruction stream is returned.
+    // Disassembles at the offset from the base, negotating jumps according to the flags, passing
+    // each instruction of the resulting stream to append. Only offsets below limit are disassembled.
+    // Returns false if the number of instructions exceeds the provided max amount, or if append fails.
     //
-    instruction_stream disassembler::disassemble( uint64_t base, uint64_t offset, disassembler_flags flags, uint64_t max_instructions )
+    template<typename T>
+    bool disassembler::walk( uint64_t base, uint64_t offset, disassembler_flags flags, uint64_t max_instructions, size_t limit, T&& append )
     {
         // ea = base + offset
         //
         uint64_t ea = base + offset;
 
-        std::vector<std::shared_ptr<instruction>> instructions;
-
-        size_t size = 0xFFFFFFFFFFFFFFFFull;
-
         uint64_t i = 0;
 
-        // Helper lambda to exception-wrap the disassebly.
-        // This is useful as we may be dealing with invalid instructions which may cause an access violation.
+        // Helper lambda to bounds-check the disassembly.
+        // This is useful as we may be dealing with invalid instructions or jumps, which may lead outside of the buffer.
         //
         auto disasm = [&]() -> bool
         {
-            __try
-            {
-                return cs_disasm_iter( handle, ( const uint8_t** )&ea, &size, &offset, insn );
-            }
-            __except ( 1 ) {}
-            return false;
+            if ( offset >= limit )
+                return false;
+
+            size_t size = limit - offset;
+            return cs_disasm_iter( handle, ( const uint8_t** )&ea, &size, &offset, insn );
         };
 
         // While iterative disassembly is successful.
@@ -38,26 +34,26 @@ namespace vmpdump
             // Check max bounds.
             //
             if ( i >= max_instructions )
-                return instruction_stream {};
+                return false;
             i++;
 
-            // Construct a self-containing instruction.
+            // Construct a compact copy of the instruction.
             //
-            auto ins = std::make_shared<instruction>( insn );
+            compact_instruction ins = { insn };
 
             // Is the instruction a branch?
             //
-            if ( ins->is_branch() )
+            if ( ins.is_branch() )
             {
                 // If it's unconditional, and we know the destination, and we are specified
                 // to follow these types of jumps, do so.
                 //
                 if ( flags & disassembler_take_unconditional_imm
-                     && ins->is_uncond_jmp() && ins->operand( 0 ).type == X86_OP_IMM )
+                     && ins.is_uncond_jmp() && ins.operand( 0 ).type == X86_OP_IMM )
                 {
                     // We must set the offset, otherwise the disassembly will be incorrect.
                     //
-                    offset = ins->operand( 0 ).imm;
+                    offset = ins.operand( 0 ).imm;
 
                     // Update actual disassembly pointer.
                     //
@@ -75,72 +71,58 @@ namespace vmpdump
 
             // Is the instruction a call?
             //
-            if ( ins->ins.id == X86_INS_CALL )
+            if ( ins.id == X86_INS_CALL )
             {
                 // If the pass calls flag is not set, add it and end disassembly.
                 //
                 if ( !( flags & disassembler_pass_calls ) )
-                {
-                    instructions.push_back( ins );
-                    break;
-                }
+                    return append( ins );
             }
 
             // Is the instruction a return?
             //
-            if ( ins->ins.id == X86_INS_RET )
+            if ( ins.id == X86_INS_RET )
             {
                 // Add the instruction and end disassembly.
                 //
-                instructions.push_back( ins );
-                break;
+                return append( ins );
             }
 
             // Add instruction to list.
             //
-            instructions.push_back( ins );
+            if ( !append( ins ) )
+                return false;
         }
 
-        // Return an instruction stream of said instructions.
-        //
-        return { instructions };
+        return true;
     }
 
-
-    // Disassembles at the offset from the base, simply disassembling every instruction in order.
+    // Disassembles at the offset from the base into an inline stream, negotating jumps according to the flags.
+    // If the number of instructions disassembled exceeds the provided max amount or the capacity of the stream, the stream is left empty.
+    // Disassembly stops at the first instruction which does not fit below limit.
     //
-    std::vector<std::unique_ptr<instruction>> disassembler::disassembly_simple( uint64_t base, uint64_t offset, uint64_t end_rva )
+    void disassembler::disassemble_compact( compact_stream& stream, uint64_t base, uint64_t offset, disassembler_flags flags, uint64_t max_instructions, size_t limit )
     {
-        // ea = base + offset
-        //
-        uint64_t ea = base + offset;
+        stream.clear();
 
-        std::vector<std::unique_ptr<instruction>> instructions;
-
-        size_t size = end_rva - offset;
-
-        // While iterative disassembly is successful.
-        //
-        while ( true )
+        bool success = walk( base, offset, flags, max_instructions, limit, [ & ] ( const compact_instruction& ins )
         {
-            // Check if we're within bounds.
-            //
-            if ( offset >= size )
-                break;
+            return stream.push_back( ins );
+        } );
 
-            // In case disassembly failed (due to invalid instructions), try to continue by incrementing offset.
-            //
-            if ( !cs_disasm_iter( handle, ( const uint8_t** )&ea, &size, &offset, insn ) )
-            {
-                offset++;
-                ea++;
+        if ( !success )
+            stream.clear();
+    }
 
-                continue;
-            }
+    // Decodes the single instruction at the offset from the base with full detail, reading at most size bytes.
+    //
+    std::optional<compact_instruction> disassembler::decode( uint64_t base, uint64_t offset, size_t size )
+    {
+        const uint8_t* code = ( const uint8_t* )( base + offset );
 
-            instructions.push_back( std::make_unique<instruction>( insn ) );
-        }
+        if ( !cs_disasm_iter( handle, &code, &size, &offset, insn ) )
+            return {};
 
-        return std::move( instructions );
+        return compact_instruction { insn };
     }
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #pragma once
 #include <capstone/capstone.h>
+#include <cstdint>
+#include <optional>
 #include <vtil/utility>
-#include "instruction_stream.hpp"
+#include "compact_instruction.hpp"
 
 namespace vmpdump
 {
@@ -49,6 +51,17 @@ namespace vmpdump
         //
         cs_insn* insn;
 
+        // The internal handle with detail disabled, and its instruction allocation memory.
+        // Decoding without detail only yields the id, address, size and bytes, but is much cheaper.
+        //
+        csh fast_handle;
+        cs_insn* fast_insn;
+
+        // Disassembles at the offset from the base, negotating jumps according to the flags, passing
+        // each instruction of the resulting stream to append.
+        //
+        template<typename T>
+        bool walk( uint64_t base, uint64_t offset, disassembler_flags flags, uint64_t max_instructions, size_t limit, T&& append );
 
     public:
         // Cannot be copied or moved.
@@ -64,11 +77,16 @@ namespace vmpdump
             fassert( cs_open( arch, mode, &handle ) == CS_ERR_OK );
             cs_option( handle, CS_OPT_DETAIL, CS_OPT_ON );
             insn = cs_malloc( handle );
+
+            fassert( cs_open( arch, mode, &fast_handle ) == CS_ERR_OK );
+            cs_option( fast_handle, CS_OPT_DETAIL, CS_OPT_OFF );
+            fast_insn = cs_malloc( fast_handle );
         }
 
         ~disassembler()
         {
             cs_close( &handle );
+            cs_close( &fast_handle );
         }
 
         // Getter to the handle.
@@ -77,6 +95,12 @@ namespace vmpdump
 
         cs_insn* get_insn() { return insn; }
 
+        // Getters to the handle with detail disabled.
+        //
+        csh get_fast_handle() const { return fast_handle; }
+
+        cs_insn* get_fast_insn() { return fast_insn; }
+
         // Singleton to provide a unique disassembler instance for each thread.
         //
         inline static disassembler& get( cs_arch arch = cs_default_arch, cs_mode mode = cs_default_mode)
@@ -86,14 +110,14 @@ namespace vmpdump
             return instance;
         }
 
-        // Disassembles at the offset from the base, negotating jumps according to the flags.
-        // NOTE: The offset is used for the disassembled instructions' addresses.
-        // If the number of instructions disassembled exceeds the provided max amount, en empty instruction stream is returned.
+        // Disassembles at the offset from the base into an inline stream, negotating jumps according to the flags.
+        // If the number of instructions disassembled exceeds the provided max amount or the capacity of the stream, the stream is left empty.
+        // Disassembly stops at the first instruction which does not fit below limit, which should be the size of the buffer at base.
         //
-        instruction_stream disassemble( uint64_t base, uint64_t offset, disassembler_flags flags = disassembler_take_unconditional_imm, uint64_t max_instructions = -1 );
+        void disassemble_compact( compact_stream& stream, uint64_t base, uint64_t offset, disassembler_flags flags = disassembler_take_unconditional_imm, uint64_t max_instructions = compact_stream::capacity, size_t limit = SIZE_MAX );
 
-        // Disassembles at the offset from the base, simply disassembling every instruction in order.
+        // Decodes the single instruction at the offset from the base with full detail, reading at most size bytes.
         //
-        std::vector<std::unique_ptr<instruction>> disassembly_simple( uint64_t base, uint64_t offset, uint64_t end_rva );
+        std::optional<compact_instruction> decode( uint64_t base, uint64_t offset, size_t size );
     };
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "export_database.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace vmpdump
+{
+    using namespace export_database_format;
+
+    // Module names are compared case-insensitively.
+    //
+    static std::string to_lower( const std::string& name )
+    {
+        std::string result = name;
+        for ( char& c : result )
+            c = ( char )std::tolower( ( unsigned char )c );
+        return result;
+    }
+
+    // Returns the export name (if available) and ordinal of the export at the given rva.
+    //
+    std::optional<export_id_t> cached_exports::find( uint32_t rva ) const
+    {
+        const export_record* end = exports + export_count;
+        const export_record* it = std::lower_bound( exports, end, rva, [ ] ( const export_record& record, uint32_t rva ) { return record.rva < rva; } );
+        if ( it == end || it->rva != rva )
+            return {};
+
+        return { { std::string( names + it->name_offset, it->name_length ), it->ordinal } };
+    }
+
+    // Opens the database at the given path. If it does not exist or is invalid, the database starts out empty.
+    //
+    std::shared_ptr<export_database> export_database::open( const std::string& path )
+    {
+        std::shared_ptr<export_database> result = std::make_shared<export_database>();
+        result->path = path;
+        result->file = mapped_file::open( path, map_mode::read_only );
+        if ( result->file && !result->load() )
+        {
+            result->records.clear();
+            result->file = nullptr;
+        }
+        return result;
+    }
+
+    // Validates and indexes the mapped file, returning false if it is invalid or of another version.
+    //
+    bool export_database::load()
+    {
+        const uint8_t* bytes = file->data();
+        size_t size = file->size();
+
+        if ( size < sizeof( header ) )
+            return false;
+
+        const header* file_header = ( const header* )bytes;
+        if ( file_header->magic != magic || file_header->version != version )
+            return false;
+
+        if ( file_header->module_count > ( size - sizeof( header ) ) / sizeof( module_record ) )
+            return false;
+
+        // Validate every record's ranges, so that lookups need no further checks.
+        //
+        const module_record* modules = ( const module_record* )( bytes + sizeof( header ) );
+        for ( uint32_t i = 0; i < file_header->module_count; i++ )
+        {
+            const module_record& module = modules[ i ];
+
+            if ( module.exports_offset % alignof( export_record ) || module.exports_offset > size ||
+                 module.export_count > ( size - module.exports_offset ) / sizeof( export_record ) )
+                return false;
+            if ( module.names_offset > size || module.names_size > size - module.names_offset )
+                return false;
+            if ( !memchr( module.module_name, 0, sizeof( module.module_name ) ) )
+                return false;
+
+            const export_record* exports = ( const export_record* )( bytes + module.exports_offset );
+            for ( uint32_t j = 0; j < module.export_count; j++ )
+            {
+                if ( exports[ j ].name_offset > module.names_size || exports[ j ].name_length > module.names_size - exports[ j ].name_offset )
+                    return false;
+                if ( j && exports[ j - 1 ].rva >= exports[ j ].rva )
+                    return false;
+            }
+
+            records[ to_lower( module.module_name ) ] = &module;
+        }
+        return true;
+    }
+
+    // Returns the cached exports of the module with the given key, if it was cached with the same identity.
+    //
+    std::optional<cached_exports> export_database::find( const export_database_key& key )
+    {
+        auto it = records.find( to_lower( key.module_name ) );
+        if ( it == records.end() )
+        {
+            misses++;
+            return {};
+        }
+
+        // A record of another build of the module is stale.
+        //
+        const module_record& module = *it->second;
+        if ( module.timedate_stamp != key.timedate_stamp || module.size_image != key.size_image || module.checksum != key.checksum )
+        {
+            stale++;
+            return {};
+        }
+
+        hits++;
+        return cached_exports( file, ( const export_record* )( file->data() + module.exports_offset ), module.export_count, ( const char* )( file->data() + module.names_offset ) );
+    }
+
+    // Adds the exports of the module with the given key, as { rva, export id }.
+    //
+    void export_database::store( const export_database_key& key, std::vector<std::pair<uint32_t, export_id_t>> exports )
+    {
+        // Names which do not fit a record cannot be cached.
+        //
+        if ( key.module_name.size() >= sizeof( module_record::module_name ) )
+            return;
+
+        std::sort( exports.begin(), exports.end(), [ ] ( auto& a, auto& b ) { return a.first < b.first; } );
+
+        std::lock_guard _g( pending_lock );
+        pending[ to_lower( key.module_name ) ] = { key, std::move( exports ) };
+    }
+
+    // Writes the database back to its path, if any modules were added.
+    //
+    bool export_database::save()
+    {
+        std::lock_guard _g( pending_lock );
+        if ( pending.empty() )
+            return true;
+
+        // Gather the records to write: the mapped records which were not replaced, and the pending ones.
+        //
+        struct output_module
+        {
+            module_record record;
+            std::vector<export_record> exports;
+            std::string names;
+        };
+        std::vector<output_module> modules;
+
+        for ( auto& [name, record] : records )
+        {
+            if ( pending.contains( name ) )
+                continue;
+
+            output_module module = { *record, {}, {} };
+            const export_record* exports = ( const export_record* )( file->data() + record->exports_offset );
+            module.exports.assign( exports, exports + record->export_count );
+            module.names.assign( ( const char* )( file->data() + record->names_offset ), record->names_size );
+            modules.push_back( std::move( module ) );
+        }
+
+        for ( auto& [name, entry] : pending )
+        {
+            output_module module = {};
+            memcpy( module.record.module_name, entry.key.module_name.c_str(), entry.key.module_name.size() + 1 );
+            module.record.timedate_stamp = entry.key.timedate_stamp;
+            module.record.size_image = entry.key.size_image;
+            module.record.checksum = entry.key.checksum;
+
+            for ( auto& [rva, id] : entry.exports )
+            {
+                module.exports.push_back( { rva, id.second, ( uint32_t )module.names.size(), ( uint32_t )id.first.size() } );
+                module.names += id.first;
+            }
+            modules.push_back( std::move( module ) );
+        }
+
+        // Lay the file out.
+        //
+        uint64_t offset = sizeof( header ) + modules.size() * sizeof( module_record );
+        for ( output_module& module : modules )
+        {
+            module.record.export_count = ( uint32_t )module.exports.size();
+            module.record.exports_offset = offset;
+            offset += module.exports.size() * sizeof( export_record );
+            module.record.names_offset = offset;
+            module.record.names_size = module.names.size();
+            offset += module.names.size();
+            offset = ( offset + alignof( export_record ) - 1 ) & ~( uint64_t )( alignof( export_record ) - 1 );
+        }
+
+        // Write to a temporary file of our own first, as the current one may still be mapped, here or by other processes,
+        // and concurrent writers must not write into each other's file.
+        //
+        std::string temporary_path = mapped_file::temporary_path( path );
+        std::error_code error;
+        {
+            std::ofstream output( temporary_path, std::ios::binary | std::ios::trunc );
+            if ( !output )
+                return false;
+
+            header file_header = { magic, version, ( uint32_t )modules.size(), 0 };
+            output.write( ( const char* )&file_header, sizeof( file_header ) );
+            for ( output_module& module : modules )
+                output.write( ( const char* )&module.record, sizeof( module.record ) );
+
+            for ( output_module& module : modules )
+            {
+                output.seekp( module.record.exports_offset );
+                output.write( ( const char* )module.exports.data(), module.exports.size() * sizeof( export_record ) );
+                output.write( module.names.data(), module.names.size() );
+            }
+
+            // Pad the file to its full size, in case the last names were empty.
+            //
+            output.seekp( 0, std::ios::end );
+            if ( ( uint64_t )output.tellp() < offset )
+                output.write( "\0\0\0\0", offset - output.tellp() );
+
+            if ( !output )
+            {
+                output.close();
+                std::filesystem::remove( temporary_path, error );
+                return false;
+            }
+        }
+
+        // Replace the database. Lookups already made keep the old mapping alive, so unmap only our reference.
+        //
+        records.clear();
+        file = nullptr;
+
+        // Should the rename fail, drop our file and keep using whatever database is in place.
+        //
+        std::filesystem::rename( temporary_path, path, error );
+        bool renamed = !error;
+        if ( !renamed )
+            std::filesystem::remove( temporary_path, error );
+
+        file = mapped_file::open( path, map_mode::read_only );
+        if ( !file || !load() )
+        {
+            records.clear();
+            file = nullptr;
+            return false;
+        }
+        if ( !renamed )
+            return false;
+
+        pending.clear();
+        return true;
+    }
+}
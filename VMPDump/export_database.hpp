@@ -0,0 +1,153 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "module_view.hpp"
+
+namespace vmpdump
+{
+    // Identifies a build of a module: its name and the identity fields of its PE header.
+    //
+    struct export_database_key
+    {
+        std::string module_name;
+        uint32_t timedate_stamp;
+        uint32_t size_image;
+        uint32_t checksum;
+    };
+
+    // The on-disk layout of the export database. All offsets are from the start of the file.
+    //
+    //      header
+    //      module_record[ header.module_count ]
+    //      export_record[ ... ], per module
+    //      names, per module
+    //
+    namespace export_database_format
+    {
+        // 'EXDB'.
+        //
+        static constexpr uint32_t magic = 0x42445845;
+        static constexpr uint32_t version = 1;
+
+        struct header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t module_count;
+            uint32_t reserved;
+        };
+
+        struct module_record
+        {
+            char module_name[ 64 ];
+            uint32_t timedate_stamp;
+            uint32_t size_image;
+            uint32_t checksum;
+            uint32_t export_count;
+            uint64_t exports_offset;
+            uint64_t names_offset;
+            uint64_t names_size;
+        };
+
+        // The exports of a module, sorted by rva. Unnamed exports have a zero name_length.
+        //
+        struct export_record
+        {
+            uint32_t rva;
+            uint32_t ordinal;
+            uint32_t name_offset;
+            uint32_t name_length;
+        };
+    }
+
+    // The cached exports of a single module, read straight out of the mapped database.
+    //
+    class cached_exports
+    {
+    private:
+        // Keeps the mapping alive.
+        //
+        std::shared_ptr<mapped_file> file;
+
+        const export_database_format::export_record* exports;
+        uint32_t export_count;
+        const char* names;
+
+    public:
+        cached_exports( std::shared_ptr<mapped_file> file, const export_database_format::export_record* exports, uint32_t export_count, const char* names )
+            : file( std::move( file ) ), exports( exports ), export_count( export_count ), names( names )
+        {}
+
+        // Returns the export name (if available) and ordinal of the export at the given rva.
+        //
+        std::optional<export_id_t> find( uint32_t rva ) const;
+
+        inline uint32_t size() const { return export_count; }
+    };
+
+    // A persistent database of module exports, keyed by module build, so that the exports of system modules only
+    // have to be read and parsed once per OS build. The file is mapped read-only and looked up in place; new modules
+    // are kept in memory and written out by save. A record whose name matches but whose identity does not is stale,
+    // and is dropped on save, as is the whole file if its version does not match.
+    //
+    class export_database
+    {
+    private:
+        // The path of the database, and its mapping if it existed and was valid.
+        //
+        std::string path;
+        std::shared_ptr<mapped_file> file;
+
+        // The modules in the mapped file, by lowercase name.
+        //
+        std::map<std::string, const export_database_format::module_record*> records;
+
+        // The modules added since the database was opened, by lowercase name.
+        //
+        struct pending_module
+        {
+            export_database_key key;
+            std::vector<std::pair<uint32_t, export_id_t>> exports;
+        };
+        std::mutex pending_lock;
+        std::map<std::string, pending_module> pending;
+
+        // Statistics.
+        //
+        std::atomic<uint64_t> hits = { 0 };
+        std::atomic<uint64_t> misses = { 0 };
+        std::atomic<uint64_t> stale = { 0 };
+
+        // Validates and indexes the mapped file, returning false if it is invalid or of another version.
+        //
+        bool load();
+
+    public:
+        // Opens the database at the given path. If it does not exist or is invalid, the database starts out empty.
+        //
+        static std::shared_ptr<export_database> open( const std::string& path );
+
+        // Returns the cached exports of the module with the given key, if it was cached with the same identity.
+        //
+        std::optional<cached_exports> find( const export_database_key& key );
+
+        // Adds the exports of the module with the given key, as { rva, export id }.
+        //
+        void store( const export_database_key& key, std::vector<std::pair<uint32_t, export_id_t>> exports );
+
+        // Writes the database back to its path, if any modules were added.
+        //
+        bool save();
+
+        inline uint64_t hit_count() const { return hits.load(); }
+        inline uint64_t miss_count() const { return misses.load(); }
+        inline uint64_t stale_count() const { return stale.load(); }
+    };
+}
@@ -0,0 +1,43 @@
+#include "export_index.hpp"
+#include <algorithm>
+
+namespace vmpdump
+{
+    // Builds the index from the export address table and the name ordinal table.
+    //
+    export_index::export_index( const uint32_t* functions, uint32_t num_functions, const uint16_t* name_ordinals, uint32_t num_names, uint32_t ordinal_base )
+        : function_names( num_functions, -1 ), ordinal_base( ordinal_base )
+    {
+        // Sort the functions by rva, keeping the last function among those sharing an rva.
+        //
+        by_rva.reserve( num_functions );
+        for ( uint32_t i = 0; i < num_functions; i++ )
+            by_rva.push_back( { functions[ i ], i } );
+
+        std::sort( by_rva.begin(), by_rva.end(), [ ] ( const rva_entry& a, const rva_entry& b )
+        {
+            return a.rva != b.rva ? a.rva < b.rva : a.function_index > b.function_index;
+        } );
+        by_rva.erase( std::unique( by_rva.begin(), by_rva.end(), [ ] ( const rva_entry& a, const rva_entry& b ) { return a.rva == b.rva; } ), by_rva.end() );
+
+        // Invert the name ordinal table, keeping the last name of each function.
+        //
+        for ( uint32_t i = 0; i < num_names; i++ )
+            if ( name_ordinals[ i ] < num_functions )
+                function_names[ name_ordinals[ i ] ] = i;
+    }
+
+    // Returns the export at the given rva, if any.
+    //
+    std::optional<export_entry> export_index::find( uint32_t rva ) const
+    {
+        auto it = std::lower_bound( by_rva.begin(), by_rva.end(), rva, [ ] ( const rva_entry& entry, uint32_t rva ) { return entry.rva < rva; } );
+        if ( it == by_rva.end() || it->rva != rva )
+            return {};
+
+        uint32_t name_index = function_names[ it->function_index ];
+        if ( name_index == -1 )
+            return { { ordinal_base + it->function_index, {} } };
+        return { { ordinal_base + it->function_index, name_index } };
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace vmpdump
+{
+    // A resolved export: its ordinal, and the index of its name in the name table, if it has one.
+    //
+    struct export_entry
+    {
+        uint32_t ordinal;
+        std::optional<uint32_t> name_index;
+    };
+
+    // An index over a module's export tables, mapping rvas to exports in O(log n).
+    // Results are identical to scanning the export address table and the name ordinal table: if several functions
+    // share an rva, or several names a function, the last one in the table wins.
+    //
+    class export_index
+    {
+    private:
+        // A single rva, and the index of the function exported at it.
+        //
+        struct rva_entry
+        {
+            uint32_t rva;
+            uint32_t function_index;
+        };
+
+        // The exported rvas, sorted and unique.
+        //
+        std::vector<rva_entry> by_rva;
+
+        // The name index of each function, or -1 if it is unnamed.
+        //
+        std::vector<uint32_t> function_names;
+
+        // The ordinal of the first function.
+        //
+        uint32_t ordinal_base = 0;
+
+    public:
+        // Constructs an empty index.
+        //
+        export_index() = default;
+
+        // Builds the index from the export address table and the name ordinal table.
+        //
+        export_index( const uint32_t* functions, uint32_t num_functions, const uint16_t* name_ordinals, uint32_t num_names, uint32_t ordinal_base );
+
+        // Returns the export at the given rva, if any.
+        //
+        std::optional<export_entry> find( uint32_t rva ) const;
+
+        // Returns the i'th exported rva, in ascending order.
+        //
+        inline uint32_t rva_at( size_t i ) const { return by_rva[ i ].rva; }
+
+        inline size_t size() const { return by_rva.size(); }
+    };
+}
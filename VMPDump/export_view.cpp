@@ -0,0 +1,182 @@
+#include "export_view.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace vmpdump
+{
+    // Fetches the headers, the export directory range and any tables outside of it from the source, and indexes the exports.
+    // If a database is given, the exports are taken from it if the module is cached, and stored in it otherwise, unless
+    // some of the tables or names could not be read. Returns false if the headers cannot be read. A module without exports is not an error.
+    //
+    bool export_view::fetch( memory_source& source, export_database* database )
+    {
+        using namespace win;
+
+        export_rva = 0;
+        export_bytes.clear();
+        table_ranges.clear();
+        index = {};
+        cached = {};
+
+        // Read the DOS header, and the NT headers it points to.
+        //
+        dos_header_t dos_header;
+        if ( !source.read( module_base, &dos_header, sizeof( dos_header ) ) || dos_header.e_lfanew + sizeof( nt_headers_t<true> ) > module_size )
+            return false;
+
+        nt_headers_t<true> nt_headers;
+        if ( !source.read( module_base + dos_header.e_lfanew, &nt_headers, sizeof( nt_headers ) ) )
+            return false;
+
+        // If this build of the module is cached, we are done.
+        //
+        export_database_key key = { module_name, nt_headers.file_header.timedate_stamp, nt_headers.optional_header.size_image, nt_headers.optional_header.checksum };
+        if ( database && ( cached = database->find( key ) ) )
+            return true;
+
+        // Read the export directory range, if there is one.
+        //
+        if ( nt_headers.optional_header.num_data_directories <= ( uint32_t )directory_id::directory_entry_export )
+            return true;
+
+        data_directory_t& export_directory = nt_headers.optional_header.data_directories.export_directory;
+        if ( !export_directory.present() || export_directory.rva >= module_size || export_directory.size > module_size - export_directory.rva )
+            return true;
+
+        export_bytes.resize( export_directory.size );
+        if ( !source.read( module_base + export_directory.rva, export_bytes.data(), export_bytes.size() ) )
+        {
+            export_bytes.clear();
+            return true;
+        }
+
+        export_rva = export_directory.rva;
+
+        const export_directory_t* export_dir = at<export_directory_t>( export_rva );
+        if ( !export_dir )
+            return true;
+        export_directory_t directory = *export_dir;
+
+        // Linkers place the tables and the names within the range, but nothing requires them to, so fetch any which lie
+        // outside of it at their own rvas.
+        //
+        auto fetch_range = [ & ] ( uint64_t rva, uint64_t size )
+        {
+            if ( !size || at<uint8_t>( rva, size ) || rva >= module_size || size > module_size - rva )
+                return;
+
+            std::vector<uint8_t> bytes( size );
+            if ( source.read( module_base + rva, bytes.data(), bytes.size() ) )
+                table_ranges.push_back( { ( uint32_t )rva, std::move( bytes ) } );
+        };
+        fetch_range( directory.rva_functions, ( uint64_t )directory.num_functions * sizeof( uint32_t ) );
+        fetch_range( directory.rva_names, ( uint64_t )directory.num_names * sizeof( uint32_t ) );
+        fetch_range( directory.rva_name_ordinals, ( uint64_t )directory.num_names * sizeof( uint16_t ) );
+
+        // The names outside of the fetched ranges are fetched in one read spanning all of them, as their lengths are unknown.
+        //
+        if ( const uint32_t* names = at<uint32_t>( directory.rva_names, directory.num_names ) )
+        {
+            uint64_t lowest = module_size;
+            uint64_t highest = 0;
+            for ( uint32_t i = 0; i < directory.num_names; i++ )
+            {
+                if ( at<char>( names[ i ] ) || names[ i ] >= module_size )
+                    continue;
+                lowest = std::min<uint64_t>( lowest, names[ i ] );
+                highest = std::max<uint64_t>( highest, names[ i ] );
+            }
+            if ( lowest <= highest )
+                fetch_range( lowest, std::min<uint64_t>( highest + max_name_length, module_size ) - lowest );
+        }
+
+        // Index the export tables, if they could be read.
+        //
+        const uint32_t* eat = at<uint32_t>( directory.rva_functions, directory.num_functions );
+        const uint16_t* name_ordinals = at<uint16_t>( directory.rva_name_ordinals, directory.num_names );
+        bool indexed = eat && ( name_ordinals || !directory.num_names );
+        if ( indexed )
+            index = export_index( eat, directory.num_functions, name_ordinals, directory.num_names, directory.base );
+
+        // Only cache the exports if every table and every name could be read, as a partial list would otherwise be served
+        // for this build of the module from then on.
+        //
+        if ( database && indexed && has_all_names( directory ) )
+            database->store( key, get_exports() );
+        return true;
+    }
+
+    // Returns whether the name table and every name it points to were fetched, each name terminated within its range.
+    //
+    bool export_view::has_all_names( const win::export_directory_t& directory ) const
+    {
+        const uint32_t* names = at<uint32_t>( directory.rva_names, directory.num_names );
+        if ( !names && directory.num_names )
+            return false;
+
+        for ( uint32_t i = 0; i < directory.num_names; i++ )
+        {
+            auto [name, max_length] = find_bytes( names[ i ] );
+            if ( !name || !memchr( name, 0, std::min( max_length, max_name_length ) ) )
+                return false;
+        }
+        return true;
+    }
+
+    // Returns every export, as { rva, export id }.
+    //
+    std::vector<std::pair<uint32_t, export_id_t>> export_view::get_exports() const
+    {
+        std::vector<std::pair<uint32_t, export_id_t>> result;
+        for ( size_t i = 0; i < index.size(); i++ )
+        {
+            uint32_t rva = index.rva_at( i );
+            if ( std::optional<export_id_t> id = get_export( module_base + rva ) )
+                result.push_back( { rva, *id } );
+        }
+        return result;
+    }
+
+    // Returns the export name (if available) and ordinal.
+    //
+    std::optional<export_id_t> export_view::get_export( remote_ea_t ea ) const
+    {
+        using namespace win;
+
+        uint64_t rva = ea - module_base;
+
+        // Check if ea is in module bounds.
+        //
+        if ( !within_bounds( ea ) )
+            return {};
+
+        // Look the rva up in the database, if the module was cached.
+        //
+        if ( cached )
+            return cached->find( ( uint32_t )rva );
+
+        // Otherwise, look the rva up in the index.
+        //
+        std::optional<export_entry> entry = index.find( ( uint32_t )rva );
+        if ( !entry )
+            return {};
+
+        // If the function is unnamed, return its ordinal.
+        //
+        if ( !entry->name_index )
+            return { { { "" }, entry->ordinal } };
+
+        // Return function name, bounded by the end of the range it was fetched in.
+        //
+        const export_directory_t* export_dir = at<export_directory_t>( export_rva );
+        const uint32_t* names = at<uint32_t>( export_dir->rva_names, export_dir->num_names );
+        if ( !names )
+            return {};
+
+        auto [name, max_length] = find_bytes( names[ *entry->name_index ] );
+        if ( !name )
+            return {};
+
+        return { { std::string( ( const char* )name, strnlen( ( const char* )name, max_length ) ), entry->ordinal } };
+    }
+}
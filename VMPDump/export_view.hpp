@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <optional>
+#include "module_view.hpp"
+#include "export_index.hpp"
+#include "export_database.hpp"
+
+namespace vmpdump
+{
+    // This class provides a lightweight, read-only view of a remote module's exports.
+    // Only the headers, the export directory range and any export tables outside of it are read, so the memory and read
+    // volume of resolving exports are proportional to the export tables, rather than to the size of the module.
+    //
+    struct export_view
+    {
+        // The longest name read for names outside of the export directory range, whose lengths are unknown until read.
+        //
+        static constexpr size_t max_name_length = 0x200;
+
+        // The name of the module, or empty if not available.
+        //
+        const std::string module_name;
+
+        // The base of the remote module in the target process.
+        //
+        const remote_ea_t module_base;
+
+        // The virtual size of the module.
+        //
+        const size_t module_size;
+
+        // The export directory range, and its locally copied bytes.
+        // The name, export address table and name tables usually lie within it, as linkers place them.
+        //
+        uint32_t export_rva = 0;
+        std::vector<uint8_t> export_bytes;
+
+        // The ranges of the tables and names which lie outside of the export directory range, fetched at their own rvas,
+        // as { rva, bytes }.
+        //
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> table_ranges;
+
+        // The index over the export tables, built once they are fetched.
+        //
+        export_index index;
+
+        // If the module was found in the export database, its cached exports, in which case nothing but
+        // the headers was read.
+        //
+        std::optional<cached_exports> cached;
+
+        // Determined whether the provided remote ea is within module bounds.
+        //
+        inline bool within_bounds( remote_ea_t ea ) const
+        {
+            return ea >= module_base && ea < module_base + module_size;
+        }
+
+        // Returns a pointer to the bytes at the given rva within the fetched ranges, along with the number of bytes fetched
+        // from there on, or nullptr if it lies outside of them.
+        //
+        inline std::pair<const uint8_t*, size_t> find_bytes( uint64_t rva ) const
+        {
+            if ( rva >= export_rva && rva - export_rva < export_bytes.size() )
+                return { export_bytes.data() + ( rva - export_rva ), export_bytes.size() - ( rva - export_rva ) };
+
+            for ( auto& [range_rva, bytes] : table_ranges )
+            {
+                if ( rva >= range_rva && rva - range_rva < bytes.size() )
+                    return { bytes.data() + ( rva - range_rva ), bytes.size() - ( rva - range_rva ) };
+            }
+            return { nullptr, 0 };
+        }
+
+        // Returns a pointer to count T's at the given rva within the fetched ranges, or nullptr if they lie outside of them.
+        //
+        template<typename T>
+        inline const T* at( uint64_t rva, size_t count = 1 ) const
+        {
+            auto [bytes, available] = find_bytes( rva );
+            if ( !bytes || count > available / sizeof( T ) )
+                return nullptr;
+            return ( const T* )bytes;
+        }
+
+        // Fetches the headers, the export directory range and any tables outside of it from the source, and indexes the exports.
+        // If a database is given, the exports are taken from it if the module is cached, and stored in it otherwise, unless
+        // some of the tables or names could not be read. Returns false if the headers cannot be read. A module without exports is not an error.
+        //
+        bool fetch( memory_source& source, export_database* database = nullptr );
+
+        // Returns whether the name table and every name it points to were fetched, each name terminated within its range.
+        //
+        bool has_all_names( const win::export_directory_t& directory ) const;
+
+        // Returns every export, as { rva, export id }.
+        //
+        std::vector<std::pair<uint32_t, export_id_t>> get_exports() const;
+
+        // Returns the export name (if available) and ordinal.
+        //
+        std::optional<export_id_t> get_export( remote_ea_t ea ) const;
+
+        // Constructor, automatically fetching the remote module's exports.
+        //
+        export_view( memory_source& source, const std::string& module_name, remote_ea_t module_base, size_t module_size, export_database* database = nullptr )
+            : module_name( module_name ), module_base( module_base ), module_size( module_size )
+        {
+            fetch( source, database );
+        }
+    };
+}
@@ -0,0 +1,122 @@
+#include "file_source.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace vmpdump
+{
+    // Opens the capture described by the manifest at the given path, returning nullptr on failure.
+    //
+    std::shared_ptr<file_memory_source> file_memory_source::open( const std::string& manifest_path )
+    {
+        std::ifstream manifest( manifest_path );
+        if ( !manifest )
+            return nullptr;
+
+        std::filesystem::path directory = std::filesystem::path( manifest_path ).parent_path();
+
+        std::shared_ptr<file_memory_source> result = std::make_shared<file_memory_source>();
+
+        std::string line;
+        while ( std::getline( manifest, line ) )
+        {
+            if ( line.empty() || line[ 0 ] == '#' )
+                continue;
+
+            // Parse the module entry.
+            //
+            std::stringstream stream( line );
+            remote_ea_t base = 0;
+            size_t size = 0;
+            std::string name, file;
+            if ( !( stream >> std::hex >> base >> size >> name ) )
+                return nullptr;
+            stream >> file;
+
+            // Map the module image read-only, if it was captured.
+            //
+            std::string image_path = "";
+            std::shared_ptr<mapped_file> image = {};
+            if ( !file.empty() )
+            {
+                image_path = ( directory / file ).string();
+                image = mapped_file::open( image_path, map_mode::read_only );
+                if ( !image )
+                    return nullptr;
+            }
+
+            // The first module is the process image.
+            //
+            if ( result->modules.empty() )
+                result->image_path = ( directory / name ).string();
+
+            result->modules.insert( { base, { name, size, image_path, image } } );
+        }
+
+        if ( result->modules.empty() )
+            return nullptr;
+
+        return result;
+    }
+
+    // Finds the module whose image fully backs [ea, ea + size), or nullptr if the range is not fully captured.
+    //
+    const file_memory_source::captured_module* file_memory_source::find( remote_ea_t ea, size_t size, uint64_t* offset ) const
+    {
+        // Find the module with the highest base at or below ea.
+        //
+        auto it = modules.upper_bound( ea );
+        if ( it == modules.begin() )
+            return nullptr;
+        it--;
+
+        const captured_module& module = it->second;
+        *offset = ea - it->first;
+        if ( !module.image || *offset + size > module.size || *offset + size > module.image->size() )
+            return nullptr;
+
+        return &module;
+    }
+
+    // Reads size bytes at the given effective address, returning false if any of them are unreadable.
+    //
+    bool file_memory_source::read( remote_ea_t ea, void* buffer, size_t size )
+    {
+        uint64_t offset;
+        const captured_module* module = find( ea, size, &offset );
+        if ( !module )
+            return false;
+
+        memcpy( buffer, module->image->data() + offset, size );
+        return true;
+    }
+
+    // Returns a fresh copy-on-write mapping of the module image.
+    //
+    std::shared_ptr<uint8_t> file_memory_source::map( remote_ea_t ea, size_t size )
+    {
+        uint64_t offset;
+        const captured_module* module = find( ea, size, &offset );
+        if ( !module )
+            return nullptr;
+
+        std::shared_ptr<mapped_file> view = mapped_file::open( module->image_path, map_mode::copy_on_write );
+        if ( !view || offset + size > view->size() )
+            return nullptr;
+
+        // Alias the mapping, keeping it alive for as long as the view is.
+        //
+        return std::shared_ptr<uint8_t>( view, view->data() + offset );
+    }
+
+    // Enumerates the modules loaded in the address space.
+    //
+    module_list_t file_memory_source::get_modules()
+    {
+        module_list_t result;
+        for ( auto& [base, module] : modules )
+            result.insert( { base, { module.name, module.size } } );
+        return result;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include "memory_source.hpp"
+#include "mapped_file.hpp"
+
+namespace vmpdump
+{
+    // A capture of a process, described by a manifest listing its modules, one per line:
+    //
+    //      <base> <size> <name> [<image file>]
+    //
+    // The base and size are hexadecimal. The optional image file, relative to the manifest, holds the module as it
+    // was laid out in memory, and is mapped so modules are opened without copying. Modules without an image file are
+    // listed, but cannot be read. Every view handed out by map is a separate private mapping, so patching one
+    // never affects reads or other views. The first module is the process image. Lines starting with # are ignored.
+    //
+    class file_memory_source : public memory_source
+    {
+    private:
+        // A captured module.
+        //
+        struct captured_module
+        {
+            std::string name;
+            size_t size;
+            std::string image_path;
+            std::shared_ptr<mapped_file> image;
+        };
+
+        // The captured modules, by base.
+        //
+        std::map<remote_ea_t, captured_module> modules;
+
+        // The path of the process image, next to the manifest.
+        //
+        std::string image_path;
+
+        // Finds the module whose image fully backs [ea, ea + size), or nullptr if the range is not fully captured.
+        //
+        const captured_module* find( remote_ea_t ea, size_t size, uint64_t* offset ) const;
+
+    public:
+        // Opens the capture described by the manifest at the given path, returning nullptr on failure.
+        //
+        static std::shared_ptr<file_memory_source> open( const std::string& manifest_path );
+
+        bool read( remote_ea_t ea, void* buffer, size_t size ) override;
+        std::shared_ptr<uint8_t> map( remote_ea_t ea, size_t size ) override;
+        module_list_t get_modules() override;
+        std::string get_image_path() override { return image_path; }
+    };
+}
@@ -1,7 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <optional>
-#include "instruction.hpp"
+#include "compact_instruction.hpp"
 #include "module_view.hpp"
 
 namespace vmpdump
@@ -26,6 +26,19 @@ namespace vmpdump
         {}
     };
 
+    // Struct that holds the bytes replacing an import call, and where they go.
+    //
+    struct call_patch
+    {
+        // The relative virtual address of the first replaced byte.
+        //
+        uint64_t rva;
+
+        // The replacement bytes, including any NOP fill.
+        //
+        std::vector<uint8_t> bytes;
+    };
+
     // Struct that holds import calls and their referenced import.
     //
     struct import_call
@@ -34,6 +47,10 @@ namespace vmpdump
         //
         uint64_t call_rva;
 
+        // The length of the call instruction, as decoded by the scan.
+        //
+        uint8_t call_size;
+
         // The import that the call referenced.
         //
         const resolved_import* import;
@@ -52,12 +69,12 @@ namespace vmpdump
 
         // The instruction that came exactly before the call instruction.
         //
-        std::optional<instruction> prev_instruction;
+        std::optional<compact_instruction> prev_instruction;
 
         // Constructor.
         //
-        import_call( uint64_t call_rva, const resolved_import* import, int32_t stack_adjustment, bool padded, bool is_jmp, std::optional<instruction> prev_instruction = {} )
-            : call_rva( call_rva ), import( import ), stack_adjustment( stack_adjustment ), padded( padded ), is_jmp( is_jmp ), prev_instruction( prev_instruction )
+        import_call( uint64_t call_rva, uint8_t call_size, const resolved_import* import, int32_t stack_adjustment, bool padded, bool is_jmp, std::optional<compact_instruction> prev_instruction = {} )
+            : call_rva( call_rva ), call_size( call_size ), import( import ), stack_adjustment( stack_adjustment ), padded( padded ), is_jmp( is_jmp ), prev_instruction( prev_instruction )
         {}
     };
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "lift_context.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace vmpdump
+{
+    lifted_routine::lifted_routine( vtil::basic_block* block )
+        : routine( block->owner ), block( block )
+    {
+        uint64_t live = ++lift_context::live_routines;
+
+        // Update the peak.
+        //
+        uint64_t peak = lift_context::peak_live_routines;
+        while ( live > peak && !lift_context::peak_live_routines.compare_exchange_weak( peak, live ) );
+    }
+
+    lifted_routine::~lifted_routine()
+    {
+        lift_context::live_routines--;
+    }
+
+    // Lifts the instruction stream to VTIL, returning the routine which owns the lifted block.
+    //
+    std::unique_ptr<lifted_routine> lift_context::lift( const compact_stream& stream )
+    {
+        using namespace vtil;
+
+        lifts++;
+
+        // Create a new basic block, owned by the returned routine.
+        //
+        auto lifted = std::make_unique<lifted_routine>( basic_block::begin( 0 ) );
+        basic_block* block = lifted->block;
+
+        // We are lifting a raw instruction stream; we don't need to preserve anything.
+        //
+        block->owner->routine_convention = {};
+        block->owner->routine_convention.purge_stack = true;
+
+        // Enumerate through each instruction.
+        //
+        for ( const compact_instruction& ins : stream )
+        {
+            // Lift the single instruction.
+            //
+            lifter.process( block, ins.address, ins.bytes );
+
+            // If block branches, end lifting.
+            //
+            if ( block->is_complete() )
+                break;
+        }
+
+        return lifted;
+    }
+
+    // Returns the peak resident set size of the process, in bytes.
+    //
+    uint64_t lift_context::peak_rss()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+            return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        // ru_maxrss is reported in kilobytes.
+        //
+        rusage usage = {};
+        if ( getrusage( RUSAGE_SELF, &usage ) )
+            return 0;
+        return ( uint64_t )usage.ru_maxrss * 1024;
+#endif
+    }
+}
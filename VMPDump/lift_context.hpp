@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <lifters/core>
+#include <lifters/amd64>
+#include "compact_instruction.hpp"
+
+namespace vmpdump
+{
+    // A routine lifted by a lift_context.
+    // The routine, and therefore every block and instruction lifted into it, is freed when this is destroyed.
+    //
+    class lifted_routine
+    {
+    private:
+        // The owned routine.
+        //
+        std::unique_ptr<vtil::routine> routine;
+
+    public:
+        // The entry block of the routine.
+        //
+        vtil::basic_block* block;
+
+        lifted_routine( vtil::basic_block* block );
+        ~lifted_routine();
+
+        // Cannot be copied or moved, as the count of live routines is tied to the instance.
+        //
+        lifted_routine( const lifted_routine& ) = delete;
+        lifted_routine( lifted_routine&& ) = delete;
+        lifted_routine& operator=( const lifted_routine& ) = delete;
+        lifted_routine& operator=( lifted_routine&& ) = delete;
+
+        inline vtil::basic_block* operator->() const { return block; }
+    };
+
+    // This class owns the state used to lift instruction streams to VTIL on a single thread.
+    // The lifter is constructed once and reused, and each lifted routine is freed as soon as its analysis is done,
+    // so that a thread never holds more than the routine it is currently analyzing.
+    //
+    class lift_context
+    {
+    private:
+        // The reused lifter.
+        //
+        vtil::lifter::amd64::lifter_t lifter;
+
+        // Counters, shared by every context.
+        //
+        inline static std::atomic<uint64_t> lifts = 0;
+        inline static std::atomic<uint64_t> live_routines = 0;
+        inline static std::atomic<uint64_t> peak_live_routines = 0;
+
+        friend class lifted_routine;
+
+    public:
+        // Cannot be copied or moved.
+        // Only one lift context can exist per thread.
+        //
+        lift_context() = default;
+        lift_context( const lift_context& ) = delete;
+        lift_context( lift_context&& ) = delete;
+        lift_context& operator=( const lift_context& ) = delete;
+        lift_context& operator=( lift_context&& ) = delete;
+
+        // Singleton to provide a unique lift context for each thread.
+        //
+        inline static lift_context& get()
+        {
+            thread_local static lift_context instance;
+
+            return instance;
+        }
+
+        // Lifts the instruction stream to VTIL, returning the routine which owns the lifted block.
+        //
+        std::unique_ptr<lifted_routine> lift( const compact_stream& stream );
+
+        // Statistics.
+        //
+        inline static uint64_t lift_count() { return lifts; }
+        inline static uint64_t live_routine_count() { return live_routines; }
+        inline static uint64_t peak_live_routine_count() { return peak_live_routines; }
+
+        // Returns the peak resident set size of the process, in bytes.
+        //
+        static uint64_t peak_rss();
+    };
+}
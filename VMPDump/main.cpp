@@ -4,9 +4,15 @@
 #include <map>
 #include <vtil/common>
 #include "pe_constructor.hpp"
+#include "mapped_file.hpp"
+#include "section_references.hpp"
+#include "patch_file.hpp"
+#include "bench.hpp"
+#include "lift_context.hpp"
 #include <fstream>
 #include "winpe/image.hpp"
 #include <sstream>
+#include <algorithm>
 #include <filesystem>
 
 #ifdef _MSC_VER
@@ -25,6 +31,18 @@ namespace vmpdump
         std::string module_name;
         std::optional<uint32_t> ep_rva;
         bool disable_relocation;
+        uint32_t scan_flags = scan_none;
+        size_t worker_count = 0;
+        bool benchmark = false;
+        std::string capture_path = "";
+        std::string export_database_path = "";
+        bool live = false;
+        bool compact = false;
+        bool strip_vmp = false;
+        std::string patch_path = "";
+        std::string apply_patch_path = "";
+        std::string stub_database_path = "";
+        size_t stub_database_capacity = stub_database::default_capacity;
     };
 
     // Attempts to parse the given argument list into vmpdump settings.
@@ -36,19 +54,29 @@ namespace vmpdump
         if ( arguments.size() < 3 )
             return {};
 
-        // Fetch target PID.
+        // If the target is an existing file, it is a minidump or capture manifest.
         //
+        std::string capture_path = "";
         uint32_t pid = 0;
-        ( std::stringstream( arguments[ 1 ] ) ) >> pid;
+        if ( std::filesystem::is_regular_file( arguments[ 1 ] ) )
+        {
+            capture_path = arguments[ 1 ];
+        }
+        else
+        {
+            // Fetch target PID.
+            //
+            ( std::stringstream( arguments[ 1 ] ) ) >> pid;
 
-        // Try to parse hex.
-        if ( pid == 0 )
-            ( std::stringstream( arguments[ 1 ] ) ) >> std::hex >> pid;
+            // Try to parse hex.
+            if ( pid == 0 )
+                ( std::stringstream( arguments[ 1 ] ) ) >> std::hex >> pid;
 
-        // Ensure PID validity.
-        //
-        if ( pid == 0 )
-            return {};
+            // Ensure PID validity.
+            //
+            if ( pid == 0 )
+                return {};
+        }
 
         // Fetch target module name.
         //
@@ -56,6 +84,17 @@ namespace vmpdump
 
         std::optional<uint32_t> ep_rva = {};
         bool disable_relocation = false;
+        uint32_t flags = scan_none;
+        size_t worker_count = 0;
+        bool benchmark = false;
+        std::string export_database_path = "";
+        bool live = false;
+        bool compact = false;
+        bool strip_vmp = false;
+        std::string patch_path = "";
+        std::string apply_patch_path = "";
+        std::string stub_database_path = "";
+        size_t stub_database_capacity = stub_database::default_capacity;
 
         // Fetch any other arguments.
         //
@@ -72,6 +111,118 @@ namespace vmpdump
                 continue;
             }
 
+            // Should we scan in parallel, optionally with a specific number of workers?
+            //
+            if ( arg == "-parallel" )
+            {
+                flags |= scan_parallel;
+                continue;
+            }
+            if ( arg.find( "-threads=" ) == 0 )
+            {
+                ( std::stringstream( arg.substr( 9 ) ) ) >> worker_count;
+
+                flags |= scan_parallel;
+                continue;
+            }
+
+            // Should we only decode the calls found by the prefilter?
+            //
+            if ( arg == "-prefilter" )
+            {
+                flags |= scan_prefilter;
+                continue;
+            }
+
+            // Should we resolve stubs with the emulator, the classifier or the clusters, optionally verifying them against VTIL?
+            //
+            if ( arg == "-fast-stubs" )
+            {
+                flags |= scan_emulate;
+                continue;
+            }
+            if ( arg == "-classify" )
+            {
+                flags |= scan_classify;
+                continue;
+            }
+            if ( arg == "-cluster" )
+            {
+                flags |= scan_cluster;
+                continue;
+            }
+            if ( arg == "-verify-stubs" )
+            {
+                flags |= scan_differential;
+                continue;
+            }
+
+            // Should we benchmark the scanner instead of dumping?
+            //
+            if ( arg == "-bench" )
+            {
+                benchmark = true;
+                continue;
+            }
+
+            // Should we fix the running process instead of dumping?
+            //
+            if ( arg == "-live" )
+            {
+                live = true;
+                continue;
+            }
+
+            // Should we pack the sections of the dump?
+            //
+            if ( arg == "-compact" )
+            {
+                compact = true;
+                continue;
+            }
+
+            // Should we strip the VMP sections nothing references anymore?
+            //
+            if ( arg == "-strip-vmp" )
+            {
+                strip_vmp = true;
+                continue;
+            }
+
+            // Should we write a patch file instead of the dump, or rebuild the dump from one?
+            //
+            if ( arg.find( "-patch=" ) == 0 )
+            {
+                patch_path = arg.substr( 7 );
+                continue;
+            }
+            if ( arg.find( "-apply-patch=" ) == 0 )
+            {
+                apply_patch_path = arg.substr( 13 );
+                continue;
+            }
+
+            // Should we cache the exports of imported modules across runs?
+            //
+            if ( arg.find( "-export-db=" ) == 0 )
+            {
+                export_database_path = arg.substr( 11 );
+                continue;
+            }
+
+            // Should we cache stub analyses across runs, optionally capping the number of stubs cached?
+            //
+            if ( arg.find( "-stub-db=" ) == 0 )
+            {
+                stub_database_path = arg.substr( 9 );
+                continue;
+            }
+            if ( arg.find( "-stub-db-cap=" ) == 0 )
+            {
+                ( std::stringstream( arg.substr( 13 ) ) ) >> stub_database_capacity;
+                continue;
+            }
+
             // Should we mark in the dumped module that relocs have been stripped?
             //
             if ( arg.find( "-disable-reloc" ) )
@@ -81,7 +232,7 @@ namespace vmpdump
             }
         }
 
-        return vmpdump_settings { pid, target_module_name, ep_rva, disable_relocation };
+        return vmpdump_settings { pid, target_module_name, ep_rva, disable_relocation, flags, worker_count, benchmark, capture_path, export_database_path, live, compact, strip_vmp, patch_path, apply_patch_path, stub_database_path, stub_database_capacity };
     }
 
     extern "C" int main( int argc, char* argv[] )
@@ -95,6 +246,11 @@ namespace vmpdump
         for ( int i = 0; i < argc; i++ )
             arguments.push_back( { argv[ i ] } );
 
+        // If requested, run the checks which need no target, before any target is opened, and exit.
+        //
+        if ( arguments.size() == 2 && arguments[ 1 ] == "-selftest" )
+            return bench::run_self_tests() ? 0 : 1;
+
         // Try to parse arguments.
         //
         settings = parse_settings( arguments );
@@ -108,23 +264,139 @@ namespace vmpdump
             return 0;
         }
 
-        std::unique_ptr<vmpdump> instance = vmpdump::from_pid( settings->target_pid, settings->module_name );
+        std::unique_ptr<vmpdump> instance = {};
+        if ( !settings->capture_path.empty() )
+        {
+            instance = vmpdump::from_capture( settings->capture_path, settings->module_name );
+
+            if ( !instance )
+            {
+                log<CON_RED>( "** Failed to open capture %s\r\n", settings->capture_path );
+                return 0;
+            }
 
-        if ( !instance )
+            log<CON_GRN>( "** Successfully opened capture %s, module %s\r\n", settings->capture_path, instance->target_module_view->module_name );
+        }
+        else
         {
-            log<CON_RED>( "** Failed to open process 0x%lx\r\n", settings->target_pid );
+            instance = vmpdump::from_pid( settings->target_pid, settings->module_name );
+
+            if ( !instance )
+            {
+                log<CON_RED>( "** Failed to open process 0x%lx\r\n", settings->target_pid );
+                return 0;
+            }
+
+            log<CON_GRN>( "** Successfully opened process %s, PID 0x%lx\r\n", instance->target_module_view->module_name, instance->process_id );
+        }
+        log<CON_GRN>( "** Selected module: %s\r\n", instance->module_full_path );
+
+        // The dump is written next to the module.
+        //
+        std::filesystem::path module_path = { instance->module_full_path };
+        module_path.remove_filename();
+        module_path /= instance->target_module_view->module_name;
+        module_path.replace_extension( "VMPDump" + module_path.extension().string() );
+
+        // If requested, rebuild the dump from a patch file and the module as fetched, and exit.
+        //
+        if ( !settings->apply_patch_path.empty() )
+        {
+            if ( !patch_file::apply( settings->apply_patch_path, *instance->target_module_view, module_path.string() ) )
+            {
+                log<CON_RED>( "** Failed to apply patch %s, it is invalid or was made from another image\r\n", settings->apply_patch_path );
+                return 1;
+            }
+
+            log<CON_GRN>( "** Patch applied, file written to: %s\r\n", module_path.string() );
             return 0;
         }
 
-        log<CON_GRN>( "** Successfully opened process %s, PID 0x%lx\r\n", instance->target_module_view->module_name, instance->process_id );
-        log<CON_GRN>( "** Selected module: %s\r\n", instance->module_full_path );
+        instance->worker_count = settings->worker_count;
+
+        if ( !settings->export_database_path.empty() )
+            instance->export_db = export_database::open( settings->export_database_path );
+
+        if ( !settings->stub_database_path.empty() )
+            instance->stub_db = stub_database::open( settings->stub_database_path, settings->stub_database_capacity );
+
+        // If requested, benchmark the scanner and exit.
+        //
+        if ( settings->benchmark )
+        {
+            bench::run_scan_benchmark( *instance );
+            return bench::run_self_tests() ? 0 : 1;
+        }
 
         std::map<uint64_t, resolved_import> resolved_imports = {};
         std::vector<import_call> import_calls = {};
 
-        instance->scan_for_imports( resolved_imports, import_calls );
+        instance->scan_for_imports( resolved_imports, import_calls, settings->scan_flags );
 
         log<CON_CYN>( "** Found %i calls to %i imports\r\n", import_calls.size(), resolved_imports.size() );
+        log<CON_CYN>( "** Stub analysis cache: %i targets, %llu hits, %llu misses\r\n", instance->analysis_cache->size(), instance->analysis_cache->hit_count(), instance->analysis_cache->miss_count() );
+
+        log<CON_CYN>( "** Lifted %llu stubs, at most %llu at once, peak RSS %llu KB\r\n", lift_context::lift_count(), lift_context::peak_live_routine_count(), lift_context::peak_rss() / 1024 );
+
+        if ( settings->scan_flags & ( scan_emulate | scan_differential ) )
+        {
+            log<CON_CYN>( "** Stub emulator: %llu resolved, %llu rejected, %llu lifted\r\n", instance->emulator->resolved_count(), instance->emulator->rejected_count(), instance->emulator->unsupported_count() );
+
+            if ( settings->scan_flags & scan_differential )
+            {
+                if ( instance->emulator->disagreement_count() )
+                    log<CON_RED>( "** Stub emulator: %llu disagreements with VTIL\r\n", instance->emulator->disagreement_count() );
+                else
+                    log<CON_GRN>( "** Stub emulator: no disagreements with VTIL\r\n" );
+            }
+        }
+
+        if ( settings->scan_flags & scan_classify )
+        {
+            const std::vector<stub_template>& templates = stub_classifier::templates();
+            for ( size_t i = 0; i < templates.size(); i++ )
+                log<CON_CYN>( "** Stub classifier: %-20s %llu hits\r\n", templates[ i ].name, instance->classifier->hit_count( i ) );
+            log<CON_CYN>( "** Stub classifier: %-20s %llu\r\n", "unmatched", instance->classifier->unmatched_count() );
+
+            if ( settings->scan_flags & scan_differential )
+            {
+                if ( instance->classifier->disagreement_count() )
+                    log<CON_RED>( "** Stub classifier: %llu disagreements with VTIL\r\n", instance->classifier->disagreement_count() );
+                else
+                    log<CON_GRN>( "** Stub classifier: no disagreements with VTIL\r\n" );
+            }
+        }
+
+        // Persist the analyses of any newly seen stubs.
+        //
+        if ( instance->stub_db )
+        {
+            log<CON_CYN>( "** Stub database: %llu hits, %llu misses\r\n", instance->stub_db->hit_count(), instance->stub_db->miss_count() );
+            if ( !instance->stub_db->save() )
+                log<CON_RED>( "** Failed to save stub database to %s\r\n", settings->stub_database_path );
+            else if ( instance->stub_db->evicted_count() )
+                log<CON_YLW>( "** Stub database: evicted %llu least recently used stubs\r\n", instance->stub_db->evicted_count() );
+        }
+
+        if ( settings->scan_flags & scan_cluster )
+        {
+            uint64_t derived = instance->clusters->derived_count();
+            uint64_t analyzed = instance->clusters->analyzed_count();
+            log<CON_CYN>( "** Stub clusters: %llu shapes, %llu stubs derived, %llu analyzed in full (%.1f%% of full analyses avoided), %llu spot checks\r\n",
+                          instance->clusters->cluster_count(), derived, analyzed, derived + analyzed ? 100.0 * derived / ( derived + analyzed ) : 0.0, instance->clusters->spot_check_count() );
+            if ( instance->clusters->disagreement_count() )
+                log<CON_RED>( "** Stub clusters: %llu rules dropped after disagreeing with a full analysis\r\n", instance->clusters->disagreement_count() );
+            else if ( settings->scan_flags & scan_differential )
+                log<CON_GRN>( "** Stub clusters: no disagreements with VTIL\r\n" );
+        }
+
+        // The rebuild needs the whole module, so fetch whatever the scan did not touch.
+        //
+        instance->target_module_view->ensure( 0, instance->target_module_view->module_size );
+
+        std::vector<uint64_t> unreadable_pages = instance->target_module_view->unreadable_pages();
+        if ( !unreadable_pages.empty() )
+            log<CON_YLW>( "** %i pages of the module could not be read, and were zero-filled\r\n", unreadable_pages.size() );
 
         // Define helper structures to organize retrieved data.
         //
@@ -135,13 +407,28 @@ namespace vmpdump
         };
         struct module_info
         {
-            module_view view;
+            export_view view;
             std::vector<export_info> exports;
         };
 
-        // Resolve exports for all found imports.
+        // Collect the modules of all found imports.
+        //
+        std::vector<remote_ea_t> import_module_bases;
+        for ( auto& [thunk_rva, import] : resolved_imports )
+        {
+            std::optional<remote_ea_t> import_module_base = instance->base_from_ea( import.target_ea );
+            if ( import_module_base && std::find( import_module_bases.begin(), import_module_bases.end(), *import_module_base ) == import_module_bases.end() )
+                import_module_bases.push_back( *import_module_base );
+        }
+
+        // Fetch and index the exports of those modules in parallel.
         //
         std::map<remote_ea_t, module_info> module_views;
+        for ( auto& [base, view] : instance->exports_from_bases( import_module_bases ) )
+            module_views.emplace( base, module_info { std::move( view ), {} } );
+
+        // Resolve exports for all found imports.
+        //
         for ( auto& [thunk_rva, import] : resolved_imports )
         {
             // Resolve imported module base.
@@ -153,23 +440,13 @@ namespace vmpdump
                 continue;
             }
 
-            // If module view already exists, fetch it.
+            // Fetch the module view.
             //
             auto it = module_views.find( *import_module_base );
             if ( it == module_views.end() )
             {
-                // Otherwise create the module view.
-                //
-                std::optional<module_view> import_module_view = instance->view_from_base( *import_module_base );
-                if ( !import_module_view )
-                {
-                    log<CON_RED>( "\t** Failed to construct module view from base 0x%p\r\n", *import_module_base );
-                    continue;
-                }
-
-                // And insert it into the map.
-                //
-                it = module_views.insert( { *import_module_base, { *import_module_view, {} } } ).first;
+                log<CON_RED>( "\t** Failed to construct module view from base 0x%p\r\n", *import_module_base );
+                continue;
             }
 
             // Convert the import target remote ea to an export identifier for the target module.
@@ -215,10 +492,10 @@ namespace vmpdump
         win::image_t<true>* target_image = instance->target_module_view->local_module.get_image();
         win::nt_headers_x64_t* nt = target_image->get_nt_headers();
 
-        // Serialize import names.
+        // Lay out import names. Tables are only laid out here, and written straight into the output once its layout is final.
         //
         uint64_t import_section_begin_rva = pe_constructor::get_sections_end( instance->target_module_view->local_module );
-        auto [named_imports_serialized, named_imports_rvas, named_imports_end] = pe_constructor::serialize_table( named_imports, import_section_begin_rva );
+        auto [named_imports_rvas, named_imports_end] = pe_constructor::layout_table( named_imports, import_section_begin_rva );
 
         // Build import thunks and import module names.
         //
@@ -264,9 +541,9 @@ namespace vmpdump
             import_thunks.push_back( {} );
         }
 
-        // Serialize module names and import thunks.
+        // Lay out module names and import thunks.
         //
-        auto [module_names_serialized, module_names_rvas, module_names_end] = pe_constructor::serialize_table( module_names, named_imports_end );
+        auto [module_names_rvas, module_names_end] = pe_constructor::layout_table( module_names, named_imports_end );
 
         // Unlike the import table, we aren't gonna create a new IAT; we are going to append the existing one instead.
         // This is because we want to make sure that the existing, non-obfuscated imports are still valid, and it's easier
@@ -275,7 +552,7 @@ namespace vmpdump
         // TODO: Check if the IAT actually exists before using it.
         //
         uint32_t appended_import_thunks_rva = nt->optional_header.data_directories.iat_directory.rva + nt->optional_header.data_directories.iat_directory.size;
-        auto [import_thunks_serialized, import_thunks_rvas, import_thunks_end] = pe_constructor::serialize_table( import_thunks, appended_import_thunks_rva );
+        auto [import_thunks_rvas, import_thunks_end] = pe_constructor::layout_table( import_thunks, appended_import_thunks_rva );
 
         // Create map of {export remote ea, thunk rva} for easy future thunk lookup.
         //
@@ -291,22 +568,57 @@ namespace vmpdump
             thunk_index++;
         }
 
+        // Persist the exports of any newly seen modules. The views are released first, as they may still
+        // reference the mapping of the database which is about to be replaced.
+        //
+        module_views.clear();
+        if ( instance->export_db )
+        {
+            log<CON_CYN>( "** Export database: %llu hits, %llu misses, %llu stale\r\n", instance->export_db->hit_count(), instance->export_db->miss_count(), instance->export_db->stale_count() );
+            if ( !instance->export_db->save() )
+                log<CON_RED>( "** Failed to save export database to %s\r\n", settings->export_database_path );
+        }
+
+        // In live mode, write the thunks and redirect the calls in the running process, instead of building a dump.
+        //
+        if ( settings->live )
+        {
+            log<CON_CYN>( "** Fixing %i calls in the running process\r\n", import_calls.size() );
+
+            size_t redirected = instance->fix_live( import_calls, export_thunk_rvas );
+            if ( redirected == import_calls.size() )
+                log<CON_GRN>( "** Redirected all %i calls\r\n", redirected );
+            else
+                log<CON_RED>( "** Redirected %i of %i calls\r\n", redirected, import_calls.size() );
+            log<CON_CYN>( "** Stubs: %llu in padding caves, %llu by growing sections\r\n", instance->stub_caves->padding_stub_count(), instance->stub_caves->tail_stub_count() );
+            return 0;
+        }
+
         // Now that we have built and serialized the new import thunks, we can fix the calls to said thunks.
         //
+        // Every call is planned first, so that conflicting patches are caught before any is applied.
+        //
         log<CON_CYN>( "** Converting %i calls\r\n", import_calls.size(), resolved_imports.size() );
+        patch_plan call_plan;
         for ( auto& import_call : import_calls )
         {
-            if ( instance->convert_local_call( import_call, instance->target_module_view->module_base + export_thunk_rvas[ import_call.import->target_ea ] ) )
+            if ( instance->convert_local_call( import_call, instance->target_module_view->module_base + export_thunk_rvas[ import_call.import->target_ea ], call_plan ) )
                 log<CON_GRN>( "\t** Successfully converted call @ RVA 0x%lx to thunk @ RVA 0x%lx\r\n", import_call.call_rva, export_thunk_rvas[ import_call.import->target_ea ] );
             else
                 log<CON_RED>( "\t** Failed to convert call @ RVA 0x%lx\r\n", import_call.call_rva );
         }
+        size_t applied = call_plan.apply( *instance->target_module_view, settings->worker_count );
+        if ( applied == import_calls.size() )
+            log<CON_GRN>( "** Applied all %llu patches\r\n", applied );
+        else
+            log<CON_RED>( "** Applied %llu of %llu patches, %llu conflicting\r\n", applied, import_calls.size(), call_plan.get_conflicts().size() );
+        log<CON_CYN>( "** Stubs: %llu in padding caves, %llu by growing sections\r\n", instance->stub_caves->padding_stub_count(), instance->stub_caves->tail_stub_count() );
 
         // Parse & transfer existing import directories.
         // As we are creating a new import table, we must preserve the current one by copying it.
         //
         std::vector<import_directory> import_directories;
-        uint8_t* existing_imports_base = instance->target_module_view->local_module.raw_bytes.data() + nt->optional_header.data_directories.import_directory.rva;
+        uint8_t* existing_imports_base = instance->target_module_view->local_module.data() + nt->optional_header.data_directories.import_directory.rva;
         size_t import_table_offset = 0;
         while ( true )
         {
@@ -347,36 +659,104 @@ namespace vmpdump
             i++;
         }
 
-        // Serialize import directories.
+        // Lay out import directories.
+        //
+        auto [import_directories_rvas, import_directories_end] = pe_constructor::layout_table( import_directories, module_names_end );
+
+        // Now that the calls no longer go through the import stubs, strip the VMP sections if nothing references any of them
+        // anymore, by zeroing them so that they can be trimmed from the output. As long as one is referenced, all of them are kept.
+        //
+        if ( settings->strip_vmp )
+        {
+            // Without base relocations, the pointers into the sections cannot be located, so only strip those which not even
+            // a conservative scan of the image for aligned pointers finds any into.
+            //
+            if ( !has_base_relocations( instance->target_module_view->local_module ) )
+                log<CON_YLW>( "** No base relocations: stripping only sections no aligned value in the image points into\r\n" );
+
+            uint64_t entry_point = settings->ep_rva ? *settings->ep_rva : nt->optional_header.entry_point;
+            for ( const section_references& references : find_vmp_references( instance->target_module_view->local_module, entry_point ) )
+            {
+                win::section_header_t* section = nt->get_section( references.section_index );
+                std::string section_name = { section->name, strnlen( section->name, win::LEN_SECTION_NAME ) };
+
+                if ( references.referenced() )
+                {
+                    log<CON_YLW>( "** Kept %s: %i references (%s), first from RVA 0x%llx\r\n", section_name, references.count, describe_reference_kinds( references.kinds ), *references.first_from );
+                    continue;
+                }
+
+                uint64_t begin = std::min<uint64_t>( references.range.first, instance->target_module_view->local_module.size() );
+                uint64_t end = std::min<uint64_t>( references.range.second, instance->target_module_view->local_module.size() );
+                instance->target_module_view->mark_dirty( begin, end - begin );
+                memset( instance->target_module_view->local_module.data() + begin, 0, end - begin );
+                log<CON_GRN>( "** Stripped %s: 0x%llx bytes\r\n", section_name, end - begin );
+            }
+        }
+
+        // Add our new import thunks to the pre-existing IAT, in the local module, so that they are laid out with its section.
+        // TODO: verify we have enough space left in the section!
         //
-        auto [import_directories_serialized, import_directories_rvas, import_directories_end] = pe_constructor::serialize_table( import_directories, module_names_end );
+        if ( import_thunks_end > instance->target_module_view->local_module.size() )
+        {
+            log<CON_RED>( "** Appended import thunks end past the image @ RVA 0x%lx\r\n", import_thunks_end );
+            return 1;
+        }
+        instance->target_module_view->mark_dirty( appended_import_thunks_rva, import_thunks_end - appended_import_thunks_rva );
+        pe_constructor::write_table( import_thunks, instance->target_module_view->local_module.data() + appended_import_thunks_rva );
 
-        // Concat each serialized buffer to build the new import table section.
+        // Plan the raw module: the converted image, with the new import table section appended.
         //
-        std::vector<uint8_t> import_section;
-        import_section.insert( import_section.end(), named_imports_serialized.begin(), named_imports_serialized.end() );
-        import_section.insert( import_section.end(), module_names_serialized.begin(), module_names_serialized.end() );
-        import_section.insert( import_section.end(), import_directories_serialized.begin(), import_directories_serialized.end() );
+        std::optional<pe_constructor::raw_layout> raw_layout = pe_constructor::plan_raw_image( instance->target_module_view->local_module, import_directories_end - import_section_begin_rva, import_section_begin_rva, ".vmpdmp", { 0x40000040 }, settings->compact );
+        if ( !raw_layout )
+        {
+            log<CON_RED>( "** No room left in the headers for the import section\r\n" );
+            return 1;
+        }
 
-        // Convert the virtual pe image to a raw pe image.
+        // Either create the output file, sized exactly, and write the raw module into it in place, or only build the headers and
+        // the new section, which a patch file carries along with the patched pages.
         //
-        pe_image raw_module = pe_constructor::virtual_to_raw_image( instance->target_module_view->local_module );
+        std::shared_ptr<mapped_file> output;
+        std::vector<uint8_t> patch_headers;
+        std::vector<uint8_t> patch_section;
+        win::nt_headers_x64_t* raw_nt;
+        uint8_t* import_section;
+        if ( settings->patch_path.empty() )
+        {
+            output = mapped_file::create( module_path.string(), raw_layout->file_size );
+            if ( !output )
+            {
+                log<CON_RED>( "** Failed to create output file %s\r\n", module_path.string() );
+                return 1;
+            }
+
+            raw_nt = pe_constructor::write_raw_image( instance->target_module_view->local_module, *raw_layout, output->data() );
+            import_section = output->data() + raw_layout->new_section.ptr_raw_data;
+        }
+        else
+        {
+            patch_headers.resize( nt->optional_header.size_headers );
+            patch_section.resize( raw_layout->new_section.size_raw_data );
 
-        // Add the new section to the raw module.
+            raw_nt = pe_constructor::write_raw_headers( instance->target_module_view->local_module, *raw_layout, patch_headers.data() );
+            import_section = patch_section.data();
+        }
+
+        // Write the new import table section.
         //
-        pe_constructor::add_section( raw_module, import_section, import_section_begin_rva, ".vmpdmp", { 0x40000040 } );
+        pe_constructor::write_table( named_imports, import_section );
+        pe_constructor::write_table( module_names, import_section + ( named_imports_end - import_section_begin_rva ) );
+        pe_constructor::write_table( import_directories, import_section + ( module_names_end - import_section_begin_rva ) );
 
         // Set new import data directory.
         //
-        auto raw_nt = raw_module.get_image()->get_nt_headers();
         raw_nt->optional_header.data_directories.import_directory.rva = module_names_end;
         raw_nt->optional_header.data_directories.import_directory.size = import_directories_end - module_names_end;
 
-        // Add our new import thunks to the pre-existing IAT.
-        // TODO: verify we have enough space left in the section!
+        // Extend the IAT over our new import thunks.
         //
-        memcpy( raw_module.get_image()->rva_to_ptr( appended_import_thunks_rva ), import_thunks_serialized.data(), import_thunks_serialized.size() );
-        raw_nt->optional_header.data_directories.iat_directory.size += import_thunks_serialized.size();
+        raw_nt->optional_header.data_directories.iat_directory.size += import_thunks_end - appended_import_thunks_rva;
 
         // Update EP if provided.
         //
@@ -392,17 +772,20 @@ namespace vmpdump
         //
         raw_nt->optional_header.characteristics.force_integrity = false;
 
-        log<CON_GRN>( "** New ImageBase: 0x%llx, SizeOfImage: 0x%lx\r\n", raw_nt->optional_header.image_base, raw_nt->optional_header.size_image );
+        log<CON_GRN>( "** New ImageBase: 0x%llx, SizeOfImage: 0x%lx, file size: 0x%llx\r\n", raw_nt->optional_header.image_base, raw_nt->optional_header.size_image, raw_layout->file_size );
 
-        // Save module.
-        //
-        std::filesystem::path module_path = { instance->module_full_path };
-        module_path.remove_filename();
-        module_path /= instance->target_module_view->module_name;
+        if ( !settings->patch_path.empty() )
+        {
+            std::optional<size_t> patch_size = patch_file::write( settings->patch_path, *instance->target_module_view, *raw_layout, patch_headers, patch_section );
+            if ( !patch_size )
+            {
+                log<CON_RED>( "** Failed to write patch file %s\r\n", settings->patch_path );
+                return 1;
+            }
 
-        module_path.replace_extension( "VMPDump" + module_path.extension().string() );
-        std::ofstream outfile( module_path.string(), std::ios::out | std::ios::binary );
-        outfile.write( ( const char* )raw_module.raw_bytes.data(), raw_module.raw_bytes.size() );
+            log<CON_GRN>( "** Patch written to: %s, 0x%llx bytes\r\n", settings->patch_path, *patch_size );
+            return 0;
+        }
 
         log<CON_GRN>( "** File written to: %s\r\n", module_path.string() );
 
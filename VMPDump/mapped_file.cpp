@@ -0,0 +1,176 @@
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vmpdump
+{
+    mapped_file::~mapped_file()
+    {
+#ifdef _WIN32
+        if ( view_base )
+            UnmapViewOfFile( view_base );
+        if ( mapping_handle )
+            CloseHandle( mapping_handle );
+        if ( file_handle && file_handle != INVALID_HANDLE_VALUE )
+            CloseHandle( file_handle );
+#else
+        if ( view_base )
+            munmap( view_base, view_length );
+#endif
+    }
+
+    // Maps the file at the given path, returning nullptr on failure.
+    // The file may be renamed over or deleted while it is mapped, as databases are replaced while other processes read them.
+    // If length is non-zero, only [offset, offset + length) of the file is mapped, which must lie within the file.
+    //
+    std::shared_ptr<mapped_file> mapped_file::open( const std::string& path, map_mode mode, uint64_t offset, size_t length )
+    {
+        std::shared_ptr<mapped_file> result( new mapped_file() );
+
+#ifdef _WIN32
+        result->file_handle = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+        if ( result->file_handle == INVALID_HANDLE_VALUE )
+            return nullptr;
+
+        LARGE_INTEGER file_size;
+        if ( !GetFileSizeEx( result->file_handle, &file_size ) || file_size.QuadPart == 0 )
+            return nullptr;
+        uint64_t total_size = ( uint64_t )file_size.QuadPart;
+
+        SYSTEM_INFO system_info;
+        GetSystemInfo( &system_info );
+        uint64_t granularity = system_info.dwAllocationGranularity;
+#else
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd < 0 )
+            return nullptr;
+
+        struct stat file_stat;
+        if ( fstat( fd, &file_stat ) != 0 || file_stat.st_size == 0 )
+        {
+            close( fd );
+            return nullptr;
+        }
+        uint64_t total_size = ( uint64_t )file_stat.st_size;
+
+        uint64_t granularity = ( uint64_t )sysconf( _SC_PAGESIZE );
+#endif
+
+        // Default to the whole file, and ensure the window lies within it.
+        //
+        if ( length == 0 )
+            length = ( size_t )( total_size - std::min( offset, total_size ) );
+        if ( length == 0 || offset + length > total_size )
+        {
+#ifndef _WIN32
+            close( fd );
+#endif
+            return nullptr;
+        }
+
+        // Views must start at a multiple of the allocation granularity, so map from the aligned offset below.
+        //
+        uint64_t view_offset = offset & ~( granularity - 1 );
+        result->view_length = ( size_t )( offset - view_offset ) + length;
+        result->length = length;
+
+#ifdef _WIN32
+        result->mapping_handle = CreateFileMappingA( result->file_handle, nullptr, mode == map_mode::copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr );
+        if ( !result->mapping_handle )
+            return nullptr;
+
+        result->view_base = MapViewOfFile( result->mapping_handle, mode == map_mode::copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, ( DWORD )( view_offset >> 32 ), ( DWORD )view_offset, result->view_length );
+        if ( !result->view_base )
+            return nullptr;
+#else
+        int protection = mode == map_mode::copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* view = mmap( nullptr, result->view_length, protection, MAP_PRIVATE, fd, ( off_t )view_offset );
+        close( fd );
+
+        if ( view == MAP_FAILED )
+            return nullptr;
+        result->view_base = view;
+#endif
+
+        result->base = ( uint8_t* )result->view_base + ( offset - view_offset );
+        return result;
+    }
+
+    // Creates the file at the given path, replacing any existing one, sized to exactly the given size and zeroed,
+    // and maps it writable. Writes reach the file, at the latest when it is unmapped. Returns nullptr on failure.
+    //
+    std::shared_ptr<mapped_file> mapped_file::create( const std::string& path, size_t size )
+    {
+        if ( size == 0 )
+            return nullptr;
+
+        std::shared_ptr<mapped_file> result( new mapped_file() );
+        result->length = size;
+        result->view_length = size;
+
+#ifdef _WIN32
+        result->file_handle = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+        if ( result->file_handle == INVALID_HANDLE_VALUE )
+            return nullptr;
+
+        // Creating the mapping with a size extends the file to it, zero-filled.
+        //
+        result->mapping_handle = CreateFileMappingA( result->file_handle, nullptr, PAGE_READWRITE, ( DWORD )( ( uint64_t )size >> 32 ), ( DWORD )size, nullptr );
+        if ( !result->mapping_handle )
+            return nullptr;
+
+        result->view_base = MapViewOfFile( result->mapping_handle, FILE_MAP_WRITE, 0, 0, size );
+        if ( !result->view_base )
+            return nullptr;
+#else
+        int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+        if ( fd < 0 )
+            return nullptr;
+
+        if ( ftruncate( fd, ( off_t )size ) != 0 )
+        {
+            close( fd );
+            return nullptr;
+        }
+
+        void* view = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        close( fd );
+
+        if ( view == MAP_FAILED )
+            return nullptr;
+        result->view_base = view;
+#endif
+
+        result->base = ( uint8_t* )result->view_base;
+        return result;
+    }
+
+    // Returns a temporary path next to the given one, unique to the calling process and call, for a file which is
+    // written in full and then renamed over the given path. Concurrent writers thus never share a temporary file.
+    //
+    std::string mapped_file::temporary_path( const std::string& path )
+    {
+        static std::atomic<uint64_t> counter = { 0 };
+        static const uint64_t nonce = ( ( uint64_t )std::random_device{}() << 32 ) | std::random_device{}();
+
+#ifdef _WIN32
+        uint32_t process_id = GetCurrentProcessId();
+#else
+        uint32_t process_id = ( uint32_t )getpid();
+#endif
+
+        std::stringstream result;
+        result << path << "." << process_id << "." << std::hex << nonce << "." << counter++ << ".tmp";
+        return result.str();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace vmpdump
+{
+    // How a file is mapped into memory.
+    //
+    enum class map_mode
+    {
+        // The view can only be read.
+        //
+        read_only,
+
+        // The view can be written, but writes are private to the process and never reach the file.
+        //
+        copy_on_write,
+    };
+
+    // A file mapped into memory, unmapped on destruction.
+    //
+    class mapped_file
+    {
+    private:
+        // The view of the file, and the granularity-aligned mapping containing it.
+        //
+        uint8_t* base = nullptr;
+        size_t length = 0;
+        void* view_base = nullptr;
+        size_t view_length = 0;
+
+#ifdef _WIN32
+        // The file and mapping handles.
+        //
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+#endif
+
+        mapped_file() = default;
+
+    public:
+        // Cannot be copied or moved; shared through a shared_ptr instead.
+        //
+        mapped_file( const mapped_file& ) = delete;
+        mapped_file( mapped_file&& ) = delete;
+        mapped_file& operator=( const mapped_file& ) = delete;
+        mapped_file& operator=( mapped_file&& ) = delete;
+        ~mapped_file();
+
+        // Maps the file at the given path, returning nullptr on failure.
+        // The file may be renamed over or deleted while it is mapped, as databases are replaced while other processes read them.
+        // If length is non-zero, only [offset, offset + length) of the file is mapped, which must lie within the file.
+        //
+        static std::shared_ptr<mapped_file> open( const std::string& path, map_mode mode = map_mode::read_only, uint64_t offset = 0, size_t length = 0 );
+
+        // Creates the file at the given path, replacing any existing one, sized to exactly the given size and zeroed,
+        // and maps it writable. Writes reach the file, at the latest when it is unmapped. Returns nullptr on failure.
+        //
+        static std::shared_ptr<mapped_file> create( const std::string& path, size_t size );
+
+        // Returns a temporary path next to the given one, unique to the calling process and call, for a file which is
+        // written in full and then renamed over the given path. Concurrent writers thus never share a temporary file.
+        //
+        static std::string temporary_path( const std::string& path );
+
+        inline uint8_t* data() const { return base; }
+        inline size_t size() const { return length; }
+    };
+}
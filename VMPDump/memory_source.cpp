@@ -0,0 +1,63 @@
+#include "memory_source.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace vmpdump
+{
+    // Writes size bytes to the given effective address, making every region of the range writable first, and restoring
+    // the protection of each afterwards. Flushes the instruction cache if any of them was executable.
+    //
+    bool protected_memory_source::write( remote_ea_t ea, const void* buffer, size_t size )
+    {
+        struct region
+        {
+            remote_ea_t begin;
+            remote_ea_t end;
+            uint32_t protection;
+        };
+
+        // Get RWX permissions for each region, remembering its own protection.
+        //
+        std::vector<region> regions;
+        bool result = true;
+        for ( remote_ea_t it = ea; it < ea + size; )
+        {
+            std::optional<std::pair<remote_ea_t, uint32_t>> query = query_protection( it );
+            if ( !query )
+            {
+                result = false;
+                break;
+            }
+
+            remote_ea_t end = std::min<remote_ea_t>( query->first, ea + size );
+            if ( !set_protection( it, end - it, page_execute_readwrite ) )
+            {
+                result = false;
+                break;
+            }
+            regions.push_back( { it, end, query->second } );
+            it = end;
+        }
+
+        // Write the memory.
+        //
+        if ( result )
+            result = write_writable( ea, buffer, size );
+
+        // Restore old memory permissions, region by region.
+        //
+        bool executable = false;
+        for ( const region& region : regions )
+        {
+            if ( !set_protection( region.begin, region.end - region.begin, region.protection ) )
+                result = false;
+            executable |= is_executable( region.protection );
+        }
+
+        // Make sure the process does not run stale code.
+        //
+        if ( result && executable )
+            flush_instructions( ea, size );
+        return result;
+    }
+}
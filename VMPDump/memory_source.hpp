@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace vmpdump
+{
+    // A remote process effective address.
+    //
+    using remote_ea_t = uintptr_t;
+
+    // A map of { module base, { module name, module size } }.
+    //
+    using module_list_t = std::map<remote_ea_t, std::pair<std::string, size_t>>;
+
+    // An address space VMPDump can read modules from, and optionally write them back to.
+    // This is either a live process, or a capture of one.
+    //
+    class memory_source
+    {
+    public:
+        virtual ~memory_source() = default;
+
+        // Reads size bytes at the given effective address, returning false if any of them are unreadable.
+        //
+        virtual bool read( remote_ea_t ea, void* buffer, size_t size ) = 0;
+
+        // Writes size bytes to the given effective address, changing the page protection as required.
+        // Returns false if the source is read-only or the write failed.
+        //
+        virtual bool write( remote_ea_t ea, const void* buffer, size_t size ) { return false; }
+
+        // Returns a private, copy-on-write view of [ea, ea + size) which aliases the storage of the source, or nullptr
+        // if the range is not backed by contiguous mapped memory. Writes to the view never reach the source.
+        //
+        virtual std::shared_ptr<uint8_t> map( remote_ea_t ea, size_t size ) { return nullptr; }
+
+        // Enumerates the modules loaded in the address space.
+        //
+        virtual module_list_t get_modules() = 0;
+
+        // Returns the full path of the process image.
+        //
+        virtual std::string get_image_path() = 0;
+
+        // Returns the process id, or zero if the source is not a live process.
+        //
+        virtual uint32_t get_process_id() const { return 0; }
+    };
+
+    // An address space whose pages must be made writable before writing to them, and restored afterwards, such as a live process.
+    // Changing the protection of a range only reports the old protection of its first page, so the range is walked region by
+    // region, each of pages sharing one protection, and each region is restored to its own.
+    //
+    class protected_memory_source : public memory_source
+    {
+    public:
+        // The page protections used, with the values of the Win32 PAGE_* constants.
+        //
+        static constexpr uint32_t page_readonly = 0x02;
+        static constexpr uint32_t page_readwrite = 0x04;
+        static constexpr uint32_t page_execute_read = 0x20;
+        static constexpr uint32_t page_execute_readwrite = 0x40;
+
+        // Returns whether the given protection allows execution.
+        //
+        static bool is_executable( uint32_t protection ) { return protection & 0xF0; }
+
+        // Writes size bytes to the given effective address, making every region of the range writable first, and restoring
+        // the protection of each afterwards. Flushes the instruction cache if any of them was executable.
+        //
+        bool write( remote_ea_t ea, const void* buffer, size_t size ) override;
+
+    protected:
+        // Returns the end of the region of pages holding ea which share its protection, along with that protection,
+        // or empty {} if ea is not committed.
+        //
+        virtual std::optional<std::pair<remote_ea_t, uint32_t>> query_protection( remote_ea_t ea ) = 0;
+
+        // Changes the protection of the pages of [ea, ea + size), returning false on failure.
+        //
+        virtual bool set_protection( remote_ea_t ea, size_t size, uint32_t protection ) = 0;
+
+        // Writes size bytes to the given effective address, which must already be writable.
+        //
+        virtual bool write_writable( remote_ea_t ea, const void* buffer, size_t size ) = 0;
+
+        // Flushes the instruction cache for [ea, ea + size), after code was written there.
+        //
+        virtual void flush_instructions( remote_ea_t ea, size_t size ) {}
+    };
+}
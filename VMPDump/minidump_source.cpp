@@ -0,0 +1,287 @@
+#include "minidump_source.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace vmpdump
+{
+    // The on-disk minidump structures we use, as documented in minidumpapiset.h.
+    //
+#pragma pack(push, 4)
+    struct minidump_header
+    {
+        uint32_t signature;
+        uint32_t version;
+        uint32_t number_of_streams;
+        uint32_t stream_directory_rva;
+        uint32_t checksum;
+        uint32_t time_date_stamp;
+        uint64_t flags;
+    };
+
+    struct minidump_directory
+    {
+        uint32_t stream_type;
+        uint32_t data_size;
+        uint32_t rva;
+    };
+
+    struct minidump_module
+    {
+        uint64_t base_of_image;
+        uint32_t size_of_image;
+        uint32_t checksum;
+        uint32_t time_date_stamp;
+        uint32_t module_name_rva;
+        uint32_t version_info[ 13 ];
+        uint32_t cv_record[ 2 ];
+        uint32_t misc_record[ 2 ];
+        uint64_t reserved[ 2 ];
+    };
+
+    struct minidump_memory_descriptor
+    {
+        uint64_t start_of_memory_range;
+        uint32_t data_size;
+        uint32_t rva;
+    };
+
+    struct minidump_memory_descriptor64
+    {
+        uint64_t start_of_memory_range;
+        uint64_t data_size;
+    };
+#pragma pack(pop)
+    static_assert( sizeof( minidump_header ) == 32 );
+    static_assert( sizeof( minidump_directory ) == 12 );
+    static_assert( sizeof( minidump_module ) == 108 );
+    static_assert( sizeof( minidump_memory_descriptor ) == 16 );
+
+    // 'MDMP', and the stream types.
+    //
+    static constexpr uint32_t minidump_signature = 0x504D444D;
+    static constexpr uint32_t module_list_stream = 4;
+    static constexpr uint32_t memory_list_stream = 5;
+    static constexpr uint32_t memory64_list_stream = 9;
+
+    // Copies a T out of the dump at the given offset, returning false if it does not fit.
+    // Structures in a minidump are not necessarily aligned, so they are never accessed in place.
+    //
+    template<typename T>
+    static bool load( const mapped_file& dump, uint64_t offset, T& out )
+    {
+        if ( offset > dump.size() || dump.size() - offset < sizeof( T ) )
+            return false;
+
+        memcpy( &out, dump.data() + offset, sizeof( T ) );
+        return true;
+    }
+
+    // Reads the UTF-16 MINIDUMP_STRING at the given offset. Non-ASCII characters are replaced with '?'.
+    //
+    static std::string load_string( const mapped_file& dump, uint64_t offset )
+    {
+        uint32_t length;
+        if ( !load( dump, offset, length ) || length / 2 > ( dump.size() - offset - 4 ) / 2 )
+            return {};
+
+        std::string result;
+        result.reserve( length / 2 );
+        for ( uint32_t i = 0; i < length / 2; i++ )
+        {
+            uint16_t character;
+            memcpy( &character, dump.data() + offset + 4 + i * 2, 2 );
+            result.push_back( character < 0x80 ? ( char )character : '?' );
+        }
+        return result;
+    }
+
+    // Opens the minidump at the given path, returning nullptr if it is not a valid minidump.
+    //
+    std::shared_ptr<minidump_memory_source> minidump_memory_source::open( const std::string& path )
+    {
+        std::shared_ptr<mapped_file> dump = mapped_file::open( path, map_mode::read_only );
+        if ( !dump )
+            return nullptr;
+
+        std::shared_ptr<minidump_memory_source> result = std::make_shared<minidump_memory_source>();
+        result->dump_path = path;
+        result->dump = std::move( dump );
+        if ( !result->parse() )
+            return nullptr;
+
+        return result;
+    }
+
+    // Adds a captured memory range, merging it with the previous one if possible.
+    //
+    void minidump_memory_source::add_range( remote_ea_t start, size_t size, uint64_t file_offset )
+    {
+        if ( size == 0 )
+            return;
+
+        // Merge with the preceding range if both the memory and the bytes in the dump are contiguous.
+        //
+        auto it = ranges.lower_bound( start );
+        if ( it != ranges.begin() )
+        {
+            auto prev = std::prev( it );
+            if ( prev->first + prev->second.size == start && prev->second.file_offset + prev->second.size == file_offset )
+            {
+                prev->second.size += size;
+                return;
+            }
+        }
+
+        ranges.insert( { start, { size, file_offset } } );
+    }
+
+    // Parses the dump's streams, returning false if it is malformed.
+    //
+    bool minidump_memory_source::parse()
+    {
+        minidump_header header;
+        if ( !load( *dump, 0, header ) || header.signature != minidump_signature )
+            return false;
+
+        for ( uint32_t i = 0; i < header.number_of_streams; i++ )
+        {
+            minidump_directory directory;
+            if ( !load( *dump, header.stream_directory_rva + ( uint64_t )i * sizeof( minidump_directory ), directory ) )
+                return false;
+
+            switch ( directory.stream_type )
+            {
+                case module_list_stream:
+                {
+                    uint32_t count;
+                    if ( !load( *dump, directory.rva, count ) )
+                        return false;
+
+                    for ( uint32_t j = 0; j < count; j++ )
+                    {
+                        minidump_module module;
+                        if ( !load( *dump, directory.rva + 4ull + ( uint64_t )j * sizeof( minidump_module ), module ) )
+                            return false;
+
+                        // Modules are listed by full path; the first one is the process image.
+                        //
+                        std::string module_path = load_string( *dump, module.module_name_rva );
+                        if ( image_path.empty() )
+                            image_path = module_path;
+
+                        // The path is a Windows path, so split it by hand rather than by the host's conventions.
+                        //
+                        std::string module_name = module_path.substr( module_path.find_last_of( "\\/" ) + 1 );
+                        modules.insert( { ( remote_ea_t )module.base_of_image, { module_name, module.size_of_image } } );
+                    }
+                    break;
+                }
+                case memory_list_stream:
+                {
+                    uint32_t count;
+                    if ( !load( *dump, directory.rva, count ) )
+                        return false;
+
+                    for ( uint32_t j = 0; j < count; j++ )
+                    {
+                        minidump_memory_descriptor descriptor;
+                        if ( !load( *dump, directory.rva + 4ull + ( uint64_t )j * sizeof( minidump_memory_descriptor ), descriptor ) )
+                            return false;
+
+                        if ( ( uint64_t )descriptor.rva + descriptor.data_size <= dump->size() )
+                            add_range( ( remote_ea_t )descriptor.start_of_memory_range, descriptor.data_size, descriptor.rva );
+                    }
+                    break;
+                }
+                case memory64_list_stream:
+                {
+                    // The bytes of all ranges are stored back to back, starting at base_rva.
+                    //
+                    uint64_t count, base_rva;
+                    if ( !load( *dump, directory.rva, count ) || !load( *dump, directory.rva + 8ull, base_rva ) )
+                        return false;
+
+                    uint64_t file_offset = base_rva;
+                    for ( uint64_t j = 0; j < count; j++ )
+                    {
+                        minidump_memory_descriptor64 descriptor;
+                        if ( !load( *dump, directory.rva + 16ull + j * sizeof( minidump_memory_descriptor64 ), descriptor ) )
+                            return false;
+
+                        if ( file_offset + descriptor.data_size > dump->size() )
+                            break;
+
+                        add_range( ( remote_ea_t )descriptor.start_of_memory_range, ( size_t )descriptor.data_size, file_offset );
+                        file_offset += descriptor.data_size;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        return !modules.empty();
+    }
+
+    // Finds the range fully containing [ea, ea + size), or nullptr if it spans a range boundary or was not captured.
+    //
+    const std::pair<const remote_ea_t, minidump_memory_source::memory_range>* minidump_memory_source::find( remote_ea_t ea, size_t size ) const
+    {
+        auto it = ranges.upper_bound( ea );
+        if ( it == ranges.begin() )
+            return nullptr;
+        it--;
+
+        if ( ea - it->first + size > it->second.size )
+            return nullptr;
+
+        return &*it;
+    }
+
+    // Reads size bytes at the given effective address, returning false if any of them were not captured.
+    //
+    bool minidump_memory_source::read( remote_ea_t ea, void* buffer, size_t size )
+    {
+        // The read may span several ranges which are adjacent in memory, but not in the dump.
+        //
+        uint8_t* out = ( uint8_t* )buffer;
+        while ( size != 0 )
+        {
+            auto it = ranges.upper_bound( ea );
+            if ( it == ranges.begin() )
+                return false;
+            it--;
+
+            uint64_t offset = ea - it->first;
+            if ( offset >= it->second.size )
+                return false;
+
+            size_t chunk = std::min<size_t>( size, it->second.size - offset );
+            memcpy( out, dump->data() + it->second.file_offset + offset, chunk );
+
+            out += chunk;
+            ea += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+
+    // Returns a copy-on-write view of [ea, ea + size), mapping only the part of the dump backing it.
+    //
+    std::shared_ptr<uint8_t> minidump_memory_source::map( remote_ea_t ea, size_t size )
+    {
+        auto range = find( ea, size );
+        if ( !range )
+            return nullptr;
+
+        std::shared_ptr<mapped_file> view = mapped_file::open( dump_path, map_mode::copy_on_write, range->second.file_offset + ( ea - range->first ), size );
+        if ( !view )
+            return nullptr;
+
+        // Alias the mapping, keeping it alive for as long as the view is.
+        //
+        return std::shared_ptr<uint8_t>( view, view->data() );
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include "memory_source.hpp"
+#include "mapped_file.hpp"
+
+namespace vmpdump
+{
+    // A full-memory minidump of a process. The dump is mapped read-only and parsed in place: the module list comes
+    // from the ModuleListStream, and memory is served straight out of the ranges of the Memory64ListStream or
+    // MemoryListStream. Views handed out by map are separate copy-on-write mappings of the dump, so opening a module
+    // copies nothing, however large the dump is.
+    //
+    class minidump_memory_source : public memory_source
+    {
+    private:
+        // A captured range of memory, and where its bytes lie in the dump.
+        //
+        struct memory_range
+        {
+            size_t size;
+            uint64_t file_offset;
+        };
+
+        // The path of the dump, and its read-only mapping.
+        //
+        std::string dump_path;
+        std::shared_ptr<mapped_file> dump;
+
+        // The captured memory ranges, by start address. Ranges which are adjacent both in memory and in the dump are merged.
+        //
+        std::map<remote_ea_t, memory_range> ranges;
+
+        // The modules, and the full path of the process image.
+        //
+        module_list_t modules;
+        std::string image_path;
+
+        // Parses the dump's streams, returning false if it is malformed.
+        //
+        bool parse();
+
+        // Adds a captured memory range, merging it with the previous one if possible.
+        //
+        void add_range( remote_ea_t start, size_t size, uint64_t file_offset );
+
+        // Finds the range fully containing [ea, ea + size), or nullptr if it spans a range boundary or was not captured.
+        //
+        const std::pair<const remote_ea_t, memory_range>* find( remote_ea_t ea, size_t size ) const;
+
+    public:
+        // Opens the minidump at the given path, returning nullptr if it is not a valid minidump.
+        //
+        static std::shared_ptr<minidump_memory_source> open( const std::string& path );
+
+        bool read( remote_ea_t ea, void* buffer, size_t size ) override;
+        std::shared_ptr<uint8_t> map( remote_ea_t ea, size_t size ) override;
+        module_list_t get_modules() override { return modules; }
+        std::string get_image_path() override { return image_path; }
+    };
+}
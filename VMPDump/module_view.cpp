@@ -1,72 +1,171 @@
 #include "module_view.hpp"
-#include <windows.h>
+#include <algorithm>
+#include <cstring>
 
 namespace vmpdump
 {
-    // Commits any local module changes back to the target process.
+    // Marks [rva, rva + size) of the local module as patched, fetching its pages if they were not already.
+    // Returns false if the range is out of bounds or unreadable.
     //
-    bool module_view::commit() const
+    bool module_view::mark_dirty( uint64_t rva, size_t size )
     {
-        bool result = false;
+        if ( size == 0 )
+            return true;
+        if ( rva > module_size || size > module_size - rva )
+            return false;
 
-        // Try to open the process.
+        // Patched pages are carried whole by patch files, so the rest of each page must hold the remote bytes.
         //
-        HANDLE process_handle = OpenProcess( PROCESS_VM_WRITE | PROCESS_VM_OPERATION, FALSE, process_id );
-        if ( !process_handle )
+        uint64_t first = rva / page_cache::page_size;
+        uint64_t last = ( rva + size - 1 ) / page_cache::page_size;
+        uint64_t end = std::min<uint64_t>( ( last + 1 ) * page_cache::page_size, module_size );
+        if ( !ensure( first * page_cache::page_size, end - first * page_cache::page_size ) )
             return false;
 
-        // Get RWX permissions.
-        //
-        DWORD new_protect = PAGE_EXECUTE_READWRITE;
-        DWORD old_protect;
-        if ( !VirtualProtectEx( process_handle, ( LPVOID )module_base, module_size, new_protect, &old_protect ) )
-            goto cleanup;
+        if ( dirty_pages.empty() )
+            dirty_pages.assign( ( module_size + page_cache::page_size - 1 ) / page_cache::page_size, false );
+
+        for ( uint64_t i = first; i <= last; i++ )
+            dirty_pages[ i ] = true;
+
+        // Merge the range with any it overlaps or touches.
+        //
+        uint64_t begin = rva;
+        end = rva + size;
+        auto it = patched_ranges.upper_bound( begin );
+        if ( it != patched_ranges.begin() && std::prev( it )->second >= begin )
+            it--;
+        while ( it != patched_ranges.end() && it->first <= end )
+        {
+            begin = std::min( begin, it->first );
+            end = std::max( end, it->second );
+            it = patched_ranges.erase( it );
+        }
+        patched_ranges.insert( { begin, end } );
+        return true;
+    }
 
-        // Write the memory.
-        //
-        SIZE_T num_written;
-        if ( WriteProcessMemory( process_handle, ( LPVOID )module_base, local_module.cdata(), local_module.size(), &num_written ) && num_written == module_size )
-            result = true;
+    // Copies the given bytes to rva in the local module, marking them as patched.
+    //
+    bool module_view::patch( uint64_t rva, const void* bytes, size_t size )
+    {
+        if ( !mark_dirty( rva, size ) )
+            return false;
 
-        // Restore old memory permissions.
-        //
-        if ( !VirtualProtectEx( process_handle, ( LPVOID )module_base, module_size, old_protect, &new_protect ) )
-            result = false;
+        memcpy( local_module.data() + rva, bytes, size );
+        return true;
+    }
 
-        // On function exit, close the handle.
-        //
-    cleanup:
-        CloseHandle( process_handle );
+    // Returns the patched ranges as { rva, size }, with adjacent patches coalesced.
+    //
+    std::vector<std::pair<uint64_t, size_t>> module_view::get_dirty_ranges() const
+    {
+        std::vector<std::pair<uint64_t, size_t>> result;
+        for ( auto& [begin, end] : patched_ranges )
+            result.push_back( { begin, end - begin } );
+        return result;
+    }
+
+    // Commits the patched bytes of the local module back to the source, one write per range of adjacent patches.
+    // Only the patched bytes are written, as the rest of their pages may have been changed remotely since they were fetched.
+    //
+    bool module_view::commit()
+    {
+        bool result = true;
+        for ( auto it = patched_ranges.begin(); it != patched_ranges.end(); )
+        {
+            if ( !source->write( module_base + it->first, local_module.cdata() + it->first, it->second - it->first ) )
+            {
+                result = false;
+                it++;
+                continue;
+            }
+
+            // The range is in sync again.
+            //
+            it = patched_ranges.erase( it );
+        }
+
+        // Only the pages holding a patch which failed are still dirty.
+        //
+        std::fill( dirty_pages.begin(), dirty_pages.end(), false );
+        for ( auto& [begin, end] : patched_ranges )
+        {
+            for ( uint64_t i = begin / page_cache::page_size; i <= ( end - 1 ) / page_cache::page_size; i++ )
+                dirty_pages[ i ] = true;
+        }
         return result;
     }
 
     // Fetches any remote module changes back to the local module buffer.
+    // If the source can map the module, the local module aliases a copy-on-write view of it instead of a copy.
+    // Otherwise, if lazy is set only the headers are fetched, and the rest of the module is fetched page by page
+    // as it is ensured. Unreadable pages are zero-filled, and only fail the fetch if they hold the headers.
     //
-    bool module_view::fetch()
+    bool module_view::fetch( bool lazy )
     {
-        bool result = false;
+        using namespace win;
 
-        // Try to open the process.
-        //
-        HANDLE process_handle = OpenProcess( PROCESS_ALL_ACCESS, FALSE, process_id );
-        if ( !process_handle )
-            return false;
+        dirty_pages.clear();
+        patched_ranges.clear();
 
-        // Resize the local module in case it's not allocated yet.
-        //
-        local_module.raw_bytes.resize( module_size );
+        if ( std::shared_ptr<uint8_t> mapping = source->map( module_base, module_size ) )
+        {
+            pages = nullptr;
+            local_module = pe_image( std::move( mapping ), module_size );
+            return true;
+        }
 
-        // Read the memory.
+        // Create the page cache, and alias the local module to its bytes.
         //
-        SIZE_T num_written;
-        if ( ReadProcessMemory( process_handle, ( LPVOID )module_base, local_module.data(), local_module.size(), &num_written ) && num_written == local_module.size() )
-            result = true;
+        pages = std::make_shared<page_cache>( source, module_base, module_size );
+        local_module = pe_image( std::shared_ptr<uint8_t>( pages, pages->data() ), module_size );
 
-        // On function exit, close the handle.
+        // Fetch the headers, which start within the first page but may extend past it.
         //
-    cleanup:
-        CloseHandle( process_handle );
-        return result;
+        if ( !ensure( 0, std::min<size_t>( page_cache::page_size, module_size ) ) )
+            return false;
+
+        if ( local_module.get_image()->get_dos_headers().e_lfanew + sizeof( nt_headers_t<true> ) > module_size )
+            return false;
+        if ( !ensure( 0, std::min<size_t>( local_module.get_image()->get_nt_headers()->optional_header.size_headers, module_size ) ) )
+            return false;
+
+        if ( !lazy )
+            ensure( 0, module_size );
+        return true;
+    }
+
+    // Ensures the bytes of [rva, rva + size) in the local module are fetched.
+    // Returns true if the range is within bounds and fully readable.
+    //
+    bool module_view::ensure( uint64_t rva, size_t size )
+    {
+        if ( !pages )
+            return rva <= module_size && size <= module_size - rva;
+        return pages->ensure( rva, size );
+    }
+
+    // Ensures the section containing rva is fetched, or just the page containing it if it is in no section.
+    //
+    bool module_view::ensure_section( uint64_t rva )
+    {
+        if ( !pages )
+            return rva < module_size;
+
+        if ( auto section = local_module.get_image()->rva_to_section( ( uint32_t )rva ) )
+            ensure( section->virtual_address, std::min<size_t>( section->virtual_size, module_size - std::min<size_t>( section->virtual_address, module_size ) ) );
+
+        return ensure( rva & ~( page_cache::page_size - 1 ), std::min<size_t>( page_cache::page_size, module_size - ( rva & ~( page_cache::page_size - 1 ) ) ) );
+    }
+
+    // Returns the rvas of the pages which could not be read so far.
+    //
+    std::vector<uint64_t> module_view::unreadable_pages() const
+    {
+        if ( !pages )
+            return {};
+        return pages->unreadable_pages();
     }
 
     // Returns the export name (if available) and ordinal.
@@ -88,8 +187,18 @@ namespace vmpdump
         if ( !export_dir_header->present() )
             return {};
 
+        // Fetch the export directory, and the export tables.
+        //
+        if ( !ensure( export_dir_header->rva, sizeof( export_directory_t ) ) )
+            return {};
+
         auto export_dir = ( export_directory_t* )( local_module.data() + export_dir_header->rva );
 
+        if ( !ensure( export_dir->rva_functions, export_dir->num_functions * sizeof( uint32_t ) ) ||
+             !ensure( export_dir->rva_names, export_dir->num_names * sizeof( uint32_t ) ) ||
+             !ensure( export_dir->rva_name_ordinals, export_dir->num_names * sizeof( uint16_t ) ) )
+            return {};
+
         // Resolve effective addresses of each export table.
         //
         uint32_t* eat = ( uint32_t* )( local_module.data() + export_dir->rva_functions );
@@ -124,6 +233,11 @@ namespace vmpdump
         if ( name_ordinal == -1 )
             return { { { "" }, ordinal } };
 
+        // Fetch the function name, which is bounded by the longest name we expect.
+        //
+        if ( names[ name_ordinal ] >= module_size || !ensure( names[ name_ordinal ], std::min<size_t>( 0x200, module_size - names[ name_ordinal ] ) ) )
+            return {};
+
         // Return function name.
         //
         return { { std::string( ( const char* )( local_module.data() + names[ name_ordinal ] ) ), ordinal } };
@@ -1,18 +1,17 @@
 #pragma once
 #include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 #include <variant>
 #include <optional>
 #include <string>
 #include "pe_image.hpp"
+#include "memory_source.hpp"
+#include "page_cache.hpp"
 
 namespace vmpdump
 {
-    // A remote process effective address.
-    //
-    using remote_ea_t = uintptr_t;
-
     // Identifies an export within a module.
     //
     using export_id_t = std::pair<std::string, uint32_t>;
@@ -21,9 +20,9 @@ namespace vmpdump
     //
     struct module_view
     {
-        // The target process id.
+        // The address space the module is read from.
         //
-        const uint32_t process_id;
+        const std::shared_ptr<memory_source> source;
 
         // The name of the target module, or empty if not available.
         //
@@ -40,6 +39,20 @@ namespace vmpdump
         // The locally copied module.
         //
         pe_image local_module;
+
+        // If the module is fetched lazily, the page cache backing the local module.
+        // Only the bytes of ranges which were ensured are valid; the rest are zero.
+        //
+        std::shared_ptr<page_cache> pages;
+
+        // The pages of the local module holding patches which were not committed yet.
+        //
+        std::vector<bool> dirty_pages;
+
+        // The bytes of the local module which were patched since it was last fetched or committed, as { begin, end },
+        // with overlapping and adjacent ranges merged.
+        //
+        std::map<uint64_t, uint64_t> patched_ranges;
         
         // Determined whether the provided remote ea is within module bounds.
         //
@@ -48,30 +61,65 @@ namespace vmpdump
             return ea >= module_base && ea < module_base + module_size;
         }
 
-        // Commits any local module changes back to the target process.
+        // Marks [rva, rva + size) of the local module as patched, fetching its pages if they were not already.
+        // Returns false if the range is out of bounds or unreadable.
+        //
+        bool mark_dirty( uint64_t rva, size_t size );
+
+        // Copies the given bytes to rva in the local module, marking them as patched.
+        //
+        bool patch( uint64_t rva, const void* bytes, size_t size );
+
+        // Returns the patched ranges as { rva, size }, with adjacent patches coalesced.
+        //
+        std::vector<std::pair<uint64_t, size_t>> get_dirty_ranges() const;
+
+        // Commits the patched bytes of the local module back to the source, one write per range of adjacent patches.
+        // Only the patched bytes are written, as the rest of their pages may have been changed remotely since they were fetched.
         //
-        bool commit() const;
+        bool commit();
 
         // Fetches any remote module changes back to the local module buffer.
+        // If the source can map the module, the local module aliases a copy-on-write view of it instead of a copy.
+        // Otherwise, if lazy is set only the headers are fetched, and the rest of the module is fetched page by page
+        // as it is ensured. Unreadable pages are zero-filled, and only fail the fetch if they hold the headers.
         //
-        bool fetch();
+        bool fetch( bool lazy = false );
+
+        // Ensures the bytes of [rva, rva + size) in the local module are fetched.
+        // Returns true if the range is within bounds and fully readable.
+        //
+        bool ensure( uint64_t rva, size_t size );
+
+        // Ensures the section containing rva is fetched, or just the page containing it if it is in no section.
+        //
+        bool ensure_section( uint64_t rva );
+
+        // Returns the rvas of the pages which could not be read so far.
+        //
+        std::vector<uint64_t> unreadable_pages() const;
 
         // Returns the export name (if available) and ordinal.
         //
         std::optional<export_id_t> get_export( remote_ea_t ea );
 
-        // Constructor, automatically fetching the remote module's bytes.
+        // Constructor, automatically fetching the remote module's bytes, or only its headers if lazy is set.
         //
-        module_view( uint32_t process_id, const std::string& module_name, remote_ea_t module_base, size_t module_size )
-            : process_id( process_id ), module_name( module_name ), module_base( module_base ), module_size( module_size )
+        module_view( std::shared_ptr<memory_source> source, const std::string& module_name, remote_ea_t module_base, size_t module_size, bool lazy = false )
+            : source( std::move( source ) ), module_name( module_name ), module_base( module_base ), module_size( module_size )
         {
-            fetch();
+            fetch( lazy );
         }
 
         // Constructor.
         //
-        module_view( uint32_t process_id, const std::string& module_name, remote_ea_t module_base, size_t module_size, const pe_image& local_module )
-            : process_id( process_id ), module_name( module_name ), module_base( module_base ), module_size( module_size ), local_module( local_module )
+        module_view( std::shared_ptr<memory_source> source, const std::string& module_name, remote_ea_t module_base, size_t module_size, const pe_image& local_module )
+            : source( std::move( source ) ), module_name( module_name ), module_base( module_base ), module_size( module_size ), local_module( local_module )
         {}
+
+        // Views can only be moved, as a copy of the local module would not be kept in sync with the page cache.
+        //
+        module_view( const module_view& ) = delete;
+        module_view( module_view&& ) = default;
     };
 }
\ No newline at end of file
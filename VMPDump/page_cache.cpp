@@ -0,0 +1,112 @@
+#include "page_cache.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace vmpdump
+{
+    page_cache::page_cache( std::shared_ptr<memory_source> source, remote_ea_t base, size_t length )
+        : source( std::move( source ) ), base( base ), length( length ),
+          bytes( ( uint8_t* )calloc( std::max<size_t>( length, 1 ), 1 ), &free ),
+          states( new std::atomic<page_state>[ ( length + page_size - 1 ) / page_size ] ),
+          page_count( ( length + page_size - 1 ) / page_size )
+    {
+        for ( size_t i = 0; i < page_count; i++ )
+            states[ i ].store( page_state::absent, std::memory_order_relaxed );
+    }
+
+    // Fetches [first, first + count) pages, splitting the read up on failure.
+    //
+    void page_cache::fetch( size_t first, size_t count )
+    {
+        uint64_t offset = first * page_size;
+        size_t size = std::min<size_t>( count * page_size, length - offset );
+
+        reads++;
+        if ( source->read( base + offset, bytes.get() + offset, size ) )
+        {
+            fetched_pages += count;
+            for ( size_t i = first; i < first + count; i++ )
+                states[ i ].store( page_state::present, std::memory_order_release );
+            return;
+        }
+
+        // A failed read may have partially written the buffer, so restore the zeroes.
+        //
+        memset( bytes.get() + offset, 0, size );
+
+        if ( count == 1 )
+        {
+            states[ first ].store( page_state::unreadable, std::memory_order_release );
+            return;
+        }
+
+        // Split the read in halves, to isolate the unreadable pages.
+        //
+        fetch( first, count / 2 );
+        fetch( first + count / 2, count - count / 2 );
+    }
+
+    // Fetches any absent pages overlapping [offset, offset + size).
+    // Returns true if the range is within bounds and all of its pages are readable.
+    //
+    bool page_cache::ensure( uint64_t offset, size_t size )
+    {
+        if ( offset > length || size > length - offset )
+            return false;
+        if ( size == 0 )
+            return true;
+
+        size_t first = offset / page_size;
+        size_t last = ( offset + size - 1 ) / page_size;
+
+        // Fast path, if every page was already fetched.
+        //
+        bool readable = true;
+        bool complete = true;
+        for ( size_t i = first; i <= last; i++ )
+        {
+            page_state state = states[ i ].load( std::memory_order_acquire );
+            readable &= state == page_state::present;
+            complete &= state != page_state::absent;
+        }
+        if ( complete )
+            return readable;
+
+        std::lock_guard _g( fetch_lock );
+
+        // Fetch every run of absent pages, extending each run past the range up to the batch size.
+        //
+        for ( size_t i = first; i <= last; )
+        {
+            if ( states[ i ].load( std::memory_order_relaxed ) != page_state::absent )
+            {
+                i++;
+                continue;
+            }
+
+            size_t end = i + 1;
+            while ( end < page_count && ( end <= last || end - i < batch_pages ) && states[ end ].load( std::memory_order_relaxed ) == page_state::absent )
+                end++;
+
+            fetch( i, end - i );
+            i = end;
+        }
+
+        for ( size_t i = first; i <= last; i++ )
+            if ( states[ i ].load( std::memory_order_relaxed ) != page_state::present )
+                return false;
+        return true;
+    }
+
+    // Returns the offsets of the pages which could not be read so far.
+    //
+    std::vector<uint64_t> page_cache::unreadable_pages() const
+    {
+        std::vector<uint64_t> result;
+        for ( size_t i = 0; i < page_count; i++ )
+            if ( states[ i ].load( std::memory_order_acquire ) == page_state::unreadable )
+                result.push_back( i * page_size );
+        return result;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "memory_source.hpp"
+
+namespace vmpdump
+{
+    // The state of a single page in a page cache.
+    //
+    enum class page_state : uint8_t
+    {
+        // Not yet fetched; the local bytes are zero.
+        //
+        absent,
+
+        // Fetched from the source.
+        //
+        present,
+
+        // The source failed to read the page; the local bytes are zero.
+        //
+        unreadable,
+    };
+
+    // A local copy of a remote range, fetched from its source page by page on demand.
+    // Missing pages are fetched in large batched reads. If a batch fails, it is split up until the unreadable pages are
+    // isolated, which are recorded and left zero-filled rather than failing the whole range.
+    // Ensuring a range is thread-safe, and cheap once its pages were fetched.
+    //
+    class page_cache
+    {
+    public:
+        static constexpr size_t page_size = 0x1000;
+
+        // The minimum amount of pages fetched by a single read, if that many are absent.
+        //
+        static constexpr size_t batch_pages = 64;
+
+    private:
+        // The source, and the remote range.
+        //
+        std::shared_ptr<memory_source> source;
+        remote_ea_t base;
+        size_t length;
+
+        // The local bytes, allocated zeroed so that pages which are never fetched are never touched either.
+        //
+        std::unique_ptr<uint8_t, void( * )( void* )> bytes;
+
+        // The state of each page.
+        //
+        std::unique_ptr<std::atomic<page_state>[]> states;
+        size_t page_count;
+
+        // Serializes fetches.
+        //
+        std::mutex fetch_lock;
+
+        // Statistics.
+        //
+        std::atomic<uint64_t> reads = { 0 };
+        std::atomic<uint64_t> fetched_pages = { 0 };
+
+        // Fetches [first, first + count) pages, splitting the read up on failure.
+        //
+        void fetch( size_t first, size_t count );
+
+    public:
+        page_cache( std::shared_ptr<memory_source> source, remote_ea_t base, size_t length );
+
+        // Cannot be copied or moved, as views alias the local bytes.
+        //
+        page_cache( const page_cache& ) = delete;
+        page_cache& operator=( const page_cache& ) = delete;
+
+        // Fetches any absent pages overlapping [offset, offset + size).
+        // Returns true if the range is within bounds and all of its pages are readable.
+        //
+        bool ensure( uint64_t offset, size_t size );
+
+        // Returns the offsets of the pages which could not be read so far.
+        //
+        std::vector<uint64_t> unreadable_pages() const;
+
+        // Returns the state of the page containing offset.
+        //
+        inline page_state get_state( uint64_t offset ) const { return states[ offset / page_size ].load( std::memory_order_acquire ); }
+
+        inline uint8_t* data() const { return bytes.get(); }
+        inline size_t size() const { return length; }
+
+        inline uint64_t read_count() const { return reads.load(); }
+        inline uint64_t fetched_page_count() const { return fetched_pages.load(); }
+    };
+}
@@ -0,0 +1,202 @@
+#include "patch_file.hpp"
+#include "mapped_file.hpp"
+#include <cstring>
+#include <filesystem>
+
+namespace vmpdump
+{
+    namespace patch_file
+    {
+        using namespace patch_file_format;
+
+        // FNV-1a, over the bytes copied from the virtual image.
+        //
+        static constexpr uint64_t fnv_offset_basis = 0xCBF29CE484222325;
+        static constexpr uint64_t fnv_prime = 0x100000001B3;
+
+        static uint64_t fnv1a( uint64_t hash, const uint8_t* bytes, size_t size )
+        {
+            for ( size_t i = 0; i < size; i++ )
+                hash = ( hash ^ bytes[ i ] ) * fnv_prime;
+            return hash;
+        }
+
+        // An op to be written, along with the bytes of a literal.
+        //
+        struct planned_op
+        {
+            op header;
+            const uint8_t* bytes;
+        };
+
+        // Writes a patch file rebuilding the planned raw image of base's local module, holding the raw headers and the new section
+        // given. Sections are copied from the virtual image as fetched, except for the pages of base which were patched.
+        // Returns the size of the patch file, or nullopt on failure.
+        //
+        std::optional<size_t> write( const std::string& path, module_view& base, const pe_constructor::raw_layout& layout,
+                                     const std::vector<uint8_t>& raw_headers, const std::vector<uint8_t>& new_section )
+        {
+            const uint8_t* virtual_bytes = base.local_module.cdata();
+            win::nt_headers_x64_t* nt = base.local_module.get_image()->get_nt_headers();
+
+            std::vector<planned_op> ops;
+            uint64_t base_hash = fnv_offset_basis;
+
+            // Literals skip their trailing zeros, which the rebuilt dump starts out as.
+            //
+            auto add_literal = [ & ] ( uint64_t offset, const uint8_t* bytes, size_t size )
+            {
+                size = pe_constructor::trim_zero_tail( bytes, size );
+                if ( size )
+                    ops.push_back( { { op_literal, 0, offset, size, 0 }, bytes } );
+            };
+            auto is_dirty = [ & ] ( uint64_t rva )
+            {
+                uint64_t page = rva / page_cache::page_size;
+                return page < base.dirty_pages.size() && base.dirty_pages[ page ];
+            };
+
+            add_literal( 0, raw_headers.data(), raw_headers.size() );
+
+            // Copy the pages of each section as fetched, and carry the patched ones as literals.
+            //
+            for ( int i = 0; i < nt->file_header.num_sections; i++ )
+            {
+                const pe_constructor::section_placement& placement = layout.sections[ i ];
+                uint64_t rva = nt->get_section( i )->virtual_address;
+                uint64_t end = rva + placement.data_size;
+                uint64_t offset = placement.ptr_raw_data;
+
+                while ( rva < end )
+                {
+                    // Extend the run over every following page of the same kind.
+                    //
+                    bool dirty = is_dirty( rva );
+                    uint64_t run_end = std::min( ( rva / page_cache::page_size + 1 ) * page_cache::page_size, end );
+                    while ( run_end < end && is_dirty( run_end ) == dirty )
+                        run_end = std::min( run_end + page_cache::page_size, end );
+
+                    if ( dirty )
+                    {
+                        add_literal( offset, virtual_bytes + rva, run_end - rva );
+                    }
+                    else
+                    {
+                        ops.push_back( { { op_copy, 0, offset, run_end - rva, rva }, nullptr } );
+                        base_hash = fnv1a( base_hash, virtual_bytes + rva, run_end - rva );
+                    }
+
+                    offset += run_end - rva;
+                    rva = run_end;
+                }
+            }
+
+            add_literal( layout.new_section.ptr_raw_data, new_section.data(), new_section.size() );
+
+            // Size the patch file exactly, and write it in place.
+            //
+            size_t file_size = sizeof( header );
+            for ( const planned_op& op : ops )
+                file_size += sizeof( op.header ) + ( op.header.kind == op_literal ? op.header.size : 0 );
+
+            std::shared_ptr<mapped_file> file = mapped_file::create( path, file_size );
+            if ( !file )
+                return {};
+
+            header file_header = { magic, version, base.module_size, base_hash, layout.file_size, ops.size() };
+            uint8_t* output = file->data();
+            memcpy( output, &file_header, sizeof( file_header ) );
+            output += sizeof( file_header );
+
+            for ( const planned_op& op : ops )
+            {
+                memcpy( output, &op.header, sizeof( op.header ) );
+                output += sizeof( op.header );
+
+                if ( op.header.kind == op_literal )
+                {
+                    memcpy( output, op.bytes, op.header.size );
+                    output += op.header.size;
+                }
+            }
+
+            return file_size;
+        }
+
+        // Rebuilds the dump at output_path from the patch file at path, and the freshly fetched virtual image base.
+        // Fails if the patch is invalid, or was made from a different virtual image.
+        //
+        bool apply( const std::string& path, module_view& base, const std::string& output_path )
+        {
+            std::shared_ptr<mapped_file> file = mapped_file::open( path );
+            if ( !file || file->size() < sizeof( header ) )
+                return false;
+
+            header file_header;
+            memcpy( &file_header, file->data(), sizeof( file_header ) );
+            if ( file_header.magic != magic || file_header.version != version || file_header.base_size != base.module_size )
+                return false;
+
+            std::shared_ptr<mapped_file> output = mapped_file::create( output_path, file_header.file_size );
+            if ( !output )
+                return false;
+
+            // Apply every op, streaming the copied sections from the virtual image as they are fetched.
+            // Unreadable pages are zero-filled as they were when the patch was made, and are covered by the hash.
+            //
+            auto apply_ops = [ & ] ()
+            {
+                const uint8_t* it = file->data() + sizeof( file_header );
+                const uint8_t* end = file->data() + file->size();
+                uint64_t base_hash = fnv_offset_basis;
+
+                for ( uint64_t i = 0; i < file_header.op_count; i++ )
+                {
+                    op current;
+                    if ( ( size_t )( end - it ) < sizeof( current ) )
+                        return false;
+                    memcpy( &current, it, sizeof( current ) );
+                    it += sizeof( current );
+
+                    if ( current.offset > file_header.file_size || current.size > file_header.file_size - current.offset )
+                        return false;
+
+                    if ( current.kind == op_literal )
+                    {
+                        if ( ( size_t )( end - it ) < current.size )
+                            return false;
+
+                        memcpy( output->data() + current.offset, it, current.size );
+                        it += current.size;
+                    }
+                    else if ( current.kind == op_copy )
+                    {
+                        if ( current.rva > base.module_size || current.size > base.module_size - current.rva )
+                            return false;
+
+                        base.ensure( current.rva, current.size );
+                        const uint8_t* bytes = base.local_module.cdata() + current.rva;
+                        memcpy( output->data() + current.offset, bytes, current.size );
+                        base_hash = fnv1a( base_hash, bytes, current.size );
+                    }
+                    else
+                    {
+                        return false;
+                    }
+                }
+
+                return base_hash == file_header.base_hash;
+            };
+
+            if ( apply_ops() )
+                return true;
+
+            // Do not leave a corrupt dump behind.
+            //
+            output.reset();
+            std::error_code ec;
+            std::filesystem::remove( output_path, ec );
+            return false;
+        }
+    }
+}
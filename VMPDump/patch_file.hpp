@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "module_view.hpp"
+#include "pe_constructor.hpp"
+
+namespace vmpdump
+{
+    // The on-disk layout of a patch file, which rebuilds a dump from the virtual image it was made from.
+    // All offsets are into the rebuilt dump. Ops are packed back to back, each literal followed by its bytes.
+    // Ranges of the dump no op covers are zero.
+    //
+    //      header
+    //      op, [ bytes ], ... header.op_count times
+    //
+    namespace patch_file_format
+    {
+        // 'VPAT'.
+        //
+        static constexpr uint32_t magic = 0x54415056;
+        static constexpr uint32_t version = 1;
+
+        struct header
+        {
+            uint32_t magic;
+            uint32_t version;
+
+            // The size of the virtual image the patch applies to, and the FNV-1a hash of the bytes copied from it, in op order.
+            //
+            uint64_t base_size;
+            uint64_t base_hash;
+
+            // The size of the rebuilt dump.
+            //
+            uint64_t file_size;
+            uint64_t op_count;
+        };
+
+        enum op_kind : uint32_t
+        {
+            // Copies size bytes from rva in the virtual image to offset.
+            //
+            op_copy,
+
+            // Writes the size bytes following the op to offset.
+            //
+            op_literal,
+        };
+
+        struct op
+        {
+            op_kind kind;
+            uint32_t reserved;
+            uint64_t offset;
+            uint64_t size;
+            uint64_t rva;
+        };
+    }
+
+    namespace patch_file
+    {
+        // Writes a patch file rebuilding the planned raw image of base's local module, holding the raw headers and the new section
+        // given. Sections are copied from the virtual image as fetched, except for the pages of base which were patched.
+        // Returns the size of the patch file, or nullopt on failure.
+        //
+        std::optional<size_t> write( const std::string& path, module_view& base, const pe_constructor::raw_layout& layout,
+                                     const std::vector<uint8_t>& raw_headers, const std::vector<uint8_t>& new_section );
+
+        // Rebuilds the dump at output_path from the patch file at path, and the freshly fetched virtual image base.
+        // Fails if the patch is invalid, or was made from a different virtual image.
+        //
+        bool apply( const std::string& path, module_view& base, const std::string& output_path );
+    }
+}
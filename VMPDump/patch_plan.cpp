@@ -0,0 +1,100 @@
+#include "patch_plan.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace vmpdump
+{
+    // Returns the rva of the edit in the plan overlapping [rva, rva + size), if any.
+    // Must be called with the lock held.
+    //
+    static std::optional<uint64_t> find_overlap_locked( const std::map<uint64_t, call_patch>& edits, uint64_t rva, size_t size )
+    {
+        // The first edit starting at or after rva overlaps if it starts before the end of the range...
+        //
+        auto next = edits.lower_bound( rva );
+        if ( next != edits.end() && next->first < rva + size )
+            return next->first;
+
+        // ...and the last edit starting before rva overlaps if it ends after rva.
+        //
+        if ( next != edits.begin() )
+        {
+            auto previous = std::prev( next );
+            if ( previous->first + previous->second.bytes.size() > rva )
+                return previous->first;
+        }
+
+        return {};
+    }
+
+    // Returns the rva of the edit in the plan overlapping [rva, rva + size), if any.
+    //
+    std::optional<uint64_t> patch_plan::find_overlap( uint64_t rva, size_t size ) const
+    {
+        std::lock_guard _g( lock );
+        return find_overlap_locked( edits, rva, size );
+    }
+
+    // Adds the edit to the plan, unless it overlaps another, in which case it is recorded as a conflict and false is returned.
+    //
+    bool patch_plan::add( call_patch edit )
+    {
+        std::lock_guard _g( lock );
+
+        if ( std::optional<uint64_t> overlapped_rva = find_overlap_locked( edits, edit.rva, edit.bytes.size() ) )
+        {
+            conflicts.push_back( { std::move( edit ), *overlapped_rva } );
+            return false;
+        }
+
+        uint64_t rva = edit.rva;
+        edits.emplace( rva, std::move( edit ) );
+        return true;
+    }
+
+    // Applies every edit to the module, splitting them across the given number of workers, or the hardware concurrency
+    // if zero. The pages edited are marked as patched, so that they can be committed. Returns the number of edits applied.
+    //
+    size_t patch_plan::apply( module_view& view, size_t worker_count ) const
+    {
+        std::lock_guard _g( lock );
+
+        // Mark the pages first, which also fetches them. This is done serially, as the dirty page set is shared.
+        //
+        std::vector<const call_patch*> applied;
+        applied.reserve( edits.size() );
+        for ( auto& [rva, edit] : edits )
+        {
+            if ( view.mark_dirty( rva, edit.bytes.size() ) )
+                applied.push_back( &edit );
+        }
+
+        uint8_t* bytes = view.local_module.data();
+        auto copy = [ & ] ( size_t begin, size_t end )
+        {
+            for ( size_t i = begin; i < end; i++ )
+                memcpy( bytes + applied[ i ]->rva, applied[ i ]->bytes.data(), applied[ i ]->bytes.size() );
+        };
+
+        if ( applied.size() < parallel_threshold )
+        {
+            copy( 0, applied.size() );
+            return applied.size();
+        }
+
+        // The edits do not overlap, so any split of them can be copied concurrently.
+        // They are split into contiguous runs, so that each worker writes to its own range of the module.
+        //
+        work_stealing_pool pool( worker_count );
+        size_t run_size = ( applied.size() + pool.size() - 1 ) / pool.size();
+        for ( size_t begin = 0; begin < applied.size(); begin += run_size )
+        {
+            size_t end = std::min( begin + run_size, applied.size() );
+            pool.push( [ &copy, begin, end ] () { copy( begin, end ); } );
+        }
+        pool.run();
+
+        return applied.size();
+    }
+}
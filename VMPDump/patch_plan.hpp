@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "imports.hpp"
+#include "module_view.hpp"
+
+namespace vmpdump
+{
+    // A set of edits to a module, checked against each other for overlaps as they are added, and applied in a single pass.
+    // Edits are kept in an interval index keyed by their rva; as no two edits overlap, an overlap with a new edit can only be
+    // with its neighbours, which are found in O(log n).
+    //
+    class patch_plan
+    {
+    public:
+        // An edit rejected as it overlapped another.
+        //
+        struct conflict
+        {
+            call_patch rejected;
+            uint64_t overlapped_rva;
+        };
+
+        // The least number of edits applied across threads. Smaller plans are applied inline.
+        //
+        static constexpr size_t parallel_threshold = 1024;
+
+    private:
+        // Lock guarding the edits and conflicts, so that edits may be planned from several threads.
+        //
+        mutable std::mutex lock;
+
+        // Map of { rva, edit }.
+        //
+        std::map<uint64_t, call_patch> edits;
+
+        // The rejected edits.
+        //
+        std::vector<conflict> conflicts;
+
+    public:
+        // Returns the rva of the edit in the plan overlapping [rva, rva + size), if any.
+        //
+        std::optional<uint64_t> find_overlap( uint64_t rva, size_t size ) const;
+
+        // Adds the edit to the plan, unless it overlaps another, in which case it is recorded as a conflict and false is returned.
+        //
+        bool add( call_patch edit );
+
+        // Applies every edit to the module, splitting them across the given number of workers, or the hardware concurrency
+        // if zero. The pages edited are marked as patched, so that they can be committed. Returns the number of edits applied.
+        //
+        size_t apply( module_view& view, size_t worker_count = 0 ) const;
+
+        inline size_t size() const { std::lock_guard _g( lock ); return edits.size(); }
+        inline std::vector<conflict> get_conflicts() const { std::lock_guard _g( lock ); return conflicts; }
+    };
+}
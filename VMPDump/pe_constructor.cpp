@@ -1,69 +1,208 @@
 #include "pe_constructor.hpp"
 #include <algorithm>
+#include <bit>
 
 namespace vmpdump
 {
     namespace pe_constructor
     {
-        // Converts the given virtual image to a raw-byte image.
+        // Scalar implementation, also used for the heads of the vectorized implementations.
         //
-        pe_image virtual_to_raw_image( pe_image& virtual_image )
+        static size_t trim_zero_tail_scalar( const uint8_t* bytes, size_t size )
+        {
+            while ( size && !bytes[ size - 1 ] )
+                size--;
+            return size;
+        }
+
+        // SSE2 implementation, comparing 16 bytes at a time from the end.
+        //
+        static size_t trim_zero_tail_sse2( const uint8_t* bytes, size_t size )
+        {
+            const __m128i zero = _mm_setzero_si128();
+
+            for ( ; size >= 16; size -= 16 )
+            {
+                __m128i chunk = _mm_loadu_si128( ( const __m128i* )( bytes + size - 16 ) );
+                uint32_t nonzero = ~( uint32_t )_mm_movemask_epi8( _mm_cmpeq_epi8( chunk, zero ) ) & 0xFFFF;
+                if ( nonzero )
+                    return size - 16 + ( 32 - std::countl_zero( nonzero ) );
+            }
+
+            return trim_zero_tail_scalar( bytes, size );
+        }
+
+        // AVX2 implementation, comparing 32 bytes at a time from the end.
+        //
+        VMPDUMP_TARGET_AVX2 static size_t trim_zero_tail_avx2( const uint8_t* bytes, size_t size )
+        {
+            const __m256i zero = _mm256_setzero_si256();
+
+            for ( ; size >= 32; size -= 32 )
+            {
+                __m256i chunk = _mm256_loadu_si256( ( const __m256i* )( bytes + size - 32 ) );
+                uint32_t nonzero = ~( uint32_t )_mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, zero ) );
+                if ( nonzero )
+                    return size - 32 + ( 32 - std::countl_zero( nonzero ) );
+            }
+
+            return trim_zero_tail_scalar( bytes, size );
+        }
+
+        // Returns the size of the given bytes without their trailing zero bytes.
+        //
+        size_t trim_zero_tail( const uint8_t* bytes, size_t size, simd_level level )
+        {
+            switch ( level )
+            {
+                case simd_level::avx2:
+                    return trim_zero_tail_avx2( bytes, size );
+                case simd_level::sse2:
+                    return trim_zero_tail_sse2( bytes, size );
+                default:
+                    return trim_zero_tail_scalar( bytes, size );
+            }
+        }
+
+        // Plans the conversion of the given virtual image to a raw-byte image, with a new section of the given size appended.
+        // By default, each section is placed at its virtual address. If compact is set, sections are instead packed to the
+        // file alignment, and their trailing zero bytes are left virtual-only.
+        // Returns nullopt if the headers have no room left for another section header.
+        //
+        std::optional<raw_layout> plan_raw_image( pe_image& virtual_image, uint32_t section_size, uint32_t va, const std::string& name, win::section_characteristics_t characteristics, bool compact )
         {
             using namespace win;
 
-            std::vector<uint8_t>& virtual_raw_bytes = virtual_image.raw_bytes;
             image_x64_t* img = virtual_image.get_image();
             nt_headers_x64_t* nt = img->get_nt_headers();
 
-            std::vector<uint8_t> raw_bytes;
+            uint32_t file_alignment = nt->optional_header.file_alignment;
+            uint32_t section_alignment = nt->optional_header.section_alignment;
 
-            // Copy headers.
+            // Verify that we can fit in another section header.
             //
-            raw_bytes.insert( raw_bytes.end(), virtual_raw_bytes.begin(), virtual_raw_bytes.begin() + nt->optional_header.size_headers );
+            // TODO: increase header size and relocate the rest of the image instead!
+            //
+            if ( ( uint8_t* )nt->get_section( nt->file_header.num_sections + 1 ) - virtual_image.data() > nt->optional_header.size_headers )
+                return {};
 
-            uint32_t section_alignment = nt->optional_header.section_alignment;
+            raw_layout layout = {};
 
-            // Copy each section.
+            // The converted image holds the headers, and each section copied from its virtual address, bounded by the virtual image.
             // We are using virtual addressing here on purpose, as in packed VMP files the raw data is NULL.
             //
+            layout.image_size = nt->optional_header.size_headers;
+            if ( compact )
+                layout.image_size = ( layout.image_size + file_alignment - 1 ) & ~( file_alignment - 1 );
+
             for ( int i = 0; i < nt->file_header.num_sections; i++ )
             {
                 section_header_t* section = nt->get_section( i );
 
-                // Determine aligned section end.
-                //
-                uint32_t section_end = section->virtual_address + section->virtual_size;
-                uint32_t required_alignment = section_alignment - ( section_end % section_alignment );
+                uint32_t data_size = 0;
+                if ( section->virtual_address < virtual_image.size() )
+                    data_size = std::min<size_t>( section->virtual_size, virtual_image.size() - section->virtual_address );
 
-                // Resize vector if required.
+                // Either place the section at its virtual address, aligned...
                 //
-                if ( raw_bytes.size() < section_end + required_alignment )
-                    raw_bytes.resize( section_end + required_alignment );
-
-                // Copy section bytes.
+                if ( !compact )
+                {
+                    uint32_t section_end = section->virtual_address + section->virtual_size;
+                    uint32_t required_alignment = section_alignment - ( section_end % section_alignment );
+                    layout.image_size = std::max( layout.image_size, section_end + required_alignment );
+
+                    uint32_t required_size_alignment = section_alignment - ( section->virtual_size % section_alignment );
+                    layout.sections.push_back( { section->virtual_address, section->virtual_size + required_size_alignment, data_size } );
+                    continue;
+                }
+
+                // ...or pack it after the previous one, without its trailing zeros, which the loader fills in.
+                // A section that is all zeros takes no file space at all.
                 //
-                std::copy( virtual_raw_bytes.begin() + section->virtual_address, virtual_raw_bytes.begin() + section->virtual_address + section->virtual_size, raw_bytes.begin() + section->virtual_address );
+                data_size = trim_zero_tail( virtual_image.cdata() + section->virtual_address, data_size );
+                if ( !data_size )
+                {
+                    layout.sections.push_back( { 0, 0, 0 } );
+                    continue;
+                }
+
+                uint32_t size_raw_data = ( data_size + file_alignment - 1 ) & ~( file_alignment - 1 );
+                layout.sections.push_back( { layout.image_size, size_raw_data, data_size } );
+                layout.image_size += size_raw_data;
             }
-            
-            // Construct the raw image.
+
+            // Create the new section header, with the section appended after the image.
             //
-            pe_image raw_image = { raw_bytes };
-            image_x64_t* raw_img = raw_image.get_image();
-            nt_headers_x64_t* raw_nt = raw_img->get_nt_headers();
+            uint32_t required_raw_alignment = file_alignment - ( section_size % file_alignment );
+            uint32_t required_section_alignment = section_alignment - ( section_size % section_alignment );
+
+            memcpy( &layout.new_section.name, name.data(), name.size() >= LEN_SECTION_NAME ? LEN_SECTION_NAME - 1 : name.size() );
+            layout.new_section.virtual_size = section_size;
+            layout.new_section.virtual_address = va;
+            layout.new_section.size_raw_data = section_size + required_raw_alignment;
+            layout.new_section.ptr_raw_data = layout.image_size;
+            layout.new_section.characteristics = characteristics;
 
-            // Copy virtual addresses to raw addresses.
+            // Determine the new SizeOfImage, if required.
+            //
+            layout.size_image = nt->optional_header.size_image;
+            if ( layout.size_image < va + section_size )
+                layout.size_image = va + section_size + required_section_alignment;
+
+            layout.file_size = ( size_t )layout.image_size + layout.new_section.size_raw_data;
+            return layout;
+        }
+
+        // Writes the headers of the planned raw image into the output, which must be SizeOfHeaders bytes, and returns its NT headers.
+        //
+        win::nt_headers_x64_t* write_raw_headers( pe_image& virtual_image, const raw_layout& layout, uint8_t* output )
+        {
+            using namespace win;
+
+            // Copy headers.
+            //
+            memcpy( output, virtual_image.cdata(), virtual_image.get_image()->get_nt_headers()->optional_header.size_headers );
+
+            nt_headers_x64_t* raw_nt = ( ( image_x64_t* )output )->get_nt_headers();
+
+            // Point the section headers to their raw data.
             //
             for ( int i = 0; i < raw_nt->file_header.num_sections; i++ )
             {
                 section_header_t* section = raw_nt->get_section( i );
+                section->ptr_raw_data = layout.sections[ i ].ptr_raw_data;
+                section->size_raw_data = layout.sections[ i ].size_raw_data;
+            }
+
+            // Add the new section header.
+            //
+            *raw_nt->get_section( raw_nt->file_header.num_sections ) = layout.new_section;
+            raw_nt->file_header.num_sections++;
+            raw_nt->optional_header.size_image = layout.size_image;
 
-                uint32_t required_alignment = section_alignment - ( section->virtual_size % section_alignment );
+            return raw_nt;
+        }
+
+        // Writes the planned raw image into the output, which must be layout.file_size bytes and zeroed, and returns its NT headers.
+        // The contents of the new section are left to the caller, at output + layout.new_section.ptr_raw_data.
+        //
+        win::nt_headers_x64_t* write_raw_image( pe_image& virtual_image, const raw_layout& layout, uint8_t* output )
+        {
+            using namespace win;
 
-                section->ptr_raw_data = section->virtual_address;
-                section->size_raw_data = section->virtual_size + required_alignment;
+            const uint8_t* virtual_raw_bytes = virtual_image.cdata();
+            nt_headers_x64_t* nt = virtual_image.get_image()->get_nt_headers();
+
+            // Copy each section to its planned place.
+            //
+            for ( int i = 0; i < nt->file_header.num_sections; i++ )
+            {
+                section_header_t* section = nt->get_section( i );
+                const section_placement& placement = layout.sections[ i ];
+                memcpy( output + placement.ptr_raw_data, virtual_raw_bytes + section->virtual_address, placement.data_size );
             }
 
-            return raw_image;
+            return write_raw_headers( virtual_image, layout, output );
         }
 
         // Determines the RVA at which the last section of the virtual image provided ends.
@@ -93,53 +232,5 @@ namespace vmpdump
 
             return highest_section_end;
         }
-
-        // Adds the given section, denoted by the byte vector, to the raw pe_image.
-        //
-        pe_image& add_section( pe_image& raw_image, const std::vector<uint8_t>& section, uint32_t va, const std::string& name, win::section_characteristics_t characteristics )
-        {
-            using namespace win;
-
-            uint32_t file_alignment = raw_image.get_image()->get_nt_headers()->optional_header.file_alignment;
-            uint32_t section_alignment = raw_image.get_image()->get_nt_headers()->optional_header.section_alignment;
-            uint32_t required_raw_alignment = file_alignment - ( section.size() % file_alignment );
-            uint32_t required_section_alignment = section_alignment - ( section.size() % section_alignment );
-
-            // Create new section header.
-            //
-            section_header_t new_section = {};
-            memcpy( &new_section.name, name.data(), name.size() >= LEN_SECTION_NAME ? LEN_SECTION_NAME - 1 : name.size() );
-            new_section.virtual_size = section.size();
-            new_section.virtual_address = va;
-            new_section.size_raw_data = section.size() + required_raw_alignment;
-            new_section.ptr_raw_data = raw_image.size();
-            new_section.characteristics = characteristics;
-
-            // Add new section to raw buffer.
-            //
-            raw_image.raw_bytes.insert( raw_image.raw_bytes.end(), section.begin(), section.end() );
-            raw_image.raw_bytes.resize( raw_image.raw_bytes.size() + required_raw_alignment );
-
-            image_x64_t* img = raw_image.get_image();
-            nt_headers_x64_t* nt = img->get_nt_headers();
-
-            // Copy new section.
-            //
-            // TODO: verify that we can fit in another section in the headers, and if we can't, increase
-            // header size and relocate the rest of the image!
-            //
-            *nt->get_section( nt->file_header.num_sections ) = new_section;
-
-            // Increment number of sections.
-            //
-            nt->file_header.num_sections++;
-
-            // Write new SizeOfImage if required.
-            //
-            if ( nt->optional_header.size_image < new_section.virtual_address + new_section.virtual_size )
-                nt->optional_header.size_image = new_section.virtual_address + new_section.virtual_size + required_section_alignment;
-
-            return raw_image;
-        }
     }
-}
\ No newline at end of file
+}
@@ -1,56 +1,107 @@
 #pragma once
 #include <vector>
 #include <algorithm>
+#include <optional>
 #include <tuple>
 #include <string>
 #include "pe_image.hpp"
+#include "simd.hpp"
 
 namespace vmpdump
 {
     namespace pe_constructor
     {
-        // Serializes the given table, returning a tuple of { serialized table bytes, entry offsets, end rva }
+        // Lays the given table out without serializing it, returning a tuple of { entry offsets, end rva }
         //
         template <typename T>
-        std::tuple<std::vector<uint8_t>, std::vector<uint32_t>, uint32_t> serialize_table( const std::vector<T>& table_entries, uint64_t offset_base = 0 )
+        std::tuple<std::vector<uint32_t>, uint32_t> layout_table( const std::vector<T>& table_entries, uint64_t offset_base = 0 )
         {
-            // Result vectors.
-            //
-            std::vector<uint8_t> result_bytes;
             std::vector<uint32_t> result_offsets;
+            result_offsets.reserve( table_entries.size() );
 
-            // Enumerate each table entry.
+            // Enumerate each table entry, pushing back its offset.
             //
+            uint64_t offset = offset_base;
             for ( const T& entry : table_entries )
             {
-                // Push back current offset.
-                //
-                result_offsets.push_back( result_bytes.size() + offset_base );
+                result_offsets.push_back( offset );
+                offset += entry.size();
+            }
 
-                // Fetch a byte vector of the entry's data.
-                //
-                std::vector<uint8_t> entry_bytes = entry.get_bytes();
+            return { result_offsets, offset };
+        }
 
-                // Add entry bytes to byte vector.
-                //
-                result_bytes.insert( result_bytes.end(), entry_bytes.begin(), entry_bytes.end() );
+        // Writes the given table, as laid out by layout_table, to the output, which must be large enough to hold it.
+        //
+        template <typename T>
+        void write_table( const std::vector<T>& table_entries, uint8_t* output )
+        {
+            for ( const T& entry : table_entries )
+            {
+                entry.write( output );
+                output += entry.size();
             }
+        }
 
-            // Return the values.
+        // Returns the size of the given bytes without their trailing zero bytes.
+        //
+        size_t trim_zero_tail( const uint8_t* bytes, size_t size, simd_level level = host_simd_level() );
+
+        // Where a section of the converted image is placed in the file.
+        //
+        struct section_placement
+        {
+            uint32_t ptr_raw_data;
+            uint32_t size_raw_data;
+
+            // The number of bytes copied from the virtual image.
             //
-            return { result_bytes, result_offsets, result_bytes.size() + offset_base };
-        }
+            uint32_t data_size;
+        };
 
-        // Converts the given virtual image to a raw-byte image.
+        // The layout of the raw image converted from a virtual image, with one new section appended.
         //
-        pe_image virtual_to_raw_image( pe_image& virtual_image );
+        struct raw_layout
+        {
+            // The placement of each existing section, by index.
+            //
+            std::vector<section_placement> sections;
 
-        // Determines the RVA at which the last section of the virtual image provided ends.
+            // The size of the converted image, up to the new section.
+            //
+            uint32_t image_size;
+
+            // The header of the new section.
+            //
+            win::section_header_t new_section;
+
+            // The new SizeOfImage.
+            //
+            uint32_t size_image;
+
+            // The exact size of the output file.
+            //
+            size_t file_size;
+        };
+
+        // Plans the conversion of the given virtual image to a raw-byte image, with a new section of the given size appended.
+        // By default, each section is placed at its virtual address. If compact is set, sections are instead packed to the
+        // file alignment, and their trailing zero bytes are left virtual-only.
+        // Returns nullopt if the headers have no room left for another section header.
         //
-        uint32_t get_sections_end( pe_image& virtual_image );
+        std::optional<raw_layout> plan_raw_image( pe_image& virtual_image, uint32_t section_size, uint32_t va, const std::string& name, win::section_characteristics_t characteristics, bool compact = false );
+
+        // Writes the headers of the planned raw image into the output, which must be SizeOfHeaders bytes, and returns its NT headers.
+        //
+        win::nt_headers_x64_t* write_raw_headers( pe_image& virtual_image, const raw_layout& layout, uint8_t* output );
 
-        // Adds the given section, denoted by the byte vector, to the raw pe_image.
+        // Writes the planned raw image into the output, which must be layout.file_size bytes and zeroed, and returns its NT headers.
+        // The contents of the new section are left to the caller, at output + layout.new_section.ptr_raw_data.
         //
-        pe_image& add_section( pe_image& raw_image, const std::vector<uint8_t>& section, uint32_t va, const std::string& name, win::section_characteristics_t characteristics );
+        win::nt_headers_x64_t* write_raw_image( pe_image& virtual_image, const raw_layout& layout, uint8_t* output );
+
+        // Determines the RVA at which the last section of the virtual image provided ends.
+        //
+        uint32_t get_sections_end( pe_image& virtual_image );
     }
-}
\ No newline at end of file
+}
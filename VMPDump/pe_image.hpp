@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
+#include <memory>
+#include <cstring>
 #include "winpe/image.hpp"
 
 namespace vmpdump
@@ -13,17 +15,43 @@ namespace vmpdump
 		std::vector<uint8_t> raw_bytes;
 		pe_image( const std::vector<uint8_t>& raw_bytes = {} ) : raw_bytes( raw_bytes ) {}
 
-		// Default move/copy.
+		// Alternatively, the image can be backed by an external mapping, such as a copy-on-write view of a file,
+		// in which case raw_bytes is unused.
+		//
+		std::shared_ptr<uint8_t> mapped_bytes;
+		size_t mapped_size = 0;
+		pe_image( std::shared_ptr<uint8_t> mapped_bytes, size_t mapped_size ) : mapped_bytes( std::move( mapped_bytes ) ), mapped_size( mapped_size ) {}
+
+		// Default move.
 		//
 		pe_image( pe_image&& ) = default;
-		pe_image( const pe_image& ) = default;
 		pe_image& operator=( pe_image&& ) = default;
-		pe_image& operator=( const pe_image& ) = default;
 
-		inline uint8_t* data() { return raw_bytes.data(); }
-		inline const uint8_t* cdata() const { return raw_bytes.data(); }
-		inline size_t size() const { return raw_bytes.size(); }
+		// Copies never alias a mapping; the bytes are copied instead.
+		//
+		pe_image( const pe_image& other ) : raw_bytes( other.cdata(), other.cdata() + other.size() ) {}
+		pe_image& operator=( const pe_image& other )
+		{
+			if ( this != &other )
+			{
+				raw_bytes.assign( other.cdata(), other.cdata() + other.size() );
+				mapped_bytes = nullptr;
+				mapped_size = 0;
+			}
+			return *this;
+		}
+
+		inline uint8_t* data() { return mapped_bytes ? mapped_bytes.get() : raw_bytes.data(); }
+		inline const uint8_t* cdata() const { return mapped_bytes ? mapped_bytes.get() : raw_bytes.data(); }
+		inline size_t size() const { return mapped_bytes ? mapped_size : raw_bytes.size(); }
 
 		inline win::image_t<true>* get_image() { return ( win::image_t<true>* )data(); }
 	};
+
+	// Determines whether the section is one of the sections VMProtect adds, named .vmpX.
+	//
+	inline bool is_vmp_section( const win::section_header_t* section )
+	{
+		return strncmp( section->name, ".vmp", 4 ) == 0;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "prefilter.hpp"
+#include <bit>
+#include <cstring>
+
+namespace vmpdump
+{
+    // Collects the executable code ranges of the image, which are the ranges scanned for import calls.
+    //
+    std::vector<rva_range_t> get_code_ranges( pe_image& image )
+    {
+        using namespace win;
+
+        nt_headers_t<true>* nt = image.get_image()->get_nt_headers();
+
+        std::vector<rva_range_t> code_ranges;
+        for ( int i = 0; i < nt->file_header.num_sections; i++ )
+        {
+            section_header_t* section = nt->get_section( i );
+
+            if ( section->characteristics.mem_read && section->characteristics.mem_execute && section->characteristics.cnt_code )
+                code_ranges.push_back( { section->virtual_address, section->virtual_address + section->virtual_size } );
+        }
+
+        return code_ranges;
+    }
+
+    // Collects the ranges VMP import stubs may reside in: every .vmpX section, or every executable
+    // section if the image has none (e.g. when the sections were renamed).
+    //
+    std::vector<rva_range_t> get_stub_ranges( pe_image& image )
+    {
+        using namespace win;
+
+        nt_headers_t<true>* nt = image.get_image()->get_nt_headers();
+
+        std::vector<rva_range_t> vmp_ranges;
+        std::vector<rva_range_t> executable_ranges;
+
+        for ( int i = 0; i < nt->file_header.num_sections; i++ )
+        {
+            section_header_t* section = nt->get_section( i );
+            rva_range_t range = { section->virtual_address, section->virtual_address + section->virtual_size };
+
+            if ( is_vmp_section( section ) )
+                vmp_ranges.push_back( range );
+            if ( section->characteristics.mem_execute )
+                executable_ranges.push_back( range );
+        }
+
+        return vmp_ranges.empty() ? executable_ranges : vmp_ranges;
+    }
+
+    // Helper functor checking the E8 at the given rva, and appending it to the candidates if its target is within range.
+    //
+    struct candidate_filter
+    {
+        const uint8_t* image;
+        uint64_t limit_rva;
+        const std::vector<rva_range_t>& targets;
+        std::vector<uint64_t>& candidates;
+
+        inline void operator()( uint64_t call_rva ) const
+        {
+            // Ensure the whole rel32 is available.
+            //
+            if ( call_rva + 5 > limit_rva )
+                return;
+
+            int32_t rel;
+            memcpy( &rel, image + call_rva + 1, sizeof( rel ) );
+
+            uint64_t target = call_rva + 5 + ( int64_t )rel;
+
+            for ( auto& [begin, end] : targets )
+            {
+                if ( target >= begin && target < end )
+                {
+                    candidates.push_back( call_rva );
+                    return;
+                }
+            }
+        }
+    };
+
+    // Scalar implementation, also used for the tails of the vectorized implementations.
+    //
+    static void find_call_candidates_scalar( const candidate_filter& filter, uint64_t rva, uint64_t end )
+    {
+        for ( ; rva < end; rva++ )
+            if ( filter.image[ rva ] == 0xE8 )
+                filter( rva );
+    }
+
+    // SSE2 implementation, comparing 16 bytes at a time.
+    //
+    static void find_call_candidates_sse2( const candidate_filter& filter, uint64_t rva, uint64_t end )
+    {
+        const __m128i opcode = _mm_set1_epi8( ( char )0xE8 );
+
+        for ( ; rva + 16 <= end; rva += 16 )
+        {
+            __m128i bytes = _mm_loadu_si128( ( const __m128i* )( filter.image + rva ) );
+            uint32_t mask = ( uint32_t )_mm_movemask_epi8( _mm_cmpeq_epi8( bytes, opcode ) );
+
+            for ( ; mask; mask &= mask - 1 )
+                filter( rva + std::countr_zero( mask ) );
+        }
+
+        find_call_candidates_scalar( filter, rva, end );
+    }
+
+    // AVX2 implementation, comparing 32 bytes at a time.
+    //
+    VMPDUMP_TARGET_AVX2 static void find_call_candidates_avx2( const candidate_filter& filter, uint64_t rva, uint64_t end )
+    {
+        const __m256i opcode = _mm256_set1_epi8( ( char )0xE8 );
+
+        for ( ; rva + 32 <= end; rva += 32 )
+        {
+            __m256i bytes = _mm256_loadu_si256( ( const __m256i* )( filter.image + rva ) );
+            uint32_t mask = ( uint32_t )_mm256_movemask_epi8( _mm256_cmpeq_epi8( bytes, opcode ) );
+
+            for ( ; mask; mask &= mask - 1 )
+                filter( rva + std::countr_zero( mask ) );
+        }
+
+        find_call_candidates_scalar( filter, rva, end );
+    }
+
+    // Finds every E8 byte in [rva, rva + size) whose rel32 call target falls within one of the target ranges.
+    // The rel32 of a candidate may extend up to limit_rva. The returned rvas are in ascending order.
+    //
+    std::vector<uint64_t> find_call_candidates( const uint8_t* image, uint64_t rva, size_t size, uint64_t limit_rva, const std::vector<rva_range_t>& targets, simd_level level )
+    {
+        std::vector<uint64_t> candidates;
+        candidate_filter filter = { image, limit_rva, targets, candidates };
+
+        switch ( level )
+        {
+            case simd_level::avx2:
+                find_call_candidates_avx2( filter, rva, rva + size );
+                break;
+            case simd_level::sse2:
+                find_call_candidates_sse2( filter, rva, rva + size );
+                break;
+            default:
+                find_call_candidates_scalar( filter, rva, rva + size );
+                break;
+        }
+
+        return candidates;
+    }
+}
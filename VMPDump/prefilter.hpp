@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include "pe_image.hpp"
+#include "simd.hpp"
+
+namespace vmpdump
+{
+    // A range of relative virtual addresses, [first, second).
+    //
+    using rva_range_t = std::pair<uint64_t, uint64_t>;
+
+    // The number of bytes before each candidate that are disassembled in order to resynchronize
+    // the sweep, and to retrieve the instruction preceding the call.
+    //
+    const size_t prefilter_resync_window = 0x20;
+
+    // Collects the executable code ranges of the image, which are the ranges scanned for import calls.
+    //
+    std::vector<rva_range_t> get_code_ranges( pe_image& image );
+
+    // Collects the ranges VMP import stubs may reside in: every .vmpX section, or every executable
+    // section if the image has none (e.g. when the sections were renamed).
+    //
+    std::vector<rva_range_t> get_stub_ranges( pe_image& image );
+
+    // Finds every E8 byte in [rva, rva + size) whose rel32 call target falls within one of the target ranges.
+    // The rel32 of a candidate may extend up to limit_rva. The returned rvas are in ascending order.
+    //
+    std::vector<uint64_t> find_call_candidates( const uint8_t* image, uint64_t rva, size_t size, uint64_t limit_rva, const std::vector<rva_range_t>& targets, simd_level level = host_simd_level() );
+}
@@ -0,0 +1,117 @@
+#include "process_source.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+
+namespace vmpdump
+{
+    process_memory_source::~process_memory_source()
+    {
+        CloseHandle( process_handle );
+    }
+
+    // Opens the process with the given id, returning nullptr on failure.
+    //
+    std::shared_ptr<process_memory_source> process_memory_source::open( uint32_t process_id )
+    {
+        // TODO: replace PROCESS_ALL_ACCESS with something more specific.
+        //
+        HANDLE process_handle = OpenProcess( PROCESS_ALL_ACCESS, FALSE, process_id );
+        if ( process_handle == NULL )
+            return nullptr;
+
+        return std::shared_ptr<process_memory_source>( new process_memory_source( process_id, process_handle ) );
+    }
+
+    // Reads size bytes at the given effective address, returning false if any of them are unreadable.
+    //
+    bool process_memory_source::read( remote_ea_t ea, void* buffer, size_t size )
+    {
+        SIZE_T num_read;
+        return ReadProcessMemory( process_handle, ( LPCVOID )ea, buffer, size, &num_read ) && num_read == size;
+    }
+
+    // Returns the end of the region of pages holding ea which share its protection, along with that protection,
+    // or empty {} if ea is not committed.
+    //
+    std::optional<std::pair<remote_ea_t, uint32_t>> process_memory_source::query_protection( remote_ea_t ea )
+    {
+        MEMORY_BASIC_INFORMATION info = {};
+        if ( !VirtualQueryEx( process_handle, ( LPCVOID )ea, &info, sizeof( info ) ) || info.State != MEM_COMMIT )
+            return {};
+
+        return { { ( remote_ea_t )info.BaseAddress + info.RegionSize, info.Protect } };
+    }
+
+    // Changes the protection of the pages of [ea, ea + size), returning false on failure.
+    //
+    bool process_memory_source::set_protection( remote_ea_t ea, size_t size, uint32_t protection )
+    {
+        DWORD old_protect;
+        return VirtualProtectEx( process_handle, ( LPVOID )ea, size, protection, &old_protect );
+    }
+
+    // Writes size bytes to the given effective address, which must already be writable.
+    //
+    bool process_memory_source::write_writable( remote_ea_t ea, const void* buffer, size_t size )
+    {
+        SIZE_T num_written;
+        return WriteProcessMemory( process_handle, ( LPVOID )ea, buffer, size, &num_written ) && num_written == size;
+    }
+
+    // Flushes the instruction cache for [ea, ea + size), after code was written there.
+    //
+    void process_memory_source::flush_instructions( remote_ea_t ea, size_t size )
+    {
+        FlushInstructionCache( process_handle, ( LPCVOID )ea, size );
+    }
+
+    // Enumerates the modules loaded in the address space.
+    //
+    module_list_t process_memory_source::get_modules()
+    {
+        module_list_t result;
+
+        HMODULE process_modules[ 1024 ] = {};
+
+        // Enumerate through the process modules list.
+        //
+        DWORD process_modules_size;
+        if ( !EnumProcessModules( process_handle, process_modules, sizeof( process_modules ), &process_modules_size ) )
+            return result;
+
+        // Loop through each module.
+        //
+        for ( int i = 0; i < ( process_modules_size / sizeof( HMODULE ) ); i++ )
+        {
+            HMODULE curr_module = process_modules[ i ];
+
+            // Get the module base address and size.
+            //
+            MODULEINFO info = {};
+            if ( !GetModuleInformation( process_handle, curr_module, &info, sizeof( info ) ) )
+                continue;
+
+            // Get the module name, and add the module to the map.
+            //
+            char module_base_name[ 64 ] = {};
+            if ( GetModuleBaseNameA( process_handle, curr_module, module_base_name, sizeof( module_base_name ) ) )
+                result.insert( { ( remote_ea_t )info.lpBaseOfDll, { module_base_name, info.SizeOfImage } } );
+        }
+
+        return result;
+    }
+
+    // Returns the full path of the process image.
+    //
+    std::string process_memory_source::get_image_path()
+    {
+        char process_image_path[ MAX_PATH ] = {};
+        DWORD process_image_path_size = sizeof( process_image_path );
+        if ( !QueryFullProcessImageNameA( process_handle, 0, process_image_path, &process_image_path_size ) )
+            return {};
+
+        return process_image_path;
+    }
+}
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+#include "memory_source.hpp"
+
+namespace vmpdump
+{
+#ifdef _WIN32
+    // A live process, accessed through the Win32 debugging APIs.
+    //
+    class process_memory_source : public protected_memory_source
+    {
+    private:
+        // The process id and handle.
+        //
+        uint32_t process_id;
+        void* process_handle;
+
+        process_memory_source( uint32_t process_id, void* process_handle )
+            : process_id( process_id ), process_handle( process_handle )
+        {}
+
+    public:
+        ~process_memory_source();
+
+        // Opens the process with the given id, returning nullptr on failure.
+        //
+        static std::shared_ptr<process_memory_source> open( uint32_t process_id );
+
+        bool read( remote_ea_t ea, void* buffer, size_t size ) override;
+        module_list_t get_modules() override;
+        std::string get_image_path() override;
+        uint32_t get_process_id() const override { return process_id; }
+
+    protected:
+        std::optional<std::pair<remote_ea_t, uint32_t>> query_protection( remote_ea_t ea ) override;
+        bool set_protection( remote_ea_t ea, size_t size, uint32_t protection ) override;
+        bool write_writable( remote_ea_t ea, const void* buffer, size_t size ) override;
+        void flush_instructions( remote_ea_t ea, size_t size ) override;
+    };
+#endif
+}
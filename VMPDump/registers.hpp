@@ -0,0 +1,68 @@
+#pragma once
+#include <capstone/capstone.h>
+#include <cstdint>
+
+namespace vmpdump
+{
+    // Describes which of the 16 64-bit general purpose registers a capstone register is part of.
+    //
+    struct register_info
+    {
+        int index;
+        uint8_t size;
+        bool high_byte;
+    };
+
+    // Resolves the general purpose register the given capstone register is part of.
+    // Returns an index of -1 for any other register.
+    //
+    inline register_info get_register_info( x86_reg reg )
+    {
+        switch ( reg )
+        {
+            case X86_REG_RAX: return { 0, 8, false };  case X86_REG_EAX: return { 0, 4, false };  case X86_REG_AX: return { 0, 2, false };   case X86_REG_AL: return { 0, 1, false };   case X86_REG_AH: return { 0, 1, true };
+            case X86_REG_RCX: return { 1, 8, false };  case X86_REG_ECX: return { 1, 4, false };  case X86_REG_CX: return { 1, 2, false };   case X86_REG_CL: return { 1, 1, false };   case X86_REG_CH: return { 1, 1, true };
+            case X86_REG_RDX: return { 2, 8, false };  case X86_REG_EDX: return { 2, 4, false };  case X86_REG_DX: return { 2, 2, false };   case X86_REG_DL: return { 2, 1, false };   case X86_REG_DH: return { 2, 1, true };
+            case X86_REG_RBX: return { 3, 8, false };  case X86_REG_EBX: return { 3, 4, false };  case X86_REG_BX: return { 3, 2, false };   case X86_REG_BL: return { 3, 1, false };   case X86_REG_BH: return { 3, 1, true };
+            case X86_REG_RSP: return { 4, 8, false };  case X86_REG_ESP: return { 4, 4, false };  case X86_REG_SP: return { 4, 2, false };   case X86_REG_SPL: return { 4, 1, false };
+            case X86_REG_RBP: return { 5, 8, false };  case X86_REG_EBP: return { 5, 4, false };  case X86_REG_BP: return { 5, 2, false };   case X86_REG_BPL: return { 5, 1, false };
+            case X86_REG_RSI: return { 6, 8, false };  case X86_REG_ESI: return { 6, 4, false };  case X86_REG_SI: return { 6, 2, false };   case X86_REG_SIL: return { 6, 1, false };
+            case X86_REG_RDI: return { 7, 8, false };  case X86_REG_EDI: return { 7, 4, false };  case X86_REG_DI: return { 7, 2, false };   case X86_REG_DIL: return { 7, 1, false };
+            case X86_REG_R8:  return { 8, 8, false };  case X86_REG_R8D:  return { 8, 4, false };  case X86_REG_R8W:  return { 8, 2, false };  case X86_REG_R8B:  return { 8, 1, false };
+            case X86_REG_R9:  return { 9, 8, false };  case X86_REG_R9D:  return { 9, 4, false };  case X86_REG_R9W:  return { 9, 2, false };  case X86_REG_R9B:  return { 9, 1, false };
+            case X86_REG_R10: return { 10, 8, false }; case X86_REG_R10D: return { 10, 4, false }; case X86_REG_R10W: return { 10, 2, false }; case X86_REG_R10B: return { 10, 1, false };
+            case X86_REG_R11: return { 11, 8, false }; case X86_REG_R11D: return { 11, 4, false }; case X86_REG_R11W: return { 11, 2, false }; case X86_REG_R11B: return { 11, 1, false };
+            case X86_REG_R12: return { 12, 8, false }; case X86_REG_R12D: return { 12, 4, false }; case X86_REG_R12W: return { 12, 2, false }; case X86_REG_R12B: return { 12, 1, false };
+            case X86_REG_R13: return { 13, 8, false }; case X86_REG_R13D: return { 13, 4, false }; case X86_REG_R13W: return { 13, 2, false }; case X86_REG_R13B: return { 13, 1, false };
+            case X86_REG_R14: return { 14, 8, false }; case X86_REG_R14D: return { 14, 4, false }; case X86_REG_R14W: return { 14, 2, false }; case X86_REG_R14B: return { 14, 1, false };
+            case X86_REG_R15: return { 15, 8, false }; case X86_REG_R15D: return { 15, 4, false }; case X86_REG_R15W: return { 15, 2, false }; case X86_REG_R15B: return { 15, 1, false };
+            default:          return { -1, 0, false };
+        }
+    }
+
+    // A set of capstone registers, kept as a bitmask indexed by the register id.
+    //
+    struct register_set
+    {
+        uint64_t bits[ ( X86_REG_ENDING + 63 ) / 64 ] = {};
+
+        inline void insert( x86_reg reg )
+        {
+            if ( reg > X86_REG_INVALID && reg < X86_REG_ENDING )
+                bits[ reg / 64 ] |= 1ull << ( reg % 64 );
+        }
+
+        inline bool contains( x86_reg reg ) const
+        {
+            return reg > X86_REG_INVALID && reg < X86_REG_ENDING && ( bits[ reg / 64 ] >> ( reg % 64 ) ) & 1;
+        }
+
+        inline bool empty() const
+        {
+            for ( uint64_t word : bits )
+                if ( word )
+                    return false;
+            return true;
+        }
+    };
+}
@@ -0,0 +1,307 @@
+#include "section_references.hpp"
+#include "disassembler.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace vmpdump
+{
+    // A single reference from one rva to another, and the VMP sections they lie in, if any.
+    //
+    struct section_reference
+    {
+        int from_section;
+        int to_section;
+        uint64_t from_rva;
+        section_reference_kind kind;
+        bool counted;
+    };
+
+    // Helper collecting the references into the VMP sections of an image.
+    //
+    struct reference_collector
+    {
+        std::vector<section_references>& sections;
+        std::vector<section_reference> references;
+
+        // Returns the index of the VMP section containing the rva, or -1 if there is none.
+        //
+        inline int find_section( uint64_t rva ) const
+        {
+            for ( size_t i = 0; i < sections.size(); i++ )
+                if ( rva >= sections[ i ].range.first && rva < sections[ i ].range.second )
+                    return ( int )i;
+            return -1;
+        }
+
+        // Records a reference from the given rva to the target rva, if the target is in another VMP section.
+        //
+        inline void add( uint64_t from_rva, uint64_t target_rva, section_reference_kind kind )
+        {
+            int to_section = find_section( target_rva );
+            int from_section = find_section( from_rva );
+            if ( to_section != -1 && to_section != from_section )
+                references.push_back( { from_section, to_section, from_rva, kind, false } );
+        }
+
+        // Linearly sweeps the code range [begin, end), recording branch targets and RIP-relative operands.
+        //
+        void sweep( const uint8_t* image, size_t image_size, uint64_t begin, uint64_t end )
+        {
+            end = std::min<uint64_t>( end, image_size );
+            if ( begin >= end )
+                return;
+
+            csh handle = disassembler::get().get_handle();
+            cs_insn* ins = disassembler::get().get_insn();
+
+            const uint8_t* code = image + begin;
+            size_t size = end - begin;
+            uint64_t offset = begin;
+
+            while ( offset < end )
+            {
+                // In case disassembly failed (due to invalid instructions), try to continue by incrementing offset.
+                //
+                if ( !cs_disasm_iter( handle, &code, &size, &offset, ins ) )
+                {
+                    offset++;
+                    code++;
+                    size--;
+                    continue;
+                }
+
+                bool branch = false;
+                for ( int i = 0; i < ins->detail->groups_count; i++ )
+                    branch |= ins->detail->groups[ i ] == X86_GRP_JUMP || ins->detail->groups[ i ] == X86_GRP_CALL;
+
+                const cs_x86& x86 = ins->detail->x86;
+                for ( int i = 0; i < x86.op_count; i++ )
+                {
+                    const cs_x86_op& op = x86.operands[ i ];
+
+                    // Immediate branch targets are already resolved to rvas, as the rva is used as the address.
+                    //
+                    if ( branch && op.type == X86_OP_IMM )
+                        add( ins->address, ( uint64_t )op.imm, reference_branch );
+                    else if ( op.type == X86_OP_MEM && op.mem.base == X86_REG_RIP )
+                        add( ins->address, ins->address + ins->size + op.mem.disp, reference_rip_relative );
+                }
+            }
+        }
+    };
+
+    // Returns whether the image has base relocations, which locate every absolute pointer in it.
+    //
+    bool has_base_relocations( pe_image& image )
+    {
+        using namespace win;
+
+        nt_headers_x64_t* nt = image.get_image()->get_nt_headers();
+        if ( nt->file_header.characteristics.relocs_stripped || nt->optional_header.num_data_directories <= directory_entry_basereloc )
+            return false;
+
+        data_directory_t& reloc_directory = nt->optional_header.data_directories.basereloc_directory;
+        return reloc_directory.present() && ( uint64_t )reloc_directory.rva + reloc_directory.size <= image.size();
+    }
+
+    // Finds the references into each VMP section of the image which remain after the imports were fixed: branches and
+    // RIP-relative operands in the code ranges, relocations, exception directory entries, data directories and the entry point.
+    // Without base relocations, every aligned value which looks like a pointer into a section is conservatively counted instead.
+    // References made from within a VMP section only count if that section is referenced itself, and from elsewhere.
+    // If any VMP section is referenced, every one of them is, as the virtual machine may reach into any of them.
+    //
+    std::vector<section_references> find_vmp_references( pe_image& image, uint64_t entry_point )
+    {
+        using namespace win;
+
+        const uint8_t* bytes = image.cdata();
+        size_t image_size = image.size();
+        nt_headers_x64_t* nt = image.get_image()->get_nt_headers();
+
+        std::vector<section_references> result;
+        std::vector<bool> executable;
+        for ( int i = 0; i < nt->file_header.num_sections; i++ )
+        {
+            section_header_t* section = nt->get_section( i );
+            if ( !is_vmp_section( section ) )
+                continue;
+
+            section_references references = {};
+            references.section_index = i;
+            references.range = { section->virtual_address, section->virtual_address + section->virtual_size };
+            result.push_back( references );
+            executable.push_back( section->characteristics.mem_execute );
+        }
+
+        reference_collector collector = { result, {} };
+
+        // The entry point and the data directories are referenced from the headers.
+        // The security directory holds a file offset rather than an rva, so it is skipped.
+        //
+        collector.add( 0, entry_point, reference_entry_point );
+
+        data_directories_x64_t& directories = nt->optional_header.data_directories;
+        uint32_t directory_count = std::min<uint32_t>( nt->optional_header.num_data_directories, NUM_DATA_DIRECTORIES );
+        for ( uint32_t i = 0; i < directory_count; i++ )
+        {
+            if ( i == directory_entry_security || !directories.entries[ i ].present() )
+                continue;
+
+            for ( size_t j = 0; j < result.size(); j++ )
+            {
+                uint64_t begin = directories.entries[ i ].rva;
+                uint64_t end = begin + directories.entries[ i ].size;
+                if ( begin < result[ j ].range.second && end > result[ j ].range.first )
+                    collector.add( 0, std::max( begin, result[ j ].range.first ), reference_directory );
+            }
+        }
+
+        // Every relocated pointer targeting a VMP section, which was relocated to the image base it was dumped at.
+        //
+        data_directory_t& reloc_directory = directories.basereloc_directory;
+        if ( has_base_relocations( image ) )
+        {
+            uint64_t block_rva = reloc_directory.rva;
+            uint64_t directory_end = block_rva + reloc_directory.size;
+            while ( block_rva + sizeof( uint32_t ) * 2 <= directory_end )
+            {
+                reloc_block_t* block = ( reloc_block_t* )( bytes + block_rva );
+                if ( block->size_block < sizeof( uint32_t ) * 2 || block_rva + block->size_block > directory_end )
+                    break;
+
+                for ( uint32_t i = 0; i < block->num_entries(); i++ )
+                {
+                    uint64_t rva = ( uint64_t )block->base_rva + block->entries[ i ].offset;
+                    if ( block->entries[ i ].type != rel_based_dir64 || rva + sizeof( uint64_t ) > image_size )
+                        continue;
+
+                    uint64_t pointer;
+                    memcpy( &pointer, bytes + rva, sizeof( pointer ) );
+                    collector.add( rva, pointer - nt->optional_header.image_base, reference_relocation );
+                }
+
+                block_rva += block->size_block;
+            }
+        }
+        else
+        {
+            // Without relocations, pointers cannot be told apart from data, so count every aligned value of every section
+            // which would point into a VMP section at the preferred image base, where such an image is always loaded.
+            //
+            for ( int i = 0; i < nt->file_header.num_sections; i++ )
+            {
+                section_header_t* section = nt->get_section( i );
+                uint64_t begin = section->virtual_address;
+                uint64_t end = std::min<uint64_t>( begin + section->virtual_size, image_size );
+
+                for ( uint64_t rva = begin; rva + sizeof( uint64_t ) <= end; rva += sizeof( uint64_t ) )
+                {
+                    uint64_t pointer;
+                    memcpy( &pointer, bytes + rva, sizeof( pointer ) );
+                    collector.add( rva, pointer - nt->optional_header.image_base, reference_pointer );
+                }
+            }
+        }
+
+        // Every function, or unwind data, in a VMP section.
+        //
+        data_directory_t& exception_directory = directories.exception_directory;
+        if ( directory_count > directory_entry_exception && exception_directory.present() && ( uint64_t )exception_directory.rva + exception_directory.size <= image_size )
+        {
+            const runtime_function_t* functions = ( const runtime_function_t* )( bytes + exception_directory.rva );
+            for ( size_t i = 0; i < exception_directory.size / sizeof( runtime_function_t ); i++ )
+            {
+                uint64_t rva = exception_directory.rva + i * sizeof( runtime_function_t );
+                collector.add( rva, functions[ i ].rva_begin, reference_exception );
+                collector.add( rva, functions[ i ].rva_unwind_data, reference_exception );
+            }
+        }
+
+        // Sweep the code outside of the VMP sections.
+        //
+        for ( auto& [begin, end] : get_code_ranges( image ) )
+        {
+            if ( collector.find_section( begin ) == -1 )
+                collector.sweep( bytes, image_size, begin, end );
+        }
+
+        // Count the references made from outside of the VMP sections, or from referenced ones. Whenever a section becomes
+        // referenced, its code is swept too, as it may reference yet another one.
+        //
+        std::vector<bool> swept( result.size() );
+        for ( bool changed = true; changed; )
+        {
+            changed = false;
+
+            for ( size_t i = 0; i < collector.references.size(); i++ )
+            {
+                section_reference& reference = collector.references[ i ];
+                if ( reference.counted || ( reference.from_section != -1 && !result[ reference.from_section ].referenced() ) )
+                    continue;
+
+                section_references& target = result[ reference.to_section ];
+                if ( !target.first_from )
+                    target.first_from = reference.from_rva;
+                target.count++;
+                target.kinds |= reference.kind;
+                reference.counted = true;
+                changed = true;
+            }
+
+            for ( size_t i = 0; i < result.size(); i++ )
+            {
+                if ( result[ i ].referenced() && executable[ i ] && !swept[ i ] )
+                {
+                    collector.sweep( bytes, image_size, result[ i ].range.first, result[ i ].range.second );
+                    swept[ i ] = true;
+                    changed = true;
+                }
+            }
+        }
+
+        // The virtual machine reaches its bytecode through encrypted or computed addresses, which no sweep finds, and its
+        // handlers and bytecode may be spread over several sections. So if it is still reachable from any section, keep them all.
+        //
+        auto live = std::find_if( result.begin(), result.end(), [ ] ( const section_references& references ) { return references.referenced(); } );
+        if ( live != result.end() )
+        {
+            for ( section_references& references : result )
+            {
+                if ( references.referenced() )
+                    continue;
+                references.first_from = live->range.first;
+                references.count = 1;
+                references.kinds = reference_virtual_machine;
+            }
+        }
+        return result;
+    }
+
+    // Describes the given reference kinds, e.g. "branch, relocation".
+    //
+    std::string describe_reference_kinds( uint32_t kinds )
+    {
+        static const std::pair<section_reference_kind, const char*> names[] =
+        {
+            { reference_branch, "branch" },
+            { reference_rip_relative, "rip-relative" },
+            { reference_relocation, "relocation" },
+            { reference_exception, "exception" },
+            { reference_entry_point, "entry point" },
+            { reference_directory, "directory" },
+            { reference_pointer, "unrelocated pointer" },
+            { reference_virtual_machine, "virtual machine" },
+        };
+
+        std::string result;
+        for ( auto& [kind, name] : names )
+        {
+            if ( !( kinds & kind ) )
+                continue;
+            if ( !result.empty() )
+                result += ", ";
+            result += name;
+        }
+        return result;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "pe_image.hpp"
+#include "prefilter.hpp"
+
+namespace vmpdump
+{
+    // The kinds of references which keep a VMP section alive.
+    //
+    enum section_reference_kind : uint32_t
+    {
+        // A relative jump or call.
+        //
+        reference_branch = 1 << 0,
+
+        // A RIP-relative memory operand.
+        //
+        reference_rip_relative = 1 << 1,
+
+        // A relocated absolute address.
+        //
+        reference_relocation = 1 << 2,
+
+        // An exception directory entry, for a function or unwind data in the section.
+        //
+        reference_exception = 1 << 3,
+
+        // The entry point.
+        //
+        reference_entry_point = 1 << 4,
+
+        // A data directory, e.g. when the IAT or the relocations were moved into the section.
+        //
+        reference_directory = 1 << 5,
+
+        // An aligned value anywhere in the image which looks like an absolute pointer into the section, only searched for
+        // if the image has no base relocations to find the actual pointers with.
+        //
+        reference_pointer = 1 << 6,
+
+        // Another VMP section which is referenced, as the virtual machine reaches its bytecode in any of the VMP sections
+        // through encrypted or computed addresses, which no scan finds.
+        //
+        reference_virtual_machine = 1 << 7,
+    };
+
+    // The references found into a single VMP section.
+    //
+    struct section_references
+    {
+        // The index and range of the section.
+        //
+        int section_index;
+        rva_range_t range;
+
+        // The number of references, and the kinds among them.
+        //
+        size_t count = 0;
+        uint32_t kinds = 0;
+
+        // The rva the first reference was found at.
+        //
+        std::optional<uint64_t> first_from;
+
+        inline bool referenced() const { return count != 0; }
+    };
+
+    // Returns whether the image has base relocations, which locate every absolute pointer in it.
+    //
+    bool has_base_relocations( pe_image& image );
+
+    // Finds the references into each VMP section of the image which remain after the imports were fixed: branches and
+    // RIP-relative operands in the code ranges, relocations, exception directory entries, data directories and the entry point.
+    // Without base relocations, every aligned value which looks like a pointer into a section is conservatively counted instead.
+    // References made from within a VMP section only count if that section is referenced itself, and from elsewhere.
+    // If any VMP section is referenced, every one of them is, as the virtual machine may reach into any of them.
+    //
+    std::vector<section_references> find_vmp_references( pe_image& image, uint64_t entry_point );
+
+    // Describes the given reference kinds, e.g. "branch, relocation".
+    //
+    std::string describe_reference_kinds( uint32_t kinds );
+}
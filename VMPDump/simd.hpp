@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// MSVC allows any intrinsic in any function, whereas GCC and Clang require functions using
+// instructions beyond the baseline to be explicitly marked.
+//
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#define VMPDUMP_TARGET_AVX2
+#else
+#define VMPDUMP_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+
+namespace vmpdump
+{
+    // The vector instruction sets the vectorized routines are implemented for, in ascending order.
+    //
+    enum class simd_level : uint32_t
+    {
+        scalar,
+        sse2,
+        avx2,
+    };
+
+    // Returns the highest vector instruction set supported by both the processor and the OS.
+    //
+    inline simd_level detect_simd_level()
+    {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+        int regs[ 4 ] = {};
+
+        // SSE2 is part of the x64 baseline, so only AVX2 must be probed for.
+        // AVX2 requires the OS to save the YMM state, which is indicated by OSXSAVE and XCR0.
+        //
+        __cpuid( regs, 1 );
+        bool osxsave = ( regs[ 2 ] & ( 1 << 27 ) ) != 0;
+        bool avx = ( regs[ 2 ] & ( 1 << 28 ) ) != 0;
+
+        __cpuidex( regs, 7, 0 );
+        bool avx2 = ( regs[ 1 ] & ( 1 << 5 ) ) != 0;
+
+        if ( osxsave && avx && avx2 && ( _xgetbv( 0 ) & 6 ) == 6 )
+            return simd_level::avx2;
+
+        return simd_level::sse2;
+#else
+        __builtin_cpu_init();
+
+        if ( __builtin_cpu_supports( "avx2" ) )
+            return simd_level::avx2;
+        if ( __builtin_cpu_supports( "sse2" ) )
+            return simd_level::sse2;
+
+        return simd_level::scalar;
+#endif
+    }
+
+    // Returns the cached vector instruction set level of the host.
+    //
+    inline simd_level host_simd_level()
+    {
+        static const simd_level level = detect_simd_level();
+        return level;
+    }
+}
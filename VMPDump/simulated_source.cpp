@@ -0,0 +1,146 @@
+#include "simulated_source.hpp"
+#include <cstring>
+#include <iterator>
+
+namespace vmpdump
+{
+    // Adds a module. The first module added is the process image.
+    //
+    void simulated_memory_source::add_module( remote_ea_t base, const std::string& name, std::vector<uint8_t> bytes )
+    {
+        if ( modules.empty() )
+            image_path = name;
+
+        std::vector<uint32_t> protections( ( bytes.size() + page_size - 1 ) / page_size, page_readwrite );
+        modules.insert( { base, { name, std::move( bytes ), std::move( protections ) } } );
+    }
+
+    // Returns the module holding ea, or nullptr if there is none.
+    //
+    simulated_memory_source::simulated_module* simulated_memory_source::find_module( remote_ea_t ea, remote_ea_t* base )
+    {
+        auto it = modules.upper_bound( ea );
+        if ( it == modules.begin() )
+            return nullptr;
+        it--;
+
+        if ( ea - it->first >= it->second.bytes.size() )
+            return nullptr;
+
+        *base = it->first;
+        return &it->second;
+    }
+
+    // Makes [ea, ea + size) unreadable.
+    //
+    void simulated_memory_source::add_hole( remote_ea_t ea, size_t size )
+    {
+        holes.insert( { ea, ea + size } );
+    }
+
+    // Reads size bytes at the given effective address, failing if any of them lie in a hole or outside of a module.
+    //
+    bool simulated_memory_source::read( remote_ea_t ea, void* buffer, size_t size )
+    {
+        read_count++;
+
+        // Check for an overlapping hole; holes do not overlap each other, so only the last one starting before the end matters.
+        //
+        auto hole = holes.lower_bound( ea + size );
+        if ( hole != holes.begin() && std::prev( hole )->second > ea )
+            return false;
+
+        auto it = modules.upper_bound( ea );
+        if ( it == modules.begin() )
+            return false;
+        it--;
+
+        uint64_t offset = ea - it->first;
+        if ( offset + size > it->second.bytes.size() )
+            return false;
+
+        memcpy( buffer, it->second.bytes.data() + offset, size );
+        return true;
+    }
+
+    // Returns the protection of the page holding ea, or empty {} if it is in no module.
+    //
+    std::optional<uint32_t> simulated_memory_source::get_protection( remote_ea_t ea )
+    {
+        remote_ea_t base;
+        simulated_module* module = find_module( ea, &base );
+        if ( !module )
+            return {};
+        return module->protections[ ( ea - base ) / page_size ];
+    }
+
+    // Returns the end of the run of pages holding ea which share its protection, along with that protection,
+    // or empty {} if ea is in no module.
+    //
+    std::optional<std::pair<remote_ea_t, uint32_t>> simulated_memory_source::query_protection( remote_ea_t ea )
+    {
+        remote_ea_t base;
+        simulated_module* module = find_module( ea, &base );
+        if ( !module )
+            return {};
+
+        size_t page = ( ea - base ) / page_size;
+        size_t end = page + 1;
+        while ( end < module->protections.size() && module->protections[ end ] == module->protections[ page ] )
+            end++;
+        return { { base + std::min( end * page_size, module->bytes.size() ), module->protections[ page ] } };
+    }
+
+    // Changes the protection of the pages of [ea, ea + size), failing if they are not all within one module.
+    //
+    bool simulated_memory_source::set_protection( remote_ea_t ea, size_t size, uint32_t protection )
+    {
+        remote_ea_t base;
+        simulated_module* module = find_module( ea, &base );
+        if ( !module || size == 0 || ea - base + size > module->bytes.size() )
+            return false;
+
+        for ( size_t page = ( ea - base ) / page_size; page <= ( ea - base + size - 1 ) / page_size; page++ )
+            module->protections[ page ] = protection;
+        return true;
+    }
+
+    // Writes size bytes to the given effective address, failing if any of them lie in a hole, outside of a module, or on a page
+    // which is not writable.
+    //
+    bool simulated_memory_source::write_writable( remote_ea_t ea, const void* buffer, size_t size )
+    {
+        writes.push_back( { ea, size } );
+
+        auto hole = holes.lower_bound( ea + size );
+        if ( hole != holes.begin() && std::prev( hole )->second > ea )
+            return false;
+
+        remote_ea_t base;
+        simulated_module* module = find_module( ea, &base );
+        if ( !module || size == 0 || ea - base + size > module->bytes.size() )
+            return false;
+
+        for ( size_t page = ( ea - base ) / page_size; page <= ( ea - base + size - 1 ) / page_size; page++ )
+        {
+            uint32_t protection = module->protections[ page ];
+            if ( protection != page_readwrite && protection != page_execute_readwrite )
+                return false;
+        }
+
+        memcpy( module->bytes.data() + ( ea - base ), buffer, size );
+        if ( on_write )
+            on_write( ea, size );
+        return true;
+    }
+
+    // Enumerates the simulated modules.
+    //
+    module_list_t simulated_memory_source::get_modules()
+    {
+        module_list_t result;
+        for ( auto& [base, module] : modules )
+            result.insert( { base, { module.name, module.bytes.size() } } );
+        return result;
+    }
+}
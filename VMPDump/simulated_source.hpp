@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "memory_source.hpp"
+
+namespace vmpdump
+{
+    // An in-memory address space with holes, used to exercise the page cache, the scanner and write-back without a process.
+    // Reads and writes overlapping a hole fail as a whole, like ReadProcessMemory does on guard or no-access pages.
+    // Every page has a protection, read-write unless changed, and writes to pages which are not writable fail.
+    // Writes are recorded, so that their volume and order can be checked.
+    //
+    class simulated_memory_source : public protected_memory_source
+    {
+    private:
+        // The granularity of protections.
+        //
+        static constexpr size_t page_size = 0x1000;
+
+        // The simulated modules, with the protection of each of their pages.
+        //
+        struct simulated_module
+        {
+            std::string name;
+            std::vector<uint8_t> bytes;
+            std::vector<uint32_t> protections;
+        };
+
+        // Returns the module holding ea, or nullptr if there is none.
+        //
+        simulated_module* find_module( remote_ea_t ea, remote_ea_t* base );
+        std::map<remote_ea_t, simulated_module> modules;
+
+        // The unreadable ranges, as { begin, end }.
+        //
+        std::map<remote_ea_t, remote_ea_t> holes;
+
+        // The process image name.
+        //
+        std::string image_path;
+
+    public:
+        // The amount of reads issued, including failed ones.
+        //
+        std::atomic<uint64_t> read_count = { 0 };
+
+        // The writes issued, as { ea, size }, including failed ones.
+        //
+        std::vector<std::pair<remote_ea_t, size_t>> writes;
+
+        // The ranges the instruction cache was flushed for, as { ea, size }.
+        //
+        std::vector<std::pair<remote_ea_t, size_t>> flushes;
+
+        // If set, invoked after every successful write, so that the state of the memory can be checked at that point.
+        //
+        std::function<void( remote_ea_t ea, size_t size )> on_write;
+
+        // Adds a module. The first module added is the process image.
+        //
+        void add_module( remote_ea_t base, const std::string& name, std::vector<uint8_t> bytes );
+
+        // Makes [ea, ea + size) unreadable.
+        //
+        void add_hole( remote_ea_t ea, size_t size );
+
+        // Returns the protection of the page holding ea, or empty {} if it is in no module.
+        //
+        std::optional<uint32_t> get_protection( remote_ea_t ea );
+
+        bool read( remote_ea_t ea, void* buffer, size_t size ) override;
+        bool set_protection( remote_ea_t ea, size_t size, uint32_t protection ) override;
+        module_list_t get_modules() override;
+        std::string get_image_path() override { return image_path; }
+
+    protected:
+        std::optional<std::pair<remote_ea_t, uint32_t>> query_protection( remote_ea_t ea ) override;
+        bool write_writable( remote_ea_t ea, const void* buffer, size_t size ) override;
+        void flush_instructions( remote_ea_t ea, size_t size ) override { flushes.push_back( { ea, size } ); }
+    };
+}
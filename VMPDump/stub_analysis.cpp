@@ -0,0 +1,140 @@
+#include "stub_analysis.hpp"
+#include <vtil/compiler>
+#include <vtil/common>
+#include <vtil/symex>
+
+namespace vmpdump
+{
+    // Attempts to generate structures from the provided call EA and instruction stream of a VMP import stub.
+    // Returns empty {} if the import stub failed analysis (and therefore is an invalid stub).
+    // The stream is lifted with the given context, and the lifted routine is freed before returning.
+    //
+    std::optional<import_stub_analysis> analyze_import_stub( const compact_stream& stream, lift_context& context )
+    {
+        using namespace vtil;
+
+        // Lift the given instruction stream to VTIL.
+        // The routine is declared first so that it outlives every expression traced from it.
+        //
+        std::unique_ptr<lifted_routine> lifted = context.lift( stream );
+        basic_block* lifted_block = lifted->block;
+
+        // Ensure lifted block is valid.
+        //
+        if ( !lifted_block->is_complete() )
+            return {};
+
+        // Get the iterator just before the VMEXIT at the end.
+        // This is the baseline we'll be using to see how certain registers / stack variables changed during the stub.
+        //
+        vtil::basic_block::const_iterator iterator = std::prev( lifted_block->end() );
+
+        // Verify that the last instruction is a JMP to a register.
+        //
+        if ( iterator->base->name != "jmp" || !iterator->operands[ 0 ].is_register() )
+            return {};
+
+        // Trace each variable that we'll be using to analyze the stub.
+        //
+        cached_tracer tracer;
+        symbolic::expression::reference dest_expression = tracer.trace( { iterator, iterator->operands[ 0 ].reg() } );
+        symbolic::expression::reference sp_expression = tracer.trace( { iterator, REG_SP } );
+        symbolic::expression::reference retaddr_expression = tracer.trace( { iterator, { sp_expression, 64 } } );
+
+#ifdef _DEBUG
+        logger::log<logger::CON_CYN>( "** Import stub analysis: dest_expression: %s sp_expression: %s retaddr_expression: %s\r\n", dest_expression, sp_expression, retaddr_expression );
+#endif
+
+        // Check if the retaddr expression matches the [CONST] + CONST expression.
+        //
+        uint64_t thunk_rva = 0;
+        uint64_t dest_offset = 0;
+        {
+            using namespace symbolic::directive;
+
+            int64_t sign;
+            stack_vector<symbol_table_t, 2> results;
+            if ( ( sign = +1, fast_match( &results, V + U, dest_expression ) ) ||
+                 ( sign = -1, fast_match( &results, V - U, dest_expression ) ) ||
+                 ( sign = +0, fast_match( &results, V,     dest_expression ) ) )
+            {
+                auto& var = results.front().translate( V )->uid.get<symbolic::variable>();
+                if ( !var.is_memory() || !var.mem().decay()->is_constant() )
+                    return {};
+
+                thunk_rva = *var.mem().decay()->get();
+                if ( sign != 0 ) 
+                    dest_offset = sign * *results.front().translate( U )->get<true>();
+            }
+            else
+            {
+                return {};
+            }
+        }
+
+        symbolic::expression::reference retaddr_sp_exp;
+
+        // Check if return address is padded.
+        // TODO: rewrite this in a nicer way.
+        //
+        bool pad = false;
+        {
+            symbolic::expression::reference lhs = retaddr_expression->lhs;
+            symbolic::expression::reference rhs = retaddr_expression->rhs;
+
+            if ( lhs && rhs && lhs->is_variable() && rhs->is_constant() )
+            {
+                uint32_t constant = *rhs->get<uint32_t>();
+
+                if ( constant != 1 )
+                    logger::log<logger::CON_PRP>( "** Warning: Unexpected value for padding: 0x%lx\r\n", constant );
+
+                pad = true;
+
+                // Set retaddr sp exp to [lhs].
+                //
+                retaddr_sp_exp = lhs->uid.get<symbolic::variable>().mem().base.base;
+            }
+            else
+                retaddr_sp_exp = retaddr_expression->uid.get<symbolic::variable>().mem().base.base;
+        }
+
+#ifdef _DEBUG
+        logger::log<logger::CON_CYN>( "** Import stub analysis: retaddr_sp_exp: %s\r\n", retaddr_sp_exp );
+#endif
+
+        // Subtract initial SP from final SP to get the SP adjustment.
+        //
+        symbolic::expression stack_adjustment_expr = ( sp_expression - symbolic::CTX( lifted_block->begin() )[ REG_SP ] ).simplify( true );
+#ifdef _DEBUG
+        logger::log<logger::CON_CYN>( "** Import stub analysis: stack_adjustment_expr: %s\r\n", stack_adjustment_expr );
+#endif
+
+        // Check if is jmp.
+        //
+        bool is_jmp = retaddr_sp_exp->equals( *sp_expression ) && *stack_adjustment_expr.get<int32_t>() >= 8;
+#ifdef _DEBUG
+        logger::log<logger::CON_CYN>( "** Import stub analysis: is_jmp: %d\r\n", is_jmp );
+#endif
+
+        if ( !stack_adjustment_expr.is_constant() )
+            return {};
+
+        // If is jump, expect stack adjustment of -0x8 to account for the initial call stub.
+        //
+        int32_t sp_adjustment = *stack_adjustment_expr.get<int32_t>() - ( is_jmp ? 8 : 0 );
+
+        // Construct the analysis result object.
+        //
+        return import_stub_analysis { thunk_rva, dest_offset, sp_adjustment, pad, is_jmp };
+    }
+
+    // Formats an analysis result for diagnostics.
+    //
+    std::string describe_analysis( const std::optional<import_stub_analysis>& analysis )
+    {
+        if ( !analysis )
+            return "not a stub";
+        return vtil::format::str( "thunk 0x%llx + 0x%llx, sp %d, pad %d, jmp %d", analysis->thunk_rva, analysis->dest_offset, analysis->stack_adjustment, analysis->padding, analysis->is_jmp );
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include "compact_instruction.hpp"
+#include "lift_context.hpp"
+
+namespace vmpdump
+{
+    // Structure used to return raw import stub analysis information.
+    //
+    struct import_stub_analysis
+    {
+        uintptr_t thunk_rva;
+        uintptr_t dest_offset;
+        int32_t stack_adjustment;
+        bool padding;
+        bool is_jmp;
+
+        bool operator==( const import_stub_analysis& ) const = default;
+    };
+
+    // Attempts to generate structures from the provided call EA and instruction stream of a VMP import stub.
+    // Returns empty {} if the import stub failed analysis (and therefore is an invalid stub).
+    // The stream is lifted with the given context, and the lifted routine is freed before returning.
+    //
+    std::optional<import_stub_analysis> analyze_import_stub( const compact_stream& stream, lift_context& context = lift_context::get() );
+
+    // Formats an analysis result for diagnostics.
+    //
+    std::string describe_analysis( const std::optional<import_stub_analysis>& analysis );
+}
@@ -0,0 +1,58 @@
+#include "stub_cache.hpp"
+#include <mutex>
+
+namespace vmpdump
+{
+    // Looks up the cached result for the given call target.
+    // Returns empty {} if the target has not been analyzed yet.
+    //
+    std::optional<std::optional<import_stub_analysis>> stub_cache::lookup( uint64_t target_rva )
+    {
+        std::shared_lock<std::shared_mutex> guard( lock );
+
+        auto it = entries.find( target_rva );
+        if ( it == entries.end() )
+        {
+            misses++;
+            return {};
+        }
+
+        hits++;
+        return std::optional<std::optional<import_stub_analysis>> { std::in_place, it->second };
+    }
+
+    // Stores the result for the given call target. If another thread already stored a result, it is kept.
+    //
+    void stub_cache::insert( uint64_t target_rva, const std::optional<import_stub_analysis>& result )
+    {
+        std::unique_lock<std::shared_mutex> guard( lock );
+        entries.insert( { target_rva, result } );
+    }
+
+    // Drops the result for the given call target, so that it is analyzed again.
+    //
+    void stub_cache::erase( uint64_t target_rva )
+    {
+        std::unique_lock<std::shared_mutex> guard( lock );
+        entries.erase( target_rva );
+    }
+
+    // Drops every entry and resets the counters.
+    //
+    void stub_cache::clear()
+    {
+        std::unique_lock<std::shared_mutex> guard( lock );
+        entries.clear();
+
+        hits = 0;
+        misses = 0;
+    }
+
+    // Returns the number of cached call targets.
+    //
+    size_t stub_cache::size() const
+    {
+        std::shared_lock<std::shared_mutex> guard( lock );
+        return entries.size();
+    }
+}
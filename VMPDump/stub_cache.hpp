@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include "stub_analysis.hpp"
+
+namespace vmpdump
+{
+    // A thread-safe cache of import stub analysis results, keyed by the call target rva.
+    // Both successful analyses and failures are stored, so ordinary functions that are called
+    // from many sites are only ever disassembled and lifted once.
+    //
+    class stub_cache
+    {
+    private:
+        // Lock guarding the entries.
+        //
+        mutable std::shared_mutex lock;
+
+        // Map of { call target rva, analysis result or empty {} if not a stub }.
+        //
+        std::unordered_map<uint64_t, std::optional<import_stub_analysis>> entries;
+
+        // Lookup counters.
+        //
+        std::atomic<uint64_t> hits = 0;
+        std::atomic<uint64_t> misses = 0;
+
+    public:
+        // Looks up the cached result for the given call target.
+        // Returns empty {} if the target has not been analyzed yet.
+        //
+        std::optional<std::optional<import_stub_analysis>> lookup( uint64_t target_rva );
+
+        // Stores the result for the given call target. If another thread already stored a result, it is kept.
+        //
+        void insert( uint64_t target_rva, const std::optional<import_stub_analysis>& result );
+
+        // Returns the cached result for the given call target, invoking the analyzer and caching its result on a miss.
+        // The analyzer is run without holding the lock, so two threads may race to analyze the same target.
+        //
+        template<typename F>
+        std::optional<import_stub_analysis> get_or_analyze( uint64_t target_rva, F&& analyzer )
+        {
+            if ( auto cached = lookup( target_rva ) )
+                return *cached;
+
+            std::optional<import_stub_analysis> result = analyzer();
+            insert( target_rva, result );
+            return result;
+        }
+
+        // Drops the result for the given call target, so that it is analyzed again.
+        //
+        void erase( uint64_t target_rva );
+
+        // Drops every entry and resets the counters.
+        //
+        void clear();
+
+        // Statistics.
+        //
+        inline uint64_t hit_count() const { return hits; }
+        inline uint64_t miss_count() const { return misses; }
+        size_t size() const;
+    };
+}
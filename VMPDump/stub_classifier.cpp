@@ -0,0 +1,411 @@
+#include "stub_classifier.hpp"
+#include "registers.hpp"
+#include <unordered_map>
+#include <vtil/common>
+
+namespace vmpdump
+{
+    // The known stub shapes. r0 is the scratch register the stub preserves, [rsp+0x0] is the slot the destination is
+    // returned into, and [rsp+0x8] is the return address pushed by the call (offsets are after the initial push).
+    //
+    static const std::vector<stub_template> stub_templates =
+    {
+        // call [thunk]
+        //
+        {
+            "call",
+            "push r0;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret",
+            0, 0, -1, 0, false
+        },
+
+        // call [thunk], followed by a padding byte skipped by adjusting the return address.
+        //
+        {
+            "call_padded",
+            "push r0;mov r0,[rsp+0x8];lea r0,[r0+#];mov [rsp+0x8],r0;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret",
+            0, 1, 0, 0, false
+        },
+
+        // call [thunk], with the return address adjusted in place.
+        //
+        {
+            "call_padded_add",
+            "push r0;add [rsp+0x8],#;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret",
+            0, 1, 0, 0, false
+        },
+
+        // jmp [thunk], discarding the return address pushed by the call.
+        //
+        {
+            "jmp",
+            "push r0;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret 0x8",
+            0, 0, -1, 0, true
+        },
+
+        // push reg; call [thunk], where the push was replaced by the stub moving the return address up a slot.
+        //
+        {
+            "call_pushed",
+            "push r0;mov r0,[rsp+0x8];mov [rsp+0x10],r0;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret 0x8",
+            0, 0, -1, 8, false
+        },
+
+        // push reg; call [thunk] followed by a padding byte.
+        //
+        {
+            "call_pushed_padded",
+            "push r0;mov r0,[rsp+0x8];lea r0,[r0+#];mov [rsp+0x10],r0;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret 0x8",
+            0, 1, 0, 8, false
+        },
+    };
+
+    // Returns the canonical mnemonic of the given instruction, or nullptr if it cannot be part of a known shape.
+    //
+    static const char* get_mnemonic( unsigned int id )
+    {
+        switch ( id )
+        {
+            case X86_INS_MOV:
+            case X86_INS_MOVABS: return "mov";
+            case X86_INS_LEA:    return "lea";
+            case X86_INS_ADD:    return "add";
+            case X86_INS_XCHG:   return "xchg";
+            case X86_INS_PUSH:   return "push";
+            case X86_INS_POP:    return "pop";
+            case X86_INS_RET:    return "ret";
+            default:             return nullptr;
+        }
+    }
+
+    // Helper used to build the normalized form of a stream.
+    //
+    struct stub_normalizer
+    {
+        normalized_stub result;
+
+        // The canonical index assigned to each general purpose register, or -1 if it has not appeared yet.
+        //
+        int canonical_index[ 16 ];
+
+        // The next canonical index to assign.
+        //
+        int next_index = 0;
+
+        stub_normalizer()
+        {
+            std::fill( std::begin( canonical_index ), std::end( canonical_index ), -1 );
+        }
+
+        // Renders a register operand, returning false if it is not a general purpose register.
+        //
+        bool append_register( x86_reg reg )
+        {
+            register_info info = get_register_info( reg );
+            if ( info.index < 0 )
+                return false;
+
+            // The stack pointer is part of the shape, and is left as is.
+            //
+            if ( info.index == 4 )
+            {
+                if ( info.size != 8 )
+                    return false;
+                result.signature += "rsp";
+                return true;
+            }
+
+            if ( canonical_index[ info.index ] < 0 )
+                canonical_index[ info.index ] = next_index++;
+
+            result.signature += vtil::format::str( "r%d", canonical_index[ info.index ] );
+
+            switch ( info.size )
+            {
+                case 4: result.signature += "d"; break;
+                case 2: result.signature += "w"; break;
+                case 1: result.signature += info.high_byte ? "h" : "b"; break;
+            }
+            return true;
+        }
+
+        // Renders a constant placeholder, capturing its value.
+        //
+        void append_constant( int64_t value )
+        {
+            result.signature += "#";
+            result.constants.push_back( value );
+        }
+
+        // Renders an operand, returning false if its form cannot be normalized.
+        //
+        bool append_operand( const cs_x86_op& op, const compact_instruction& ins )
+        {
+            switch ( op.type )
+            {
+                case X86_OP_REG:
+                    return append_register( op.reg );
+
+                case X86_OP_IMM:
+                    append_constant( op.imm );
+                    return true;
+
+                case X86_OP_MEM:
+                {
+                    if ( op.mem.segment != X86_REG_INVALID || op.mem.index != X86_REG_INVALID )
+                        return false;
+
+                    result.signature += "[";
+
+                    if ( op.mem.base == X86_REG_RIP )
+                    {
+                        // Capture the referenced rva.
+                        //
+                        result.signature += "T";
+                        result.thunks.push_back( ins.address + ins.size + op.mem.disp );
+                    }
+                    else if ( op.mem.base == X86_REG_RSP )
+                    {
+                        // Stack offsets are part of the shape.
+                        //
+                        result.signature += op.mem.disp < 0 ? vtil::format::str( "rsp-0x%llx", -op.mem.disp ) : vtil::format::str( "rsp+0x%llx", op.mem.disp );
+                    }
+                    else if ( op.mem.base != X86_REG_INVALID )
+                    {
+                        if ( !append_register( op.mem.base ) )
+                            return false;
+                        result.signature += "+";
+                        append_constant( op.mem.disp );
+                    }
+                    else
+                    {
+                        append_constant( op.mem.disp );
+                    }
+
+                    result.signature += "]";
+
+                    // Only qword accesses are part of the known shapes; tag any other size.
+                    //
+                    if ( op.size != 8 && ins.id != X86_INS_LEA )
+                        result.signature += vtil::format::str( ":%d", op.size );
+                    return true;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        // Appends the given instruction, returning false if it cannot be normalized.
+        //
+        bool append( const compact_instruction& ins )
+        {
+            switch ( ins.id )
+            {
+                // Instructions which only affect flags. None of the known shapes consume flags,
+                // so these are pure mutation.
+                //
+                case X86_INS_NOP:
+                case X86_INS_CMP:
+                case X86_INS_TEST:
+                case X86_INS_BT:
+                case X86_INS_CLC:
+                case X86_INS_STC:
+                case X86_INS_CMC:
+                    return true;
+
+                // Moves of a register to itself. Only the 64-bit forms are no-ops, as 32-bit writes zero the upper half.
+                //
+                case X86_INS_MOV:
+                case X86_INS_XCHG:
+                    if ( ins.operand_count() == 2 && ins.operand_type( 0 ) == X86_OP_REG && ins.operand_type( 1 ) == X86_OP_REG &&
+                         ins.operand( 0 ).reg == ins.operand( 1 ).reg && get_register_info( ins.operand( 0 ).reg ).size == 8 )
+                        return true;
+                    break;
+
+                // lea reg, [reg].
+                //
+                case X86_INS_LEA:
+                {
+                    const cs_x86_op& src = ins.operand( 1 );
+                    if ( ins.operand( 0 ).reg == src.mem.base && src.mem.index == X86_REG_INVALID && src.mem.disp == 0 &&
+                         src.mem.segment == X86_REG_INVALID && get_register_info( src.mem.base ).size == 8 )
+                        return true;
+                    break;
+                }
+            }
+
+            const char* mnemonic = get_mnemonic( ins.id );
+            if ( !mnemonic )
+            {
+                // Canonicalize additions of constants: add/sub/inc/dec become lea for registers and add for memory.
+                //
+                int64_t addend;
+                switch ( ins.id )
+                {
+                    case X86_INS_SUB:
+                        if ( ins.operand_count() != 2 || ins.operand_type( 1 ) != X86_OP_IMM )
+                            return false;
+                        addend = -ins.operand( 1 ).imm;
+                        break;
+                    case X86_INS_INC:
+                        addend = 1;
+                        break;
+                    case X86_INS_DEC:
+                        addend = -1;
+                        break;
+                    default:
+                        return false;
+                }
+                return append_addition( ins, addend );
+            }
+
+            if ( ins.id == X86_INS_ADD )
+            {
+                if ( ins.operand_count() != 2 || ins.operand_type( 1 ) != X86_OP_IMM )
+                    return false;
+                return append_addition( ins, ins.operand( 1 ).imm );
+            }
+
+            if ( !result.signature.empty() )
+                result.signature += ";";
+            result.signature += mnemonic;
+
+            // The immediate of a RET is part of the shape.
+            //
+            if ( ins.id == X86_INS_RET )
+            {
+                if ( ins.operand_count() == 1 )
+                    result.signature += vtil::format::str( " 0x%llx", ins.operand( 0 ).imm );
+                return true;
+            }
+
+            // Exchanges are commutative; place the register first.
+            //
+            int first = 0;
+            if ( ins.id == X86_INS_XCHG && ins.operand_count() == 2 && ins.operand_type( 0 ) != X86_OP_REG )
+                first = 1;
+
+            for ( int i = 0; i < ins.operand_count(); i++ )
+            {
+                result.signature += i == 0 ? " " : ",";
+                if ( !append_operand( ins.operand( ( i + first ) % ins.operand_count() ), ins ) )
+                    return false;
+            }
+            return true;
+        }
+
+        // Appends the addition of a constant to the first operand of the given instruction.
+        //
+        bool append_addition( const compact_instruction& ins, int64_t addend )
+        {
+            const cs_x86_op& dst = ins.operand( 0 );
+
+            if ( !result.signature.empty() )
+                result.signature += ";";
+
+            if ( dst.type == X86_OP_REG )
+            {
+                if ( get_register_info( dst.reg ).size != 8 )
+                    return false;
+
+                result.signature += "lea ";
+                if ( !append_register( dst.reg ) )
+                    return false;
+                result.signature += ",[";
+                append_register( dst.reg );
+                result.signature += "+";
+                append_constant( addend );
+                result.signature += "]";
+                return true;
+            }
+
+            result.signature += "add ";
+            if ( !append_operand( dst, ins ) )
+                return false;
+            result.signature += ",";
+            append_constant( addend );
+            return true;
+        }
+    };
+
+    // Normalizes the given stream, returning empty {} if it contains an operand form that cannot be normalized.
+    //
+    std::optional<normalized_stub> normalize_stub( const compact_stream& stream )
+    {
+        stub_normalizer normalizer;
+
+        for ( const compact_instruction& ins : stream )
+            if ( !normalizer.append( ins ) )
+                return {};
+
+        return std::move( normalizer.result );
+    }
+
+    // The table of known stub shapes.
+    //
+    const std::vector<stub_template>& stub_classifier::templates()
+    {
+        return stub_templates;
+    }
+
+    stub_classifier::stub_classifier()
+        : hits( stub_templates.size() )
+    {}
+
+    // Matches the stream against the known shapes, returning empty {} if none match.
+    //
+    std::optional<import_stub_analysis> stub_classifier::classify( const compact_stream& stream )
+    {
+        // Index the templates by signature.
+        //
+        static const std::unordered_map<std::string, size_t> template_index = [ ] ()
+        {
+            std::unordered_map<std::string, size_t> index;
+            for ( size_t i = 0; i < stub_templates.size(); i++ )
+                index.emplace( stub_templates[ i ].signature, i );
+            return index;
+        }();
+
+        std::optional<normalized_stub> normalized = normalize_stub( stream );
+        if ( !normalized )
+        {
+            unmatched++;
+            return {};
+        }
+
+        auto it = template_index.find( normalized->signature );
+        if ( it == template_index.end() )
+        {
+            unmatched++;
+            return {};
+        }
+
+        const stub_template& shape = stub_templates[ it->second ];
+        hits[ it->second ]++;
+
+        // Pull the analysis straight from the captured operands.
+        //
+        import_stub_analysis analysis;
+        analysis.thunk_rva = normalized->thunks[ shape.thunk_capture ];
+        analysis.dest_offset = ( uintptr_t )normalized->constants[ shape.constant_capture ];
+        analysis.stack_adjustment = shape.stack_adjustment;
+        analysis.padding = shape.padding_capture >= 0 && normalized->constants[ shape.padding_capture ] != 0;
+        analysis.is_jmp = shape.is_jmp;
+        return analysis;
+    }
+
+    // Verifies a classification against analyze_import_stub, logging and counting any disagreement.
+    // Returns the VTIL analysis.
+    //
+    std::optional<import_stub_analysis> stub_classifier::verify( const compact_stream& stream, const import_stub_analysis& classification )
+    {
+        std::optional<import_stub_analysis> reference = analyze_import_stub( stream );
+        if ( reference != classification )
+        {
+            disagreements++;
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Classifier disagrees with VTIL for stub @ RVA 0x%llx: classifier [%s], VTIL [%s]\r\n", stream.rva(), describe_analysis( classification ), describe_analysis( reference ) );
+        }
+
+        return reference;
+    }
+}
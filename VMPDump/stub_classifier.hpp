@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "stub_analysis.hpp"
+
+namespace vmpdump
+{
+    // A candidate stream reduced to its shape.
+    // No-op mutation is dropped, general purpose registers are renamed to r0, r1, ... in order of appearance,
+    // and every constant is replaced by a placeholder whose value is captured.
+    //
+    struct normalized_stub
+    {
+        // The shape, e.g. "push r0;mov r0,[T];lea r0,[r0+#];xchg r0,[rsp+0x0];ret".
+        // [T] is a rip-relative memory operand, # is any other constant.
+        //
+        std::string signature;
+
+        // The rvas referenced by the [T] placeholders, in order.
+        //
+        std::vector<uint64_t> thunks;
+
+        // The values of the # placeholders, in order.
+        //
+        std::vector<int64_t> constants;
+    };
+
+    // Normalizes the given stream, returning empty {} if it contains an operand form that cannot be normalized.
+    //
+    std::optional<normalized_stub> normalize_stub( const compact_stream& stream );
+
+    // A known import stub shape, along with the analysis it implies.
+    //
+    struct stub_template
+    {
+        // The name of the template, for reporting.
+        //
+        const char* name;
+
+        // The normalized signature of the template.
+        //
+        const char* signature;
+
+        // The index of the [T] placeholder holding the thunk.
+        //
+        int thunk_capture;
+
+        // The index of the # placeholder added to the thunk value.
+        //
+        int constant_capture;
+
+        // The index of the # placeholder added to the return address, or -1 if the template has none.
+        //
+        int padding_capture;
+
+        // The fixed properties of the template.
+        //
+        int32_t stack_adjustment;
+        bool is_jmp;
+    };
+
+    // Classifies candidate streams against a table of known VMP import stub shapes,
+    // extracting the analysis straight from the matched operands.
+    //
+    class stub_classifier
+    {
+    private:
+        // Per-template hit counters, indexed like the template table.
+        //
+        std::vector<std::atomic<uint64_t>> hits;
+
+        // Counters.
+        //
+        std::atomic<uint64_t> unmatched = 0;
+        std::atomic<uint64_t> disagreements = 0;
+
+    public:
+        // The table of known stub shapes.
+        //
+        static const std::vector<stub_template>& templates();
+
+        stub_classifier();
+
+        // Matches the stream against the known shapes, returning empty {} if none match.
+        //
+        std::optional<import_stub_analysis> classify( const compact_stream& stream );
+
+        // Verifies a classification against analyze_import_stub, logging and counting any disagreement.
+        // Returns the VTIL analysis.
+        //
+        std::optional<import_stub_analysis> verify( const compact_stream& stream, const import_stub_analysis& classification );
+
+        // Statistics.
+        //
+        inline uint64_t hit_count( size_t template_index ) const { return hits[ template_index ]; }
+        inline uint64_t unmatched_count() const { return unmatched; }
+        inline uint64_t disagreement_count() const { return disagreements; }
+    };
+}
@@ -0,0 +1,131 @@
+#include "stub_clusters.hpp"
+#include <algorithm>
+#include <utility>
+#include <vtil/common>
+
+namespace vmpdump
+{
+    // Counts a new member of the cluster of the given stub, returning the rule to derive its analysis with,
+    // or empty {} if it must be analyzed in full, which it always must when verifying.
+    //
+    std::optional<cluster_rule> stub_clusters::admit( const compact_stream& stream, const normalized_stub& stub, bool verifying )
+    {
+        std::lock_guard _g( lock );
+
+        cluster& entry = clusters[ stub.signature ];
+        entry.members++;
+
+        if ( entry.opaque || !entry.rule || entry.confirmations < confirm_count || verifying )
+            return {};
+
+        if ( entry.members % spot_check_interval == 0 )
+        {
+            spot_checks++;
+            return {};
+        }
+
+        entry.derived_members.push_back( stream.rva() );
+        return entry.rule;
+    }
+
+    // Records the full analysis of a member, learning the cluster's rule from it or checking the rule against it.
+    //
+    void stub_clusters::record( const compact_stream& stream, const normalized_stub& stub, const std::optional<import_stub_analysis>& analysis )
+    {
+        std::lock_guard _g( lock );
+
+        cluster& entry = clusters[ stub.signature ];
+        if ( entry.opaque )
+            return;
+
+        // The first member analyzed teaches the rule.
+        //
+        if ( !entry.rule )
+        {
+            entry.rule = learn( stub, analysis );
+            entry.opaque = !entry.rule;
+            entry.confirmations = entry.rule ? 1 : 0;
+            return;
+        }
+
+        std::optional<import_stub_analysis> derived_analysis = derive( *entry.rule, stub );
+        if ( derived_analysis == analysis )
+        {
+            entry.confirmations++;
+            return;
+        }
+
+        // The shape does not determine the analysis after all; analyze every later member in full, and the derived ones again.
+        //
+        disagreements++;
+        entry.rule.reset();
+        entry.opaque = true;
+        invalidated.insert( invalidated.end(), entry.derived_members.begin(), entry.derived_members.end() );
+        entry.derived_members.clear();
+        vtil::logger::log<vtil::logger::CON_RED>( "!! Stub cluster [%s] derived [%s] for stub @ RVA 0x%llx, but the analysis is [%s]\r\n", stub.signature, describe_analysis( derived_analysis ), stream.rva(), describe_analysis( analysis ) );
+    }
+
+    // Derives the analysis of a stub from its cluster's rule.
+    //
+    std::optional<import_stub_analysis> stub_clusters::derive( const cluster_rule& rule, const normalized_stub& stub )
+    {
+        if ( !rule.is_stub || rule.thunk_capture >= stub.thunks.size() || rule.constant_capture >= stub.constants.size() )
+            return {};
+
+        import_stub_analysis analysis;
+        analysis.thunk_rva = stub.thunks[ rule.thunk_capture ];
+        analysis.dest_offset = ( uintptr_t )stub.constants[ rule.constant_capture ];
+        analysis.stack_adjustment = rule.stack_adjustment;
+        analysis.padding = rule.padding;
+        analysis.is_jmp = rule.is_jmp;
+        return analysis;
+    }
+
+    // Learns the rule of a cluster from the full analysis of one of its members, returning empty {} if the analysis
+    // cannot be derived from the member's operands.
+    //
+    std::optional<cluster_rule> stub_clusters::learn( const normalized_stub& stub, const std::optional<import_stub_analysis>& analysis )
+    {
+        // Candidates of a shape which is not a stub are not stubs either, whatever their operands.
+        //
+        if ( !analysis )
+            return cluster_rule { false };
+
+        // Find the operands the thunk and the destination offset were taken from. Should several operands match,
+        // the first is assumed, and the confirmations catch a wrong guess.
+        //
+        auto thunk = std::find( stub.thunks.begin(), stub.thunks.end(), analysis->thunk_rva );
+        if ( thunk == stub.thunks.end() )
+            return {};
+
+        auto constant = std::find_if( stub.constants.begin(), stub.constants.end(), [ & ] ( int64_t value ) { return ( uintptr_t )value == analysis->dest_offset; } );
+        if ( constant == stub.constants.end() )
+            return {};
+
+        return cluster_rule
+        {
+            true,
+            ( size_t )( thunk - stub.thunks.begin() ),
+            ( size_t )( constant - stub.constants.begin() ),
+            analysis->stack_adjustment,
+            analysis->padding,
+            analysis->is_jmp
+        };
+    }
+
+    // Returns the rvas of the members derived from rules which were dropped since the last call, and forgets them.
+    //
+    std::vector<uint64_t> stub_clusters::take_invalidated()
+    {
+        std::lock_guard _g( lock );
+        return std::exchange( invalidated, {} );
+    }
+
+    // Statistics.
+    //
+    size_t stub_clusters::cluster_count()
+    {
+        std::lock_guard _g( lock );
+        return clusters.size();
+    }
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "stub_classifier.hpp"
+
+namespace vmpdump
+{
+    // How the analysis of a cluster's members is derived from their captured operands.
+    //
+    struct cluster_rule
+    {
+        // Whether the members are import stubs at all.
+        //
+        bool is_stub;
+
+        // The index of the [T] placeholder holding the thunk, and of the # placeholder holding the destination offset.
+        //
+        size_t thunk_capture;
+        size_t constant_capture;
+
+        // The properties shared by every member.
+        //
+        int32_t stack_adjustment;
+        bool padding;
+        bool is_jmp;
+    };
+
+    // Groups candidate streams into clusters by their normalized shape, as produced by normalize_stub, so that a single
+    // full analysis covers every stub of a shape, which differ only in their thunks, constants and registers.
+    //
+    // The first members of each cluster are analyzed in full, and the operands holding the thunk and the destination offset
+    // are identified from the first. Once confirm_count full analyses agree with what the rule derives, the analysis of the
+    // rest is derived by substituting their operands, except for every spot_check_interval-th member, which is still
+    // analyzed in full. If a full analysis ever disagrees, the rule is dropped, and every later member is analyzed in full.
+    // The members whose analysis was derived from a dropped rule may have been given a wrong one, so they are handed back
+    // by take_invalidated, to be analyzed again. When verifying, nothing is derived: every member is analyzed in full and
+    // checked against the rule.
+    //
+    class stub_clusters
+    {
+    public:
+        static constexpr uint64_t confirm_count = 2;
+        static constexpr uint64_t spot_check_interval = 64;
+
+    private:
+        // A single cluster.
+        //
+        struct cluster
+        {
+            // The number of members seen so far.
+            //
+            uint64_t members = 0;
+
+            // The rule, and the number of full analyses which agreed with it.
+            //
+            std::optional<cluster_rule> rule;
+            uint64_t confirmations = 0;
+
+            // Set if no rule could be derived, or a full analysis disagreed with it.
+            //
+            bool opaque = false;
+
+            // The rvas of the members whose analysis was derived from the rule.
+            //
+            std::vector<uint64_t> derived_members;
+        };
+
+        // Lock guarding the clusters. Analyses are run without holding it.
+        //
+        std::mutex lock;
+
+        // Map of { normalized signature, cluster }.
+        //
+        std::unordered_map<std::string, cluster> clusters;
+
+        // The rvas of the members derived from rules which were dropped since take_invalidated was last called.
+        //
+        std::vector<uint64_t> invalidated;
+
+        // Counters.
+        //
+        std::atomic<uint64_t> derived = 0;
+        std::atomic<uint64_t> analyzed = 0;
+        std::atomic<uint64_t> spot_checks = 0;
+        std::atomic<uint64_t> disagreements = 0;
+
+        // Counts a new member of the cluster of the given stub, returning the rule to derive its analysis with,
+        // or empty {} if it must be analyzed in full, which it always must when verifying.
+        //
+        std::optional<cluster_rule> admit( const compact_stream& stream, const normalized_stub& stub, bool verifying );
+
+        // Records the full analysis of a member, learning the cluster's rule from it or checking the rule against it.
+        //
+        void record( const compact_stream& stream, const normalized_stub& stub, const std::optional<import_stub_analysis>& analysis );
+
+    public:
+        // Returns the analysis of the stream, either derived from its cluster, or by invoking full_analysis.
+        // If verifying, full_analysis is always invoked, and any disagreement with the cluster's rule drops it.
+        //
+        template<typename F>
+        std::optional<import_stub_analysis> analyze( const compact_stream& stream, F&& full_analysis, bool verifying = false )
+        {
+            std::optional<normalized_stub> stub = normalize_stub( stream );
+            if ( !stub )
+            {
+                analyzed++;
+                return full_analysis();
+            }
+
+            if ( std::optional<cluster_rule> rule = admit( stream, *stub, verifying ) )
+            {
+                derived++;
+                return derive( *rule, *stub );
+            }
+
+            std::optional<import_stub_analysis> analysis = full_analysis();
+            analyzed++;
+            record( stream, *stub, analysis );
+            return analysis;
+        }
+
+        // Derives the analysis of a stub from its cluster's rule.
+        //
+        static std::optional<import_stub_analysis> derive( const cluster_rule& rule, const normalized_stub& stub );
+
+        // Learns the rule of a cluster from the full analysis of one of its members, returning empty {} if the analysis
+        // cannot be derived from the member's operands.
+        //
+        static std::optional<cluster_rule> learn( const normalized_stub& stub, const std::optional<import_stub_analysis>& analysis );
+
+        // Returns the rvas of the members derived from rules which were dropped since the last call, and forgets them.
+        //
+        std::vector<uint64_t> take_invalidated();
+
+        // Statistics.
+        //
+        size_t cluster_count();
+        inline uint64_t derived_count() const { return derived; }
+        inline uint64_t analyzed_count() const { return analyzed; }
+        inline uint64_t spot_check_count() const { return spot_checks; }
+        inline uint64_t disagreement_count() const { return disagreements; }
+    };
+}
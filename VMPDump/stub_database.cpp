@@ -0,0 +1,275 @@
+#include "stub_database.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace vmpdump
+{
+    using namespace stub_database_format;
+
+    // FNV-1a, over the stub's instruction bytes and their offsets from the stub.
+    //
+    static constexpr uint64_t fnv_offset_basis = 0xCBF29CE484222325;
+    static constexpr uint64_t fnv_prime = 0x100000001B3;
+
+    static uint64_t fnv1a( uint64_t hash, const void* bytes, size_t size )
+    {
+        for ( size_t i = 0; i < size; i++ )
+            hash = ( hash ^ ( ( const uint8_t* )bytes )[ i ] ) * fnv_prime;
+        return hash;
+    }
+
+    // An independent hash confirming a match of the key, mixing each byte with a multiply and xorshift.
+    //
+    static uint64_t mix( uint64_t hash, const void* bytes, size_t size )
+    {
+        for ( size_t i = 0; i < size; i++ )
+        {
+            hash = ( hash + ( ( const uint8_t* )bytes )[ i ] + 1 ) * 0x9E3779B97F4A7C15;
+            hash ^= hash >> 29;
+        }
+        return hash;
+    }
+
+    // Builds the record of the given stream, keyed and with its thunk relative to the stream, but without any analysis.
+    //
+    static record make_record( const compact_stream& stream )
+    {
+        record result = {};
+        result.key = fnv_offset_basis;
+        for ( const compact_instruction& ins : stream )
+        {
+            uint32_t offset = ( uint32_t )( ins.address - stream.rva() );
+            result.key = fnv1a( result.key, &offset, sizeof( offset ) );
+            result.key = fnv1a( result.key, &ins.size, sizeof( ins.size ) );
+            result.key = fnv1a( result.key, ins.bytes, ins.size );
+            result.check = mix( result.check, &offset, sizeof( offset ) );
+            result.check = mix( result.check, &ins.size, sizeof( ins.size ) );
+            result.check = mix( result.check, ins.bytes, ins.size );
+            result.byte_count += ins.size;
+        }
+        result.instruction_count = ( uint8_t )stream.size();
+        return result;
+    }
+
+    // Returns whether the record was made from a stream with the same shape as the given key record.
+    //
+    static bool matches( const record& entry, const record& key )
+    {
+        return entry.key == key.key && entry.check == key.check && entry.byte_count == key.byte_count && entry.instruction_count == key.instruction_count;
+    }
+
+    // Converts a record back to the analysis of a stream at the given rva.
+    //
+    static std::optional<import_stub_analysis> to_analysis( const record& entry, uint64_t rva )
+    {
+        if ( !( entry.flags & record_stub ) )
+            return {};
+
+        import_stub_analysis analysis;
+        analysis.thunk_rva = ( uintptr_t )( rva + entry.thunk_delta );
+        analysis.dest_offset = ( uintptr_t )entry.dest_offset;
+        analysis.stack_adjustment = entry.stack_adjustment;
+        analysis.padding = entry.flags & record_padding;
+        analysis.is_jmp = entry.flags & record_jmp;
+        return analysis;
+    }
+
+    // Opens the database at the given path, holding at most capacity records.
+    // If it does not exist or is invalid, the database starts out empty.
+    //
+    std::shared_ptr<stub_database> stub_database::open( const std::string& path, size_t capacity )
+    {
+        std::shared_ptr<stub_database> result = std::make_shared<stub_database>();
+        result->path = path;
+        result->capacity = capacity;
+        result->file = mapped_file::open( path, map_mode::read_only );
+        if ( result->file && !result->load() )
+        {
+            result->records = nullptr;
+            result->record_count = 0;
+            result->file = nullptr;
+        }
+        return result;
+    }
+
+    // Validates and indexes the mapped file, returning false if it is invalid or of another version.
+    //
+    bool stub_database::load()
+    {
+        const uint8_t* bytes = file->data();
+        size_t size = file->size();
+
+        if ( size < sizeof( header ) )
+            return false;
+
+        const header* file_header = ( const header* )bytes;
+        if ( file_header->magic != magic || file_header->version != version )
+            return false;
+
+        if ( file_header->record_count > ( size - sizeof( header ) ) / sizeof( record ) )
+            return false;
+
+        // Lookups are binary searches, so the records must be sorted.
+        //
+        const record* entries = ( const record* )( bytes + sizeof( header ) );
+        for ( uint64_t i = 1; i < file_header->record_count; i++ )
+        {
+            if ( entries[ i - 1 ].key > entries[ i ].key )
+                return false;
+        }
+
+        records = entries;
+        record_count = file_header->record_count;
+        generation = file_header->generation;
+        used = std::make_unique<std::atomic<bool>[]>( record_count );
+        return true;
+    }
+
+    // Returns the cached analysis of the stream: empty {} on a miss, or the analysis, which is itself empty {}
+    // if the stream is not a stub.
+    //
+    std::optional<std::optional<import_stub_analysis>> stub_database::find( const compact_stream& stream )
+    {
+        record key = make_record( stream );
+
+        // Search the mapped records first, which needs no locking.
+        //
+        const record* end = records + record_count;
+        for ( const record* it = std::lower_bound( records, end, key.key, [ ] ( const record& entry, uint64_t key ) { return entry.key < key; } );
+              it != end && it->key == key.key; it++ )
+        {
+            if ( matches( *it, key ) )
+            {
+                used[ it - records ].store( true, std::memory_order_relaxed );
+                hits++;
+                return to_analysis( *it, stream.rva() );
+            }
+        }
+
+        // Then the records added by this run, as the same stub may be called through many targets.
+        //
+        {
+            std::shared_lock _g( pending_lock );
+            auto it = pending.find( key.key );
+            if ( it != pending.end() && matches( it->second, key ) )
+            {
+                hits++;
+                return to_analysis( it->second, stream.rva() );
+            }
+        }
+
+        misses++;
+        return {};
+    }
+
+    // Adds the analysis of the stream, or a negative verdict if it is empty {}.
+    // Must only be given analyses VTIL produced or confirmed, as they are trusted by later runs.
+    //
+    void stub_database::store( const compact_stream& stream, const std::optional<import_stub_analysis>& analysis )
+    {
+        record entry = make_record( stream );
+        if ( analysis )
+        {
+            entry.flags = record_stub | ( analysis->padding ? record_padding : 0 ) | ( analysis->is_jmp ? record_jmp : 0 );
+            entry.thunk_delta = ( int64_t )( analysis->thunk_rva - stream.rva() );
+            entry.dest_offset = analysis->dest_offset;
+            entry.stack_adjustment = analysis->stack_adjustment;
+        }
+
+        std::unique_lock _g( pending_lock );
+        pending.emplace( entry.key, entry );
+    }
+
+    // Writes the database back to its path, if any records were added, or any were used by this run, so that eviction
+    // ranks records by when they were last used rather than by when they were added.
+    //
+    bool stub_database::save()
+    {
+        std::unique_lock _g( pending_lock );
+
+        uint64_t next_generation = generation + 1;
+        bool stamped = false;
+        for ( size_t i = 0; i < record_count && !stamped; i++ )
+            stamped = used[ i ].load( std::memory_order_relaxed ) && records[ i ].last_used < next_generation;
+        if ( pending.empty() && !stamped )
+            return true;
+
+        // Gather the records to write: the mapped records, stamped if used by this run, and the pending ones.
+        //
+        std::vector<record> output;
+        output.reserve( record_count + pending.size() );
+        for ( size_t i = 0; i < record_count; i++ )
+        {
+            if ( pending.contains( records[ i ].key ) )
+                continue;
+
+            output.push_back( records[ i ] );
+            if ( used[ i ].load( std::memory_order_relaxed ) )
+                output.back().last_used = ( uint32_t )next_generation;
+        }
+        for ( auto& [key, entry] : pending )
+        {
+            output.push_back( entry );
+            output.back().last_used = ( uint32_t )next_generation;
+        }
+
+        // Evict the least recently used records past the capacity.
+        //
+        if ( output.size() > capacity )
+        {
+            std::nth_element( output.begin(), output.begin() + capacity, output.end(), [ ] ( const record& a, const record& b ) { return a.last_used > b.last_used; } );
+            evicted += output.size() - capacity;
+            output.resize( capacity );
+        }
+        std::sort( output.begin(), output.end(), [ ] ( const record& a, const record& b ) { return a.key < b.key; } );
+
+        // Write to a temporary file of our own first, so that readers never see a partial database,
+        // and concurrent writers never write into each other's file.
+        //
+        std::string temporary_path = mapped_file::temporary_path( path );
+        {
+            std::shared_ptr<mapped_file> temporary = mapped_file::create( temporary_path, sizeof( header ) + output.size() * sizeof( record ) );
+            if ( !temporary )
+            {
+                std::error_code error;
+                std::filesystem::remove( temporary_path, error );
+                return false;
+            }
+
+            header file_header = { magic, version, output.size(), next_generation };
+            memcpy( temporary->data(), &file_header, sizeof( file_header ) );
+            memcpy( temporary->data() + sizeof( file_header ), output.data(), output.size() * sizeof( record ) );
+        }
+
+        // Replace the database. Lookups copy their results out, so the old mapping can be released first.
+        //
+        records = nullptr;
+        record_count = 0;
+        used = nullptr;
+        file = nullptr;
+
+        // Should the rename fail, drop our file and keep using whatever database is in place.
+        //
+        std::error_code error;
+        std::filesystem::rename( temporary_path, path, error );
+        bool renamed = !error;
+        if ( !renamed )
+            std::filesystem::remove( temporary_path, error );
+
+        file = mapped_file::open( path, map_mode::read_only );
+        if ( !file || !load() )
+        {
+            records = nullptr;
+            record_count = 0;
+            file = nullptr;
+            return false;
+        }
+        if ( !renamed )
+            return false;
+
+        pending.clear();
+        return true;
+    }
+}
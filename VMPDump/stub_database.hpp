@@ -0,0 +1,136 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include "mapped_file.hpp"
+#include "stub_analysis.hpp"
+
+namespace vmpdump
+{
+    // The on-disk layout of the stub database. Records are sorted by key.
+    //
+    //      header
+    //      record[ header.record_count ]
+    //
+    namespace stub_database_format
+    {
+        // 'SADB'.
+        //
+        static constexpr uint32_t magic = 0x42444153;
+        static constexpr uint32_t version = 2;
+
+        struct header
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t record_count;
+
+            // Incremented on every save; records store the generation they were last used in.
+            //
+            uint64_t generation;
+        };
+
+        enum record_flags : uint8_t
+        {
+            record_stub = 1 << 0,
+            record_padding = 1 << 1,
+            record_jmp = 1 << 2,
+        };
+
+        // The analysis of a stub, or a negative verdict if record_stub is not set. The thunk is stored relative
+        // to the stub, so that the record applies wherever the same stub lands.
+        // The key is an FNV-1a hash of the stub; check is an independent hash of it, confirming a match.
+        //
+        struct record
+        {
+            uint64_t key;
+            uint64_t check;
+            uint32_t byte_count;
+            uint8_t instruction_count;
+            uint8_t flags;
+            uint16_t reserved;
+            int64_t thunk_delta;
+            uint64_t dest_offset;
+            int32_t stack_adjustment;
+            uint32_t last_used;
+        };
+    }
+
+    // A persistent cache of stub analyses across runs, keyed by a hash of the stub's instruction bytes and of their
+    // offsets from the stub, which is where the jumps it follows put them. Identical stubs thus hit the cache in any
+    // build, wherever they land. A match must also agree on a second, independent hash, so that a collision of the
+    // key alone never returns the analysis of another stub. Only analyses VTIL produced or confirmed are stored.
+    //
+    // The file is mapped read-only and searched in place, without locking, and is only ever replaced as a whole by renaming
+    // a temporary file of the writer's own over it, so any number of readers, in this process or others, see either the old
+    // or the new file. Of concurrent writers, the last to rename wins. New records are kept
+    // in memory and written out by save, along with the generation each record was last used in. Once the database
+    // holds more records than its capacity, the least recently used ones are evicted.
+    //
+    class stub_database
+    {
+    public:
+        static constexpr size_t default_capacity = 1 << 20;
+
+    private:
+        // The path of the database, its capacity in records, and its mapping if it existed and was valid.
+        //
+        std::string path;
+        size_t capacity = default_capacity;
+        std::shared_ptr<mapped_file> file;
+
+        // The records in the mapped file, and whether each was used by this run.
+        //
+        const stub_database_format::record* records = nullptr;
+        size_t record_count = 0;
+        uint64_t generation = 0;
+        std::unique_ptr<std::atomic<bool>[]> used;
+
+        // The records added since the database was opened, by key.
+        //
+        mutable std::shared_mutex pending_lock;
+        std::unordered_map<uint64_t, stub_database_format::record> pending;
+
+        // Statistics.
+        //
+        std::atomic<uint64_t> hits = { 0 };
+        std::atomic<uint64_t> misses = { 0 };
+        std::atomic<uint64_t> evicted = { 0 };
+
+        // Validates and indexes the mapped file, returning false if it is invalid or of another version.
+        //
+        bool load();
+
+    public:
+        // Opens the database at the given path, holding at most capacity records.
+        // If it does not exist or is invalid, the database starts out empty.
+        //
+        static std::shared_ptr<stub_database> open( const std::string& path, size_t capacity = default_capacity );
+
+        // Returns the cached analysis of the stream: empty {} on a miss, or the analysis, which is itself empty {}
+        // if the stream is not a stub.
+        //
+        std::optional<std::optional<import_stub_analysis>> find( const compact_stream& stream );
+
+        // Adds the analysis of the stream, or a negative verdict if it is empty {}.
+        // Must only be given analyses VTIL produced or confirmed, as they are trusted by later runs.
+        //
+        void store( const compact_stream& stream, const std::optional<import_stub_analysis>& analysis );
+
+        // Writes the database back to its path, if any records were added, or any were used by this run, so that eviction
+        // ranks records by when they were last used rather than by when they were added.
+        // Must not be called while lookups are in flight, as the mapping they search is replaced.
+        //
+        bool save();
+
+        inline uint64_t hit_count() const { return hits.load(); }
+        inline uint64_t miss_count() const { return misses.load(); }
+        inline uint64_t evicted_count() const { return evicted.load(); }
+        inline size_t size() const { std::shared_lock _g( pending_lock ); return record_count + pending.size(); }
+    };
+}
@@ -0,0 +1,576 @@
+#include "stub_emulator.hpp"
+#include "registers.hpp"
+#include <vector>
+#include <vtil/common>
+
+namespace vmpdump
+{
+    // A value in the emulated machine state.
+    // Every value is either unknown, or of the form origin + offset.
+    //
+    struct emulated_value
+    {
+        enum kind_t : uint8_t
+        {
+            // Nothing is known about the value.
+            //
+            unknown,
+
+            // The constant offset.
+            //
+            constant,
+
+            // The initial stack pointer + offset.
+            //
+            stack_pointer,
+
+            // The initial value of the stack slot at [initial stack pointer + origin] + offset.
+            //
+            initial_stack,
+
+            // The value of the thunk at rva origin + offset.
+            //
+            thunk,
+        };
+
+        kind_t kind = unknown;
+        int64_t origin = 0;
+        int64_t offset = 0;
+
+        static emulated_value make( kind_t kind, int64_t origin, int64_t offset ) { return { kind, origin, offset }; }
+        static emulated_value make_constant( int64_t value ) { return { constant, 0, value }; }
+
+        inline bool is( kind_t k ) const { return kind == k; }
+    };
+
+    // Adds two values. Only sums where at most one side is non-constant are tracked.
+    //
+    static emulated_value add_values( const emulated_value& a, const emulated_value& b )
+    {
+        if ( a.is( emulated_value::unknown ) || b.is( emulated_value::unknown ) )
+            return {};
+        if ( b.is( emulated_value::constant ) )
+            return emulated_value::make( a.kind, a.origin, a.offset + b.offset );
+        if ( a.is( emulated_value::constant ) )
+            return emulated_value::make( b.kind, b.origin, b.offset + a.offset );
+        return {};
+    }
+
+    // Subtracts two values. Differences of values sharing an origin are constant.
+    //
+    static emulated_value sub_values( const emulated_value& a, const emulated_value& b )
+    {
+        if ( a.is( emulated_value::unknown ) || b.is( emulated_value::unknown ) )
+            return {};
+        if ( b.is( emulated_value::constant ) )
+            return emulated_value::make( a.kind, a.origin, a.offset - b.offset );
+        if ( a.kind == b.kind && a.origin == b.origin )
+            return emulated_value::make_constant( a.offset - b.offset );
+        return {};
+    }
+
+    // The index of RSP within the emulated registers.
+    //
+    static constexpr int rsp_index = 4;
+
+    // The emulated machine state.
+    //
+    struct machine_state
+    {
+        // The general purpose registers.
+        //
+        emulated_value registers[ 16 ];
+
+        // The qwords written to the stack, as { offset from the initial stack pointer, value }.
+        //
+        std::vector<std::pair<int64_t, emulated_value>> stack;
+
+        // Set once an unmodeled operation was encountered.
+        //
+        bool unsupported = false;
+
+        machine_state()
+        {
+            registers[ rsp_index ] = emulated_value::make( emulated_value::stack_pointer, 0, 0 );
+        }
+
+        // Reads the stack at the given offset from the initial stack pointer.
+        //
+        emulated_value read_stack( int64_t offset, uint8_t size )
+        {
+            for ( auto& [slot, value] : stack )
+            {
+                if ( slot == offset && size == 8 )
+                    return value;
+
+                // Partial or misaligned accesses to written slots are not modeled.
+                //
+                if ( offset < slot + 8 && slot < offset + size )
+                {
+                    unsupported = true;
+                    return {};
+                }
+            }
+
+            // Untouched slots hold their initial value.
+            //
+            if ( size == 8 )
+                return emulated_value::make( emulated_value::initial_stack, offset, 0 );
+            return {};
+        }
+
+        // Writes a qword to the stack at the given offset from the initial stack pointer.
+        //
+        void write_stack( int64_t offset, uint8_t size, const emulated_value& value )
+        {
+            if ( size != 8 )
+            {
+                unsupported = true;
+                return;
+            }
+
+            for ( auto& [slot, slot_value] : stack )
+            {
+                if ( slot == offset )
+                {
+                    slot_value = value;
+                    return;
+                }
+
+                if ( offset < slot + 8 && slot < offset + 8 )
+                {
+                    unsupported = true;
+                    return;
+                }
+            }
+
+            stack.push_back( { offset, value } );
+        }
+
+        // Computes the effective address of a memory operand.
+        //
+        emulated_value effective_address( const x86_op_mem& mem, const compact_instruction& ins )
+        {
+            // Segment-relative addresses (e.g. the TEB) are not modeled.
+            //
+            if ( mem.segment != X86_REG_INVALID )
+                return {};
+
+            emulated_value address = emulated_value::make_constant( mem.disp );
+
+            if ( mem.base == X86_REG_RIP )
+                address = add_values( address, emulated_value::make_constant( ins.address + ins.size ) );
+            else if ( mem.base != X86_REG_INVALID )
+            {
+                register_info base = get_register_info( mem.base );
+                if ( base.index < 0 || base.size != 8 )
+                    return {};
+
+                address = add_values( address, registers[ base.index ] );
+            }
+
+            if ( mem.index != X86_REG_INVALID )
+            {
+                register_info index = get_register_info( mem.index );
+                if ( index.index < 0 || index.size != 8 || !registers[ index.index ].is( emulated_value::constant ) )
+                    return {};
+
+                address = add_values( address, emulated_value::make_constant( registers[ index.index ].offset * mem.scale ) );
+            }
+
+            return address;
+        }
+
+        // Reads the given operand.
+        //
+        emulated_value read( const cs_x86_op& op, const compact_instruction& ins )
+        {
+            switch ( op.type )
+            {
+                case X86_OP_IMM:
+                    return emulated_value::make_constant( op.imm );
+
+                case X86_OP_REG:
+                {
+                    register_info reg = get_register_info( op.reg );
+                    if ( reg.index < 0 )
+                        return {};
+
+                    emulated_value& value = registers[ reg.index ];
+                    if ( reg.size == 8 )
+                        return value;
+
+                    // Sub-registers are only tracked for constants.
+                    //
+                    if ( !value.is( emulated_value::constant ) )
+                        return {};
+
+                    uint64_t bits = ( uint64_t )value.offset >> ( reg.high_byte ? 8 : 0 );
+                    return emulated_value::make_constant( bits & ( ~0ull >> ( 64 - reg.size * 8 ) ) );
+                }
+
+                case X86_OP_MEM:
+                {
+                    emulated_value address = effective_address( op.mem, ins );
+
+                    if ( address.is( emulated_value::stack_pointer ) )
+                        return read_stack( address.offset, op.size );
+
+                    // A qword read from a constant address is the value of a thunk.
+                    //
+                    if ( address.is( emulated_value::constant ) && op.size == 8 )
+                        return emulated_value::make( emulated_value::thunk, address.offset, 0 );
+
+                    // Reading any other memory is harmless, but its value is unknown.
+                    //
+                    return {};
+                }
+
+                default:
+                    return {};
+            }
+        }
+
+        // Writes the given operand.
+        //
+        void write( const cs_x86_op& op, const compact_instruction& ins, const emulated_value& value )
+        {
+            switch ( op.type )
+            {
+                case X86_OP_REG:
+                {
+                    register_info reg = get_register_info( op.reg );
+
+                    // Writes to other registers (e.g. vector registers) do not affect the stub.
+                    //
+                    if ( reg.index < 0 )
+                        return;
+
+                    emulated_value& target = registers[ reg.index ];
+                    if ( reg.size == 8 )
+                    {
+                        target = value;
+                    }
+                    else if ( reg.size == 4 )
+                    {
+                        // 32-bit writes zero-extend.
+                        //
+                        target = value.is( emulated_value::constant ) ? emulated_value::make_constant( ( uint32_t )value.offset ) : emulated_value {};
+                    }
+                    else
+                    {
+                        // 8 and 16-bit writes merge into the register.
+                        //
+                        if ( !target.is( emulated_value::constant ) || !value.is( emulated_value::constant ) )
+                        {
+                            target = {};
+                        }
+                        else
+                        {
+                            uint32_t shift = reg.high_byte ? 8 : 0;
+                            uint64_t mask = ( ~0ull >> ( 64 - reg.size * 8 ) ) << shift;
+                            target = emulated_value::make_constant( ( ( uint64_t )target.offset & ~mask ) | ( ( ( uint64_t )value.offset << shift ) & mask ) );
+                        }
+                    }
+                    return;
+                }
+
+                case X86_OP_MEM:
+                {
+                    emulated_value address = effective_address( op.mem, ins );
+
+                    // Only writes to the stack are modeled.
+                    //
+                    if ( address.is( emulated_value::stack_pointer ) )
+                        write_stack( address.offset, op.size, value );
+                    else
+                        unsupported = true;
+                    return;
+                }
+
+                default:
+                    unsupported = true;
+                    return;
+            }
+        }
+
+        // Returns the stack pointer offset, if the stack pointer is still known.
+        //
+        std::optional<int64_t> stack_offset()
+        {
+            emulated_value& sp = registers[ rsp_index ];
+            if ( !sp.is( emulated_value::stack_pointer ) )
+                return {};
+            return sp.offset;
+        }
+
+        // Pushes a qword onto the stack.
+        //
+        void push( const emulated_value& value )
+        {
+            std::optional<int64_t> sp = stack_offset();
+            if ( !sp )
+            {
+                unsupported = true;
+                return;
+            }
+
+            registers[ rsp_index ].offset -= 8;
+            write_stack( *sp - 8, 8, value );
+        }
+
+        // Pops a qword from the stack.
+        //
+        emulated_value pop()
+        {
+            std::optional<int64_t> sp = stack_offset();
+            if ( !sp )
+            {
+                unsupported = true;
+                return {};
+            }
+
+            emulated_value value = read_stack( *sp, 8 );
+            registers[ rsp_index ].offset += 8;
+            return value;
+        }
+    };
+
+    // Determines whether the instruction only writes registers and flags, without accessing memory implicitly.
+    // Such instructions simply clobber their written registers.
+    //
+    static bool is_register_only( uint32_t id )
+    {
+        switch ( id )
+        {
+            case X86_INS_ADC: case X86_INS_SBB: case X86_INS_IMUL:
+            case X86_INS_SHL: case X86_INS_SHR: case X86_INS_SAR: case X86_INS_ROL: case X86_INS_ROR: case X86_INS_RCL: case X86_INS_RCR:
+            case X86_INS_BSWAP: case X86_INS_BTC: case X86_INS_BTR: case X86_INS_BTS: case X86_INS_BSF: case X86_INS_BSR:
+            case X86_INS_CBW: case X86_INS_CWDE: case X86_INS_CDQE: case X86_INS_CWD: case X86_INS_CDQ: case X86_INS_CQO:
+            case X86_INS_MOVSX: case X86_INS_MOVSXD: case X86_INS_MOVZX:
+            case X86_INS_CMOVA: case X86_INS_CMOVAE: case X86_INS_CMOVB: case X86_INS_CMOVBE: case X86_INS_CMOVE: case X86_INS_CMOVG:
+            case X86_INS_CMOVGE: case X86_INS_CMOVL: case X86_INS_CMOVLE: case X86_INS_CMOVNE: case X86_INS_CMOVNO: case X86_INS_CMOVNP:
+            case X86_INS_CMOVNS: case X86_INS_CMOVO: case X86_INS_CMOVP: case X86_INS_CMOVS:
+            case X86_INS_SETA: case X86_INS_SETAE: case X86_INS_SETB: case X86_INS_SETBE: case X86_INS_SETE: case X86_INS_SETG:
+            case X86_INS_SETGE: case X86_INS_SETL: case X86_INS_SETLE: case X86_INS_SETNE: case X86_INS_SETNO: case X86_INS_SETNP:
+            case X86_INS_SETNS: case X86_INS_SETO: case X86_INS_SETP: case X86_INS_SETS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Emulates the given instruction stream, which must end in a RET.
+    //
+    emulation_result stub_emulator::emulate( const compact_stream& stream )
+    {
+        machine_state state;
+
+        for ( const compact_instruction& ins : stream )
+        {
+            switch ( ins.id )
+            {
+                // Instructions which only affect flags.
+                //
+                case X86_INS_NOP:
+                case X86_INS_CMP:
+                case X86_INS_TEST:
+                case X86_INS_BT:
+                case X86_INS_CLC:
+                case X86_INS_STC:
+                case X86_INS_CMC:
+                    break;
+
+                case X86_INS_MOV:
+                case X86_INS_MOVABS:
+                    state.write( ins.operand( 0 ), ins, state.read( ins.operand( 1 ), ins ) );
+                    break;
+
+                case X86_INS_LEA:
+                    state.write( ins.operand( 0 ), ins, state.effective_address( ins.operand( 1 ).mem, ins ) );
+                    break;
+
+                case X86_INS_ADD:
+                    state.write( ins.operand( 0 ), ins, add_values( state.read( ins.operand( 0 ), ins ), state.read( ins.operand( 1 ), ins ) ) );
+                    break;
+
+                case X86_INS_SUB:
+                    state.write( ins.operand( 0 ), ins, sub_values( state.read( ins.operand( 0 ), ins ), state.read( ins.operand( 1 ), ins ) ) );
+                    break;
+
+                case X86_INS_INC:
+                case X86_INS_DEC:
+                    state.write( ins.operand( 0 ), ins, add_values( state.read( ins.operand( 0 ), ins ), emulated_value::make_constant( ins.id == X86_INS_INC ? 1 : -1 ) ) );
+                    break;
+
+                case X86_INS_NEG:
+                case X86_INS_NOT:
+                {
+                    emulated_value value = state.read( ins.operand( 0 ), ins );
+                    if ( value.is( emulated_value::constant ) )
+                        value.offset = ins.id == X86_INS_NEG ? -value.offset : ~value.offset;
+                    else
+                        value = {};
+                    state.write( ins.operand( 0 ), ins, value );
+                    break;
+                }
+
+                case X86_INS_XOR:
+                case X86_INS_AND:
+                case X86_INS_OR:
+                {
+                    emulated_value lhs = state.read( ins.operand( 0 ), ins );
+                    emulated_value rhs = state.read( ins.operand( 1 ), ins );
+                    emulated_value result = {};
+
+                    // xor reg, reg is a common way of zeroing.
+                    //
+                    if ( ins.id == X86_INS_XOR && ins.operand_type( 0 ) == X86_OP_REG && ins.operand_type( 1 ) == X86_OP_REG && ins.operand( 0 ).reg == ins.operand( 1 ).reg )
+                        result = emulated_value::make_constant( 0 );
+                    else if ( lhs.is( emulated_value::constant ) && rhs.is( emulated_value::constant ) )
+                        result = emulated_value::make_constant( ins.id == X86_INS_XOR ? lhs.offset ^ rhs.offset : ins.id == X86_INS_AND ? lhs.offset & rhs.offset : lhs.offset | rhs.offset );
+
+                    state.write( ins.operand( 0 ), ins, result );
+                    break;
+                }
+
+                case X86_INS_XCHG:
+                {
+                    emulated_value first = state.read( ins.operand( 0 ), ins );
+                    emulated_value second = state.read( ins.operand( 1 ), ins );
+                    state.write( ins.operand( 0 ), ins, second );
+                    state.write( ins.operand( 1 ), ins, first );
+                    break;
+                }
+
+                case X86_INS_PUSH:
+                    if ( ins.operand( 0 ).size != 8 && ins.operand_type( 0 ) != X86_OP_IMM )
+                        state.unsupported = true;
+                    else
+                        state.push( state.read( ins.operand( 0 ), ins ) );
+                    break;
+
+                case X86_INS_POP:
+                    if ( ins.operand_type( 0 ) != X86_OP_REG || ins.operand( 0 ).size != 8 )
+                        state.unsupported = true;
+                    else
+                        state.write( ins.operand( 0 ), ins, state.pop() );
+                    break;
+
+                case X86_INS_PUSHFQ:
+                    state.push( {} );
+                    break;
+
+                case X86_INS_POPFQ:
+                    state.pop();
+                    break;
+
+                case X86_INS_RET:
+                {
+                    // Pop the destination and release any extra stack bytes.
+                    //
+                    emulated_value dest = state.pop();
+                    if ( ins.operand_count() != 0 )
+                        state.registers[ rsp_index ].offset += ins.operand( 0 ).imm;
+
+                    std::optional<int64_t> final_sp = state.stack_offset();
+                    if ( state.unsupported || !final_sp || dest.is( emulated_value::unknown ) )
+                        return { emulation_status::unsupported };
+
+                    // The destination must be [CONST] + CONST.
+                    //
+                    if ( !dest.is( emulated_value::thunk ) )
+                        return { emulation_status::not_stub };
+
+                    // The return address left at the final stack pointer must be an initial stack slot, optionally padded.
+                    //
+                    emulated_value retaddr = state.read_stack( *final_sp, 8 );
+                    if ( state.unsupported || !retaddr.is( emulated_value::initial_stack ) )
+                        return { emulation_status::unsupported };
+
+                    bool pad = retaddr.offset != 0;
+                    if ( pad && retaddr.offset != 1 )
+                        vtil::logger::log<vtil::logger::CON_PRP>( "** Warning: Unexpected value for padding: 0x%lx\r\n", ( uint32_t )retaddr.offset );
+
+                    // If the return address is the untouched slot the stack pointer ends at, and the stack was released
+                    // past the call's own return address, the stub is a jump.
+                    //
+                    int32_t stack_adjustment = ( int32_t )*final_sp;
+                    bool is_jmp = retaddr.origin == *final_sp && stack_adjustment >= 8;
+
+                    return { emulation_status::resolved, import_stub_analysis { ( uintptr_t )dest.origin, ( uintptr_t )dest.offset, stack_adjustment - ( is_jmp ? 8 : 0 ), pad, is_jmp } };
+                }
+
+                default:
+                {
+                    if ( !is_register_only( ins.id ) )
+                        return { emulation_status::unsupported };
+
+                    // Memory destinations are not modeled.
+                    //
+                    for ( int i = 0; i < ins.operand_count(); i++ )
+                        if ( ins.operand_type( i ) == X86_OP_MEM && ( ins.operand( i ).access & CS_AC_WRITE ) )
+                            return { emulation_status::unsupported };
+
+                    // Clobber every written general purpose register, which must not include the stack pointer.
+                    //
+                    for ( int reg = X86_REG_INVALID + 1; reg < X86_REG_ENDING; reg++ )
+                    {
+                        if ( !ins.regs_written.contains( ( x86_reg )reg ) )
+                            continue;
+
+                        register_info info = get_register_info( ( x86_reg )reg );
+                        if ( info.index == rsp_index )
+                            return { emulation_status::unsupported };
+                        if ( info.index >= 0 )
+                            state.registers[ info.index ] = {};
+                    }
+                    break;
+                }
+            }
+
+            if ( state.unsupported )
+                return { emulation_status::unsupported };
+        }
+
+        // The stream did not end in a RET.
+        //
+        return { emulation_status::unsupported };
+    }
+
+    // Analyzes the given stream, using the emulator and falling back to analyze_import_stub for unsupported streams.
+    // If differential, both are always run and any disagreement is logged and counted, with the VTIL analysis winning.
+    //
+    std::optional<import_stub_analysis> stub_emulator::analyze( const compact_stream& stream, bool differential, bool* lifted )
+    {
+        emulation_result result = emulate( stream );
+
+        switch ( result.status )
+        {
+            case emulation_status::resolved:    resolved++;    break;
+            case emulation_status::not_stub:    rejected++;    break;
+            case emulation_status::unsupported: unsupported++; break;
+        }
+
+        if ( lifted )
+            *lifted = result.status == emulation_status::unsupported || differential;
+
+        if ( result.status == emulation_status::unsupported )
+            return analyze_import_stub( stream );
+
+        if ( !differential )
+            return result.analysis;
+
+        // Run the full analysis and compare.
+        //
+        std::optional<import_stub_analysis> reference = analyze_import_stub( stream );
+        if ( reference != result.analysis )
+        {
+            disagreements++;
+
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Emulator disagrees with VTIL for stub @ RVA 0x%llx: emulator [%s], VTIL [%s]\r\n", stream.rva(), describe_analysis( result.analysis ), describe_analysis( reference ) );
+        }
+
+        return reference;
+    }
+}
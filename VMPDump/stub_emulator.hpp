@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include "stub_analysis.hpp"
+
+namespace vmpdump
+{
+    // The outcome of concretely emulating a candidate import stub.
+    //
+    enum class emulation_status
+    {
+        // The stream is a VMP import stub, and the analysis was computed.
+        //
+        resolved,
+
+        // The stream was fully emulated, and is not a VMP import stub.
+        //
+        not_stub,
+
+        // The stream uses an instruction or addressing form the emulator does not model.
+        // The result must be determined by the full VTIL analysis.
+        //
+        unsupported,
+    };
+
+    // Structure returned by the emulator.
+    //
+    struct emulation_result
+    {
+        emulation_status status;
+        std::optional<import_stub_analysis> analysis;
+    };
+
+    // A small concrete x86-64 emulator acting as a fast path for analyze_import_stub.
+    //
+    // VMP import stubs are straight-line once jumps are followed: they load a thunk, add a constant to it, shuffle
+    // it onto the stack and return into it. Instead of lifting and symbolically tracing, the stream is executed on a
+    // register/stack model whose values are either constants, offsets from the initial stack pointer, or one of
+    // a few opaque origins (the initial value of a stack slot, the value of a thunk) plus a constant.
+    //
+    class stub_emulator
+    {
+    private:
+        // Counters.
+        //
+        std::atomic<uint64_t> resolved = 0;
+        std::atomic<uint64_t> rejected = 0;
+        std::atomic<uint64_t> unsupported = 0;
+        std::atomic<uint64_t> disagreements = 0;
+
+    public:
+        // Emulates the given instruction stream, which must end in a RET.
+        //
+        emulation_result emulate( const compact_stream& stream );
+
+        // Analyzes the given stream, using the emulator and falling back to analyze_import_stub for unsupported streams.
+        // If differential, both are always run and any disagreement is logged and counted, with the VTIL analysis winning.
+        // If given, lifted is set to whether the result is the VTIL analysis.
+        //
+        std::optional<import_stub_analysis> analyze( const compact_stream& stream, bool differential = false, bool* lifted = nullptr );
+
+        // Statistics.
+        //
+        inline uint64_t resolved_count() const { return resolved; }
+        inline uint64_t rejected_count() const { return rejected; }
+        inline uint64_t unsupported_count() const { return unsupported; }
+        inline uint64_t disagreement_count() const { return disagreements; }
+    };
+}
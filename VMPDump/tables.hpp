@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -17,18 +18,11 @@ namespace vmpdump
         uint32_t rva_name;
         uint32_t rva_first_thunk;
 
-        inline std::vector<uint8_t> get_bytes() const
-        {
-            // Allocate result vector.
-            //
-            std::vector<uint8_t> result;
-            result.resize( sizeof( *this ) );
-
-            // Copy data.
-            //
-            memcpy( result.data(), this, sizeof( *this ) );
+        inline size_t size() const { return sizeof( *this ); }
 
-            return result;
+        inline void write( uint8_t* output ) const
+        {
+            memcpy( output, this, sizeof( *this ) );
         }
     };
 
@@ -47,18 +41,11 @@ namespace vmpdump
             };
         };
 
-        inline std::vector<uint8_t> get_bytes() const
-        {
-            // Allocate result vector.
-            //
-            std::vector<uint8_t> result;
-            result.resize( sizeof( *this ) );
-
-            // Copy data.
-            //
-            memcpy( result.data(), this, sizeof( *this ) );
+        inline size_t size() const { return sizeof( *this ); }
 
-            return result;
+        inline void write( uint8_t* output ) const
+        {
+            memcpy( output, this, sizeof( *this ) );
         }
     };
 
@@ -67,19 +54,12 @@ namespace vmpdump
         uint16_t hint;
         std::string name;
 
-        inline std::vector<uint8_t> get_bytes() const
-        {
-            // Allocate result vector.
-            //
-            std::vector<uint8_t> result;
-            result.resize( sizeof( hint ) + name.size() + 1 );
-
-            // Copy data.
-            //
-            memcpy( result.data(), &hint, sizeof( hint ) );
-            memcpy( result.data() + sizeof( hint ), name.data(), name.size() );
+        inline size_t size() const { return sizeof( hint ) + name.size() + 1; }
 
-            return result;
+        inline void write( uint8_t* output ) const
+        {
+            memcpy( output, &hint, sizeof( hint ) );
+            memcpy( output + sizeof( hint ), name.c_str(), name.size() + 1 );
         }
     };
 
@@ -87,12 +67,11 @@ namespace vmpdump
     {
         std::string string;
 
-        inline std::vector<uint8_t> get_bytes() const
-        {
-            std::vector<uint8_t> result = { string.begin(), string.end() };
-            result.push_back( '\0' );
+        inline size_t size() const { return string.size() + 1; }
 
-            return result;
+        inline void write( uint8_t* output ) const
+        {
+            memcpy( output, string.c_str(), string.size() + 1 );
         }
     };
 }
\ No newline at end of file
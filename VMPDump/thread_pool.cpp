@@ -0,0 +1,89 @@
+#include "thread_pool.hpp"
+
+namespace vmpdump
+{
+    // Constructs a pool with the given amount of workers.
+    // If zero, the hardware concurrency is used.
+    //
+    work_stealing_pool::work_stealing_pool( size_t worker_count )
+    {
+        if ( worker_count == 0 )
+            worker_count = std::thread::hardware_concurrency();
+
+        // hardware_concurrency may return 0 if it cannot be determined.
+        //
+        if ( worker_count == 0 )
+            worker_count = 1;
+
+        for ( size_t i = 0; i < worker_count; i++ )
+            queues.push_back( std::make_unique<worker_queue>() );
+    }
+
+    // Adds a task to the pool. Must not be called while the pool is running.
+    //
+    void work_stealing_pool::push( task_t task )
+    {
+        queues[ next_queue ]->tasks.push_back( std::move( task ) );
+        next_queue = ( next_queue + 1 ) % queues.size();
+    }
+
+    // Pops a task from the front of the given worker's own queue.
+    //
+    bool work_stealing_pool::pop_local( size_t worker, task_t& task )
+    {
+        worker_queue& queue = *queues[ worker ];
+        std::lock_guard<std::mutex> guard( queue.lock );
+
+        if ( queue.tasks.empty() )
+            return false;
+
+        task = std::move( queue.tasks.front() );
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    // Steals a task from the back of any other worker's queue.
+    //
+    bool work_stealing_pool::steal( size_t worker, task_t& task )
+    {
+        for ( size_t i = 1; i < queues.size(); i++ )
+        {
+            worker_queue& victim = *queues[ ( worker + i ) % queues.size() ];
+            std::lock_guard<std::mutex> guard( victim.lock );
+
+            if ( victim.tasks.empty() )
+                continue;
+
+            task = std::move( victim.tasks.back() );
+            victim.tasks.pop_back();
+            return true;
+        }
+
+        return false;
+    }
+
+    // Runs all pushed tasks to completion, blocking until every worker is done.
+    //
+    void work_stealing_pool::run()
+    {
+        std::vector<std::thread> workers;
+
+        for ( size_t worker = 0; worker < queues.size(); worker++ )
+        {
+            workers.emplace_back( [ this, worker ] ()
+            {
+                // As no task pushes new tasks, once both our own queue and every other queue
+                // are empty there is nothing left to do.
+                //
+                task_t task;
+                while ( pop_local( worker, task ) || steal( worker, task ) )
+                    task();
+            } );
+        }
+
+        for ( std::thread& worker : workers )
+            worker.join();
+
+        next_queue = 0;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vmpdump
+{
+    // A simple work-stealing pool for batches of independent tasks.
+    // Tasks are distributed round-robin over per-worker queues; a worker pops from the front of its own
+    // queue and, once it runs dry, steals from the back of the other workers' queues.
+    //
+    class work_stealing_pool
+    {
+    public:
+        // A single unit of work.
+        //
+        using task_t = std::function<void()>;
+
+    private:
+        // A queue owned by a single worker.
+        //
+        struct worker_queue
+        {
+            std::mutex lock;
+            std::deque<task_t> tasks;
+        };
+
+        // The worker queues.
+        //
+        std::vector<std::unique_ptr<worker_queue>> queues;
+
+        // The queue the next pushed task is assigned to.
+        //
+        size_t next_queue = 0;
+
+        // Pops a task from the front of the given worker's own queue.
+        //
+        bool pop_local( size_t worker, task_t& task );
+
+        // Steals a task from the back of any other worker's queue.
+        //
+        bool steal( size_t worker, task_t& task );
+
+    public:
+        // Cannot be copied or moved, as workers reference the queues.
+        //
+        work_stealing_pool( const work_stealing_pool& ) = delete;
+        work_stealing_pool& operator=( const work_stealing_pool& ) = delete;
+
+        // Constructs a pool with the given amount of workers.
+        // If zero, the hardware concurrency is used.
+        //
+        work_stealing_pool( size_t worker_count = 0 );
+
+        // Returns the amount of workers.
+        //
+        inline size_t size() const { return queues.size(); }
+
+        // Adds a task to the pool. Must not be called while the pool is running.
+        //
+        void push( task_t task );
+
+        // Runs all pushed tasks to completion, blocking until every worker is done.
+        // The calling thread does not participate, so thread_local state (e.g. disassembler::get())
+        // is instantiated once per worker.
+        //
+        void run();
+    };
+}
@@ -1,166 +1,179 @@
 #include "vmpdump.hpp"
-#include <psapi.h>
-#include <Shlwapi.h>
 #include "disassembler.hpp"
+#include "thread_pool.hpp"
+#include "prefilter.hpp"
+#include "branch_encoder.hpp"
 #include <map>
+#include <algorithm>
 #include <cstdint>
-#include <vtil/compiler>
+#include <cstring>
+#include "stub_analysis.hpp"
+#include "stub_cache.hpp"
+#include "process_source.hpp"
+#include "file_source.hpp"
+#include "minidump_source.hpp"
+#include <cctype>
 #include <vtil/common>
-#include <vtil/symex>
-#include <lifters/core>
-#include <lifters/amd64>
 
 namespace vmpdump
 {
-    // Structure used to return raw import stub analysis information.
+    // Disassembles and analyzes the target of an E8 call as a VMP import stub.
+    // Results, including failures, are memoized per target for the lifetime of the instance.
     //
-    struct import_stub_analysis
+    std::optional<import_stub_analysis> vmpdump::analyze_call_target( uint64_t call_target_offset, uint32_t flags )
     {
-        uintptr_t thunk_rva;
-        uintptr_t dest_offset;
-        int32_t stack_adjustment;
-        bool padding;
-        bool is_jmp;
-    };
-
-    // Attempts to generate structures from the provided call EA and instruction_stream of a VMP import stub.
-    // Returns empty {} if the import stub failed analysis (and therefore is an invalid stub).
-    //
-    std::optional<import_stub_analysis> analyze_import_stub( const instruction_stream& stream )
-    {
-        using namespace vtil;
-
-        // Lift the given instruction stream to VTIL.
-        //
-        basic_block* lifted_block = stream.lift();
-
-        // Ensure lifted block is valid.
-        //
-        if ( !lifted_block->is_complete() )
-            return {};
-
-        // Get the iterator just before the VMEXIT at the end.
-        // This is the baseline we'll be using to see how certain registers / stack variables changed during the stub.
-        //
-        vtil::basic_block::const_iterator iterator = std::prev( lifted_block->end() );
-
-        // Verify that the last instruction is a JMP to a register.
-        //
-        if ( iterator->base->name != "jmp" || !iterator->operands[ 0 ].is_register() )
-            return {};
+        return analysis_cache->get_or_analyze( call_target_offset, [ & ] () -> std::optional<import_stub_analysis>
+        {
+            uint8_t* local_module_bytes = ( uint8_t* )target_module_view->local_module.data();
+            size_t local_module_size = target_module_view->local_module.size();
 
-        // Trace each variable that we'll be using to analyze the stub.
-        //
-        cached_tracer tracer;
-        symbolic::expression::reference dest_expression = tracer.trace( { iterator, iterator->operands[ 0 ].reg() } );
-        symbolic::expression::reference sp_expression = tracer.trace( { iterator, REG_SP } );
-        symbolic::expression::reference retaddr_expression = tracer.trace( { iterator, { sp_expression, 64 } } );
+            // Ensure that the call destination is within the module in the first place.
+            //
+            if ( call_target_offset >= local_module_size )
+                return {};
 
-#ifdef _DEBUG
-        logger::log<logger::CON_CYN>( "** Import stub analysis: dest_expression: %s sp_expression: %s retaddr_expression: %s\r\n", dest_expression, sp_expression, retaddr_expression );
-#endif
+            // Fetch the section of the call destination, as stubs may jump anywhere within it.
+            //
+            target_module_view->ensure_section( call_target_offset );
 
-        // Check if the retaddr expression matches the [CONST] + CONST expression.
-        //
-        uint64_t thunk_rva = 0;
-        uint64_t dest_offset = 0;
-        {
-            using namespace symbolic::directive;
+            // Disassemble at the call target.
+            // Max 25 instructions, in order to filter out invalid calls.
+            //
+            compact_stream stream;
+            disassembler::get().disassemble_compact( stream, ( uint64_t )local_module_bytes, call_target_offset, disassembler_take_unconditional_imm, 25, local_module_size );
 
-            int64_t sign;
-            stack_vector<symbol_table_t, 2> results;
-            if ( ( sign = +1, fast_match( &results, V + U, dest_expression ) ) ||
-                 ( sign = -1, fast_match( &results, V - U, dest_expression ) ) ||
-                 ( sign = +0, fast_match( &results, V,     dest_expression ) ) )
-            {
-                auto& var = results.front().translate( V )->uid.get<symbolic::variable>();
-                if ( !var.is_memory() || !var.mem().decay()->is_constant() )
-                    return {};
+            // Perform more preliminary filtering, so we only pass the most valid calls to the costly VTIL analysis.
+            //
+            if ( stream.empty() || stream.back().id != X86_INS_RET )
+                return {};
 
-                thunk_rva = *var.mem().decay()->get();
-                if ( sign != 0 ) 
-                    dest_offset = sign * *results.front().translate( U )->get<true>();
-            }
-            else
+            // Reuse the analysis of the same stub from a previous run, unless every stub is to be verified.
+            //
+            if ( stub_db && !( flags & scan_differential ) )
             {
-                return {};
+                if ( std::optional<std::optional<import_stub_analysis>> cached = stub_db->find( stream ) )
+                    return *cached;
             }
-        }
 
-        symbolic::expression::reference retaddr_sp_exp;
+            // Only persist what VTIL produced or confirmed, so that a wrong heuristic result is never reused by later runs.
+            //
+            bool lifted = false;
+            std::optional<import_stub_analysis> analysis = analyze_stream( stream, flags, lifted );
+            if ( stub_db && lifted )
+                stub_db->store( stream, analysis );
+            return analysis;
+        } );
+    }
 
-        // Check if return address is padded.
-        // TODO: rewrite this in a nicer way.
+    // Analyzes a disassembled candidate stream as a VMP import stub, with the analyses selected by the scan flags.
+    // lifted is set to whether the result was produced or confirmed by the VTIL analysis, rather than only by a heuristic.
+    //
+    std::optional<import_stub_analysis> vmpdump::analyze_stream( const compact_stream& stream, uint32_t flags, bool& lifted )
+    {
+        lifted = false;
+
+        // Try the known stub shapes first, which resolves most stubs without emulating or lifting anything.
         //
-        bool pad = false;
+        if ( flags & scan_classify )
         {
-            symbolic::expression::reference lhs = retaddr_expression->lhs;
-            symbolic::expression::reference rhs = retaddr_expression->rhs;
-
-            if ( lhs && rhs && lhs->is_variable() && rhs->is_constant() )
+            if ( std::optional<import_stub_analysis> classification = classifier->classify( stream ) )
             {
-                uint32_t constant = *rhs->get<uint32_t>();
+                if ( !( flags & scan_differential ) )
+                    return classification;
 
-                if ( constant != 1 )
-                    logger::log<logger::CON_PRP>( "** Warning: Unexpected value for padding: 0x%lx\r\n", constant );
-
-                pad = true;
-
-                // Set retaddr sp exp to [lhs].
-                //
-                retaddr_sp_exp = lhs->uid.get<symbolic::variable>().mem().base.base;
+                lifted = true;
+                return classifier->verify( stream, *classification );
             }
-            else
-                retaddr_sp_exp = retaddr_expression->uid.get<symbolic::variable>().mem().base.base;
         }
 
-#ifdef _DEBUG
-        logger::log<logger::CON_CYN>( "** Import stub analysis: retaddr_sp_exp: %s\r\n", retaddr_sp_exp );
-#endif
-
-        // Subtract initial SP from final SP to get the SP adjustment.
-        //
-        symbolic::expression stack_adjustment_expr = ( sp_expression - symbolic::CTX( lifted_block->begin() )[ REG_SP ] ).simplify( true );
-#ifdef _DEBUG
-        logger::log<logger::CON_CYN>( "** Import stub analysis: stack_adjustment_expr: %s\r\n", stack_adjustment_expr );
-#endif
-
-        // Check if is jmp.
+        // Analyze the disassembled stream as a VMP import stub, preferring the emulator if requested.
         //
-        bool is_jmp = retaddr_sp_exp->equals( *sp_expression ) && *stack_adjustment_expr.get<int32_t>() >= 8;
-#ifdef _DEBUG
-        logger::log<logger::CON_CYN>( "** Import stub analysis: is_jmp: %d\r\n", is_jmp );
-#endif
+        auto full_analysis = [ & ] () -> std::optional<import_stub_analysis>
+        {
+            if ( flags & ( scan_emulate | scan_differential ) )
+                return emulator->analyze( stream, flags & scan_differential, &lifted );
 
-        if ( !stack_adjustment_expr.is_constant() )
-            return {};
+            lifted = true;
+            return analyze_import_stub( stream );
+        };
 
-        // If is jump, expect stack adjustment of -0x8 to account for the initial call stub.
+        // Derive the analysis from the stub's cluster if requested, which leaves most stubs of a shape unanalyzed.
+        // When verifying, every stub is analyzed in full instead, and checked against its cluster's rule.
         //
-        int32_t sp_adjustment = *stack_adjustment_expr.get<int32_t>() - ( is_jmp ? 8 : 0 );
+        if ( flags & scan_cluster )
+            return clusters->analyze( stream, full_analysis, flags & scan_differential );
 
-        // Construct the analysis result object.
-        //
-        return import_stub_analysis { thunk_rva, dest_offset, sp_adjustment, pad, is_jmp };
+        return full_analysis();
     }
 
     // Scans the specified code range for any import calls and imports.
     // resolved_imports is a map of { import thunk rva, import structure }.
     //
     bool vmpdump::scan_for_imports( uint64_t rva, size_t code_size, std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags )
+    {
+        sweep_state state = { rva };
+        return scan_range( state, rva + code_size, rva + code_size, resolved_imports, import_calls, flags );
+    }
+
+    // Computes the destination of a relative jump or call from its raw bytes, as the sweep decodes without detail.
+    // Returns empty {} unless the instruction is a plain EB rel8, E9 rel32 or E8 rel32.
+    //
+    static std::optional<uint64_t> get_relative_target( const cs_insn* ins )
+    {
+        if ( ins->size == 2 && ins->bytes[ 0 ] == 0xEB )
+            return ins->address + ins->size + ( int8_t )ins->bytes[ 1 ];
+
+        if ( ins->size == 5 && ( ins->bytes[ 0 ] == 0xE9 || ins->bytes[ 0 ] == 0xE8 ) )
+        {
+            int32_t rel;
+            memcpy( &rel, &ins->bytes[ 1 ], sizeof( rel ) );
+            return ins->address + ins->size + ( int64_t )rel;
+        }
+
+        return {};
+    }
+
+    // Linearly sweeps the code from the given state up to end_rva, allowing instructions to be decoded up to limit_rva, and
+    // leaves the state where the sweep stopped, so that it can be continued. If given, on_decoded is invoked with the rva of
+    // every instruction decoded once it was handled, and the sweep stops right after the instruction if it returns true.
+    //
+    bool vmpdump::scan_range( sweep_state& state, uint64_t end_rva, uint64_t limit_rva, std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags,
+                              const std::function<bool( uint64_t rva )>& on_decoded )
     {
         uint8_t* local_module_bytes = ( uint8_t* )target_module_view->local_module.data();
 
-        size_t size = code_size;
+        // The sweep may already be past the range, e.g. if the last instruction it decoded ran past its end.
+        //
+        if ( state.offset >= end_rva )
+            return true;
+
+        uint64_t rva = state.offset;
+        size_t code_size = end_rva - rva;
+
+        // Instructions may run past the end of the range, up to the limit.
+        //
+        size_t size = limit_rva - rva;
+
+        // Fetch the range, if it was not already.
+        //
+        target_module_view->ensure( rva, std::min<uint64_t>( limit_rva, target_module_view->module_size ) - std::min<uint64_t>( rva, target_module_view->module_size ) );
 
         uint8_t* code_start = local_module_bytes + rva;
 
         uint64_t start_offset = rva;
         uint64_t offset = start_offset;
 
-        // Retain the previously disassembled instruction for future use.
+        // Retain the rva of the previously disassembled instruction for future use.
         //
-        std::optional<instruction> previous_instruction = {};
+        std::optional<uint64_t> previous_rva = state.previous_rva;
+
+        // If prefiltering, only the E8 calls which land in a stub range are candidates, and the sweep
+        // only covers a small resynchronization window before each of them.
+        //
+        std::vector<uint64_t> candidates;
+        size_t next_candidate = 0;
+        if ( flags & scan_prefilter )
+            candidates = find_call_candidates( local_module_bytes, rva, code_size, limit_rva, get_stub_ranges( target_module_view->local_module ) );
 
         // While iterative disassembly is successful.
         //
@@ -171,9 +184,40 @@ namespace vmpdump
             if ( offset >= start_offset + code_size )
                 break;
 
+            if ( flags & scan_prefilter )
+            {
+                // Drop the candidates the sweep has already passed, e.g. as they were inside of another instruction.
+                //
+                while ( next_candidate < candidates.size() && candidates[ next_candidate ] < offset )
+                    next_candidate++;
+
+                // Stop if there are no candidates left.
+                //
+                if ( next_candidate == candidates.size() )
+                    break;
+
+                // Skip ahead to the resynchronization window of the next candidate.
+                //
+                uint64_t candidate = candidates[ next_candidate ];
+                uint64_t resync_offset = candidate - std::min<uint64_t>( candidate - start_offset, prefilter_resync_window );
+                if ( offset < resync_offset )
+                {
+                    code_start += resync_offset - offset;
+                    offset = resync_offset;
+
+                    previous_rva = {};
+                }
+            }
+
+            // Never decode past the limit, even if bytes were skipped.
+            //
+            size = limit_rva - offset;
+
             // In case disassembly failed (due to invalid instructions), try to continue by incrementing offset.
+            // The sweep decodes without detail; only the length, id and bytes are needed to follow it.
             //
-            if ( !cs_disasm_iter( disassembler::get().get_handle(), ( const uint8_t** )&code_start, &size, &offset, disassembler::get().get_insn() ) )
+            cs_insn* ins = disassembler::get().get_fast_insn();
+            if ( !cs_disasm_iter( disassembler::get().get_fast_handle(), ( const uint8_t** )&code_start, &size, &offset, ins ) )
             {
                 offset++;
                 code_start++;
@@ -181,169 +225,292 @@ namespace vmpdump
                 continue;
             }
 
-            instruction ins = { disassembler::get().get_insn() };
-
             // In order to scan mutated code without failing, we are following 1 and 2 byte absolute jumps.
             //
-            if ( ins.ins.id == X86_INS_JMP
-                && ins.operand_type( 0 ) == X86_OP_IMM )
+            std::optional<uint64_t> jump_target;
+            if ( ins->id == X86_INS_JMP
+                && ( jump_target = get_relative_target( ins ) ) )
             {
-                uint32_t jump_offset = ins.operand( 0 ).imm - ( ins.ins.address + ins.ins.size );
+                uint32_t jump_offset = *jump_target - ( ins->address + ins->size );
 
                 if ( jump_offset == 1 || jump_offset == 2 )
                 {
                     offset += jump_offset;
                     code_start += jump_offset;
 
-                    previous_instruction = ins;
+                    previous_rva = ins->address;
+                    if ( on_decoded && on_decoded( ins->address ) )
+                        break;
 
                     continue;
                 }
             }
 
             // If the instruction is a relative ( E8 ) call.
+            // When prefiltering, only the candidate itself has a target worth analyzing.
             //
-            if ( ins.ins.id == X86_INS_CALL && ins.operand_type( 0 ) == X86_OP_IMM && ins.ins.bytes[ 0 ] == 0xE8 )
+            std::optional<uint64_t> call_target;
+            if ( ins->id == X86_INS_CALL && ( call_target = get_relative_target( ins ) )
+                && ( !( flags & scan_prefilter ) || ins->address == candidates[ next_candidate ] ) )
             {
-                uint64_t call_target_offset = ins.operand( 0 ).imm;
-                uint8_t* call_target = local_module_bytes + call_target_offset;
-
-                // Ensure that the call destination is valid memory in the first place.
+                // Analyze the call target as a VMP import stub.
                 //
-                if ( !IsBadReadPtr( call_target, 1 ) )
+                std::optional<import_stub_analysis> stub_analysis = analyze_call_target( *call_target, flags );
+                bool resolved = stub_analysis && target_module_view->ensure( stub_analysis->thunk_rva, sizeof( uintptr_t ) );
+                if ( resolved )
                 {
-                    // Disassemble at the call target.
-                    // Max 25 instructions, in order to filter out invalid calls.
+                    // vtil::logger::log<vtil::logger::CON_GRN>( "** Resolved import stub @ 0x%p\r\n", ins->address );
+
+                    // Compute the ea of the function, in the target process.
                     //
-                    instruction_stream stream = disassembler::get().disassemble( ( uint64_t )local_module_bytes, call_target_offset, disassembler_take_unconditional_imm, 25 );
+                    uintptr_t target_ea = *( uintptr_t* )( local_module_bytes + stub_analysis->thunk_rva ) + stub_analysis->dest_offset;
 
-                    // Perform more preliminary filtering, so we only pass the most valid calls to the costly VTIL analysis.
+                    // If it doesn't already exist within the map, insert the import.
                     //
-                    if ( !stream.instructions.empty() && stream.instructions[ stream.instructions.size() - 1 ]->ins.id == X86_INS_RET )
-                    {
-                        // Analyze the disassembled stream as a VMP import stub.
-                        //
-                        if ( std::optional<import_stub_analysis> stub_analysis = analyze_import_stub( stream ) )
-                        {
-                            // vtil::logger::log<vtil::logger::CON_GRN>( "** Resolved import stub @ 0x%p\r\n", ins.ins.address );
-
-                            // Compute the ea of the function, in the target process.
-                            //
-                            uintptr_t target_ea = *( uintptr_t* )( local_module_bytes + stub_analysis->thunk_rva ) + stub_analysis->dest_offset;
-
-                            // If it doesn't already exist within the map, insert the import.
-                            //
-                            const resolved_import* referenced_import = &resolved_imports.insert( { stub_analysis->thunk_rva, { stub_analysis->thunk_rva, target_ea } } ).first->second;
-
-                            // Record the call to the import.
-                            //
-                            import_calls.push_back( { ins.ins.address, referenced_import, stub_analysis->stack_adjustment, stub_analysis->padding, stub_analysis->is_jmp, previous_instruction } );
-
-                            // If the call is a jump, and has no backwards (push) padding, it must be padded after the stub.
-                            // Because jumps don't return, this information won't be provided to us by the analysis, so we have
-                            // to skip the next byte to prevent potentially invalid disassembly.
-                            //
-                            if ( stub_analysis->is_jmp && stub_analysis->stack_adjustment == 0 )
-                            {
-                                offset++;
-                                code_start++;
-                            }
-                        }
-                        // else
-                        //     vtil::logger::log<vtil::logger::CON_PRP>( "** Potentially skipped import call @ RVA 0x%p\r\n", ins.ins.address );
-                    }
+                    const resolved_import* referenced_import = &resolved_imports.insert( { stub_analysis->thunk_rva, { stub_analysis->thunk_rva, target_ea } } ).first->second;
+
+                    // Only now decode the previous instruction with full detail, as the call conversion may need its operands.
+                    //
+                    std::optional<compact_instruction> previous_instruction = {};
+                    if ( previous_rva )
+                        previous_instruction = disassembler::get().decode( ( uint64_t )local_module_bytes, *previous_rva, limit_rva - *previous_rva );
+
+                    // Record the call to the import.
+                    //
+                    import_calls.push_back( { ins->address, ins->size, referenced_import, stub_analysis->stack_adjustment, stub_analysis->padding, stub_analysis->is_jmp, previous_instruction } );
+                }
+                // else
+                //     vtil::logger::log<vtil::logger::CON_PRP>( "** Potentially skipped import call @ RVA 0x%p\r\n", ins->address );
+
+                // If the call is a jump, and has no backwards (push) padding, it must be padded after the stub.
+                // Because jumps don't return, this information won't be provided to us by the analysis, so we have
+                // to skip the next byte to prevent potentially invalid disassembly.
+                //
+                if ( resolved && stub_analysis->is_jmp && stub_analysis->stack_adjustment == 0 )
+                {
+                    offset++;
+                    code_start++;
                 }
             }
 
-            previous_instruction = ins;
+            previous_rva = ins->address;
+            if ( on_decoded && on_decoded( ins->address ) )
+                break;
         }
 
+        state = { offset, previous_rva };
         return true;
     }
 
     // Scans all executable sections of the image for any import calls and imports.
+    // Should a stub cluster's rule be dropped during the scan, the analyses derived from it are dropped as well, and the scan
+    // is repeated, as the results and even the sweep itself may depend on them.
     //
     bool vmpdump::scan_for_imports( std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags )
     {
-        using namespace win;
-
-        bool failed = false;
+        while ( true )
+        {
+            std::map<uint64_t, resolved_import> scanned_imports;
+            std::vector<import_call> scanned_calls;
+            bool succeeded = scan_code_ranges( scanned_imports, scanned_calls, flags );
 
-        nt_headers_t<true>* nt = target_module_view->local_module.get_image()->get_nt_headers();
+            // Analyze the members derived from a dropped rule again, in full, as their cluster no longer derives anything.
+            // Every other analysis is still cached, so the repeated scan is cheap.
+            //
+            std::vector<uint64_t> invalidated = clusters->take_invalidated();
+            if ( !invalidated.empty() )
+            {
+                vtil::logger::log<vtil::logger::CON_YLW>( "** Dropped %llu stub analyses derived from a disproved cluster rule, rescanning\r\n", invalidated.size() );
+                for ( uint64_t target_rva : invalidated )
+                    analysis_cache->erase( target_rva );
+                continue;
+            }
 
-        // Enumerate image sections.
-        //
-        for ( int i = 0; i < nt->file_header.num_sections; i++ )
-        {
-            section_header_t* section = nt->get_section( i );
+            // The calls reference the imports of this scan, so they must be pointed to the merged ones.
+            //
+            for ( auto& [thunk_rva, import] : scanned_imports )
+                resolved_imports.insert( { thunk_rva, import } );
 
-            if ( section->characteristics.mem_read && section->characteristics.mem_execute && section->characteristics.cnt_code )
-                failed |= !scan_for_imports( section->virtual_address, section->virtual_size, resolved_imports, import_calls, flags );
+            for ( import_call& call : scanned_calls )
+            {
+                call.import = &resolved_imports.at( call.import->thunk_rva );
+                import_calls.push_back( std::move( call ) );
+            }
+            return succeeded;
         }
-
-        return !failed;
     }
 
-    // Attempts to generate a stub in a code cave which jmps to the given thunk.
-    // Returns the stub rva.
+    // Scans all executable sections of the image for any import calls and imports, serially or in parallel.
     //
-    std::optional<uint32_t> vmpdump::generate_stub( uint32_t rva, remote_ea_t thunk )
+    bool vmpdump::scan_code_ranges( std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags )
     {
-        // Save all stubs so we don't re-create them on each call.
-        //
-        static std::map<remote_ea_t, uint32_t> stubs;
+        bool failed = false;
 
-        // If the stub was already created, just return its rva.
+        // Collect the executable code ranges.
         //
-        auto it = stubs.find( thunk );
-        if ( it != stubs.end() )
-            return it->second;
+        std::vector<rva_range_t> code_ranges = get_code_ranges( target_module_view->local_module );
 
-        // We need 6 bytes for a thunk call.
+        // Serial scan, one section after another.
         //
-        const uint32_t req_len = 6;
+        if ( !( flags & scan_parallel ) )
+        {
+            for ( auto& [rva, range_end] : code_ranges )
+                failed |= !scan_for_imports( rva, range_end - rva, resolved_imports, import_calls, flags );
+
+            return !failed;
+        }
 
-        // Increase the section size.
+        // Structure holding a single chunk of a code range, and the results of its scan.
         //
-        auto section = target_module_view->local_module.get_image()->rva_to_section( rva );
-        uint32_t stub_rva = section->virtual_address + section->virtual_size;
-        section->virtual_size += req_len;
+        struct scan_chunk
+        {
+            uint64_t range_end;
+            uint64_t begin;
+            uint64_t end;
+
+            // The state the sweep stopped at.
+            //
+            sweep_state state;
+
+            // Whether an instruction was decoded at each rva of the chunk.
+            //
+            std::vector<bool> decoded;
+
+            // The rva of the instruction the sweep synchronized with a later chunk's at, and the index of that chunk.
+            //
+            uint64_t synced_rva;
+            std::optional<size_t> synced_chunk;
 
-        // TODO: Handle if there is no more padding left in the section to overwrite.....
+            std::map<uint64_t, resolved_import> resolved_imports;
+            std::vector<import_call> import_calls;
+            bool succeeded;
+        };
+
+        // Split each code range into chunks, in the same order as the serial scan visits them.
         //
-        // ...
+        std::vector<scan_chunk> chunks;
+        for ( auto& [rva, range_end] : code_ranges )
+        {
+            for ( uint64_t begin = rva; begin < range_end; begin += chunk_size )
+            {
+                uint64_t end = std::min<uint64_t>( begin + chunk_size, range_end );
+                chunks.push_back( { range_end, begin, end, { begin }, std::vector<bool>( end - begin ), 0, {}, {}, {}, false } );
+            }
+        }
 
-        // If no code-cave found, return empty {}.
+        // Sweep every chunk on the pool, noting where instructions were decoded.
+        // Every worker uses its own thread_local disassembler, and writes to its own chunk only.
         //
-        if ( !stub_rva )
-            return {};
+        work_stealing_pool pool( worker_count );
+        for ( scan_chunk& chunk : chunks )
+        {
+            pool.push( [ this, &chunk, flags ] ()
+            {
+                chunk.succeeded = scan_range( chunk.state, chunk.end, chunk.range_end, chunk.resolved_imports, chunk.import_calls, flags, [ & ] ( uint64_t rva )
+                {
+                    chunk.decoded[ rva - chunk.begin ] = true;
+                    return false;
+                } );
+            } );
+        }
+        pool.run();
 
-        // Assemble a jump.
+        // A chunk's sweep may start in the middle of an instruction the serial sweep decodes, and reach different instructions
+        // until it resynchronizes. Once two sweeps decode an instruction at the same rva, they proceed identically from there on.
+        // So continue the sweep of every chunk past its end, until it decodes an instruction a later chunk's sweep decoded too.
         //
-        std::vector<uint8_t> jump = vtil::amd64::assemble( vtil::format::str( "jmp [0x%p]", thunk ), target_module_view->module_base + stub_rva );
+        for ( size_t index = 0; index < chunks.size(); index++ )
+        {
+            pool.push( [ this, &chunks, index, flags ] ()
+            {
+                scan_chunk& chunk = chunks[ index ];
+                for ( size_t next = index + 1; next < chunks.size() && chunks[ next ].range_end == chunk.range_end && !chunk.synced_chunk; next++ )
+                {
+                    const scan_chunk& successor = chunks[ next ];
+                    chunk.succeeded &= scan_range( chunk.state, successor.end, chunk.range_end, chunk.resolved_imports, chunk.import_calls, flags, [ & ] ( uint64_t rva )
+                    {
+                        if ( rva < successor.begin || !successor.decoded[ rva - successor.begin ] )
+                            return false;
 
-        // Sanity-check the size.
+                        chunk.synced_rva = rva;
+                        chunk.synced_chunk = next;
+                        return true;
+                    } );
+                }
+            } );
+        }
+        pool.run();
+
+        // Merge the per-chunk results in the order the serial sweep visits them, which yields its exact results. The first chunk of
+        // each range is swept from where the serial sweep starts. Each chunk's calls are taken up to the instruction it synchronized
+        // at, and the calls of the chunk it synchronized with only past it, skipping any chunks in between. A chunk which never
+        // synchronized swept to the end of the range itself.
+        // The calls reference the chunk-local imports, so they must be pointed to the merged ones.
         //
-        if ( jump.size() > 6 )
-            return {};
+        uint64_t taken_rva = 0;
+        for ( size_t index = 0; index < chunks.size(); )
+        {
+            scan_chunk& chunk = chunks[ index ];
+            failed |= !chunk.succeeded;
 
-        // Copy the assembled jump to the code-cave.
+            for ( import_call& call : chunk.import_calls )
+            {
+                if ( call.call_rva < taken_rva )
+                    continue;
+
+                call.import = &resolved_imports.insert( { call.import->thunk_rva, *call.import } ).first->second;
+                import_calls.push_back( std::move( call ) );
+            }
+
+            if ( chunk.synced_chunk )
+            {
+                taken_rva = chunk.synced_rva + 1;
+                index = *chunk.synced_chunk;
+            }
+            else
+            {
+                taken_rva = 0;
+                while ( index < chunks.size() && chunks[ index ].range_end == chunk.range_end )
+                    index++;
+            }
+        }
+
+        return !failed;
+    }
+
+    // Attempts to generate a stub in a code cave which jmps to the given thunk, or returns the one already generated.
+    // Returns the stub rva.
+    //
+    std::optional<uint32_t> vmpdump::generate_stub( remote_ea_t thunk )
+    {
+        // We need 6 bytes for a thunk call.
         //
-        memcpy( target_module_view->local_module.data() + stub_rva, jump.data(), jump.size() );
+        const uint32_t req_len = 6;
 
-        // Add the generated stub to the list for future use.
+        // Stubs are shared by every call to the same thunk, so only the first call allocates and writes one.
         //
-        stubs.insert( { thunk, stub_rva } );
+        return stub_caves->get_or_emit( thunk, req_len, [ & ] ( uint32_t stub_rva )
+        {
+            // Encode a jump.
+            //
+            std::optional<encoded_branch> jump = branch_encoder::encode_indirect<branch_type::jmp>( target_module_view->module_base + stub_rva, thunk );
+
+            // Sanity-check the size.
+            //
+            if ( !jump || jump->size > req_len )
+                return false;
 
-        return stub_rva;
+            // Copy the encoded jump to the code-cave.
+            //
+            return target_module_view->patch( stub_rva, jump->bytes, jump->size );
+        } );
     }
 
-    // Attempts to convert the provided call to the VMP import stub to a direct import thunk call to the specified remote thunk ea.
+    // Plans the conversion of the provided call to the VMP import stub to a direct import thunk call to the specified remote thunk ea,
+    // without patching the call itself. Any stub the call is dispatched through is generated immediately.
     //
-    bool vmpdump::convert_local_call( const import_call& call, remote_ea_t thunk )
+    std::optional<call_patch> vmpdump::plan_local_call( const import_call& call, remote_ea_t thunk )
     {
-        uint8_t* local_module_bytes = ( uint8_t* )target_module_view->local_module.data();
-
         uint64_t fill_rva = 0;
         size_t fill_size = 0;
 
@@ -354,50 +521,35 @@ namespace vmpdump
         //
         if ( call.stack_adjustment == 8 )
         {
-            if ( call.prev_instruction && call.prev_instruction->ins.id == X86_INS_PUSH && call.prev_instruction->operand_type( 0 ) == X86_OP_REG )
+            if ( call.prev_instruction && call.prev_instruction->id == X86_INS_PUSH && call.prev_instruction->operand_type( 0 ) == X86_OP_REG )
             {
                 // It is indeed a valid VMP-injected push.
                 // We can NOP it later, and mark it as the starting point for our fill address.
                 //
-                fill_rva = call.prev_instruction->ins.address;
-                fill_size += call.prev_instruction->ins.size;
+                fill_rva = call.prev_instruction->address;
+                fill_size += call.prev_instruction->size;
             }
             else
             {
                 vtil::logger::log<vtil::logger::CON_RED>( "!! Stack adjustment failed for call @ RVA 0x%llx for thunk @ 0x%llx\r\n", call.call_rva, thunk );
-                return false;
+                return {};
             }
         }
 
-        uint8_t* call_ea = local_module_bytes + call.call_rva;
-
-        // Disassemble instruction at the call rva.
-        //
-        auto instructions = vtil::amd64::disasm( call_ea, call.call_rva );
-
-        // Ensure disassembly succeeded.
-        //
-        if ( instructions.empty() )
-        {
-            vtil::logger::log<vtil::logger::CON_RED>( "!! Disassembly failed for call @ RVA 0x%llx for thunk @ 0x%llx\r\n", call.call_rva, thunk );
-            return false;
-        }
-
         // If it's a jump, we can increase fill size by 1, if we haven't already filled using a PUSH.
         // This is because thunk jumps must be 5 bytes, so VMP can insert a junk pad byte after its 4 byte stub.
         //
         if ( fill_size == 0 && call.is_jmp )
             fill_size++;
 
-        // If there's no fill rva selected, set it as the beginning of the disassembled instructions.
+        // If there's no fill rva selected, set it as the beginning of the call.
         //
         if ( fill_rva == 0 )
-            fill_rva = instructions[ 0 ].address;
+            fill_rva = call.call_rva;
         
-        // Account for these instructions for the fill size.
+        // Account for the call, as decoded by the scan, for the fill size.
         //
-        for ( auto instruction : instructions )
-            fill_size += instruction.bytes.size();
+        fill_size += call.call_size;
 
         // If padded, increase fill size by 1.
         //
@@ -405,51 +557,153 @@ namespace vmpdump
 
         // Now we must inject a call to the newly-fixed thunk.
         //
-        // We assemble this call as if we're in the target process address-space.
-        // This is because we want to give the assembler the freedom to potentially make a non-relative call if it desires.
+        // We encode this call as if we're in the target process address-space.
+        // This is because we want to give the encoder the freedom to potentially make a non-relative call if it must.
         //
-        std::vector<uint8_t> converted_call = vtil::amd64::assemble( vtil::format::str( "%s [0x%p]", call.is_jmp ? "jmp" : "call", thunk ), target_module_view->module_base + fill_rva );
+        branch_type type = call.is_jmp ? branch_type::jmp : branch_type::call;
+        std::optional<encoded_branch> converted_call = branch_encoder::encode_indirect( type, target_module_view->module_base + fill_rva, thunk );
 
-        // Ensure assembly succeeded.
+        // Ensure encoding succeeded.
         //
-        if ( converted_call.empty() )
+        if ( !converted_call )
         {
-            vtil::logger::log<vtil::logger::CON_RED>( "!! Assembly failed for call @ RVA 0x%llx for thunk @ 0x%llx\r\n", call.call_rva, thunk );
-            return false;
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Encoding failed for call @ RVA 0x%llx for thunk @ 0x%llx\r\n", call.call_rva, thunk );
+            return {};
         }
 
         // Ensure we have enough bytes to fill.
         //
-        if ( converted_call.size() > fill_size )
+        if ( converted_call->size > fill_size )
         {
             // If we don't have enough bytes, we can try to dispatch the call via a stub.
             // Try to generate this stub in a codecave.
             //
-            if ( std::optional<uint32_t> stub_rva = generate_stub( fill_rva, thunk ) )
+            if ( std::optional<uint32_t> stub_rva = generate_stub( thunk ) )
             {
                 // Successful, we found a suitable code-cave and generated a stub.
                 // Now replace the call with a dispatched call (or jmp) to the stub.
                 //
-                converted_call = vtil::amd64::assemble( vtil::format::str( "%s 0x%p", call.is_jmp ? "jmp" : "call", target_module_view->module_base + *stub_rva ), target_module_view->module_base + fill_rva );
+                if ( std::optional<encoded_branch> dispatch = branch_encoder::encode_relative( type, target_module_view->module_base + fill_rva, target_module_view->module_base + *stub_rva ) )
+                    converted_call = dispatch;
             }
         }
 
         // Ensure again we have enough bytes to fill.
         //
-        if ( converted_call.size() > fill_size )
+        if ( converted_call->size > fill_size )
         {
-            vtil::logger::log<vtil::logger::CON_RED>( "!! Insufficient bytes [have %d, need %d] for call @ RVA 0x%llx for thunk @ 0x%llx\r\n", fill_size, converted_call.size(), call.call_rva, thunk );
-            return false;
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Insufficient bytes [have %d, need %d] for call @ RVA 0x%llx for thunk @ 0x%llx\r\n", fill_size, converted_call->size, call.call_rva, thunk );
+            return {};
         }
 
         // NOP the fill bytes and copy the converted call in.
         //
-        memset( local_module_bytes + fill_rva, 0x90, fill_size );
-        memcpy( local_module_bytes + fill_rva, converted_call.data(), converted_call.size() );
+        std::vector<uint8_t> fill( fill_size, 0x90 );
+        memcpy( fill.data(), converted_call->bytes, converted_call->size );
 
+        return call_patch { fill_rva, std::move( fill ) };
+    }
+
+    // Plans the conversion of the provided call to the VMP import stub to a direct import thunk call to the specified remote thunk ea,
+    // adding its patch to the plan. Fails if the call cannot be converted, or its patch overlaps one already planned.
+    //
+    bool vmpdump::convert_local_call( const import_call& call, remote_ea_t thunk, patch_plan& plan )
+    {
+        std::optional<call_patch> patch = plan_local_call( call, thunk );
+        if ( !patch )
+            return false;
+
+        uint64_t rva = patch->rva;
+        size_t size = patch->bytes.size();
+        if ( !plan.add( std::move( *patch ) ) )
+        {
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Patch [0x%llx, 0x%llx) for call @ RVA 0x%llx overlaps the patch @ RVA 0x%llx\r\n", rva, rva + size, call.call_rva, *plan.find_overlap( rva, size ) );
+            return false;
+        }
         return true;
     }
 
+    // Fixes the import calls in the running process instead of a dump. thunk_rvas maps each import's remote ea to the rva of
+    // the thunk appended for it, which is only used if that range is still zero padding; otherwise the thunks are moved into a cave.
+    // The thunks are written first, then any stubs, and only then are the calls redirected, so that no call is redirected to a
+    // thunk or stub which is not there yet. Returns the number of calls redirected.
+    //
+    size_t vmpdump::fix_live( const std::vector<import_call>& import_calls, const std::map<remote_ea_t, uint32_t>& thunk_rvas )
+    {
+        // Start from the current state of the process, as it kept running since the scan.
+        // Only the pages we patch are fetched again.
+        //
+        target_module_view->fetch( true );
+
+        // The thunks were laid out right after the IAT, which in a running process may be followed by data in use rather than
+        // by padding. Unless their range is still all zeros, move them into a cave.
+        //
+        std::map<remote_ea_t, uint32_t> placed_rvas = thunk_rvas;
+        if ( !placed_rvas.empty() )
+        {
+            auto [lowest, highest] = std::minmax_element( placed_rvas.begin(), placed_rvas.end(), [ ] ( auto& a, auto& b ) { return a.second < b.second; } );
+            uint32_t range_begin = lowest->second;
+            uint32_t range_size = highest->second + sizeof( remote_ea_t ) - range_begin;
+
+            const uint8_t* bytes = target_module_view->local_module.cdata() + range_begin;
+            if ( !target_module_view->ensure( range_begin, range_size ) || std::any_of( bytes, bytes + range_size, [ ] ( uint8_t value ) { return value != 0; } ) )
+            {
+                std::optional<uint32_t> cave = stub_caves->reserve( range_size );
+                if ( !cave )
+                {
+                    vtil::logger::log<vtil::logger::CON_RED>( "!! The thunks @ RVA 0x%lx would overwrite data in use, and no cave is left for them\r\n", range_begin );
+                    return 0;
+                }
+
+                vtil::logger::log<vtil::logger::CON_YLW>( "** The thunks @ RVA 0x%lx would overwrite data in use, moved them to RVA 0x%lx\r\n", range_begin, *cave );
+                for ( auto& [target_ea, thunk_rva] : placed_rvas )
+                    thunk_rva = thunk_rva - range_begin + *cave;
+            }
+        }
+
+        // Write the thunks, resolved to the imports' remote eas as the loader would have.
+        //
+        for ( auto& [target_ea, thunk_rva] : placed_rvas )
+        {
+            if ( !target_module_view->patch( thunk_rva, &target_ea, sizeof( target_ea ) ) )
+            {
+                vtil::logger::log<vtil::logger::CON_RED>( "!! Failed to write thunk @ RVA 0x%lx\r\n", thunk_rva );
+                return 0;
+            }
+        }
+        if ( !target_module_view->commit() )
+        {
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Failed to commit the thunks\r\n" );
+            return 0;
+        }
+
+        // Plan every call, which generates the stubs they are dispatched through, and write those stubs.
+        //
+        patch_plan plan;
+        for ( const import_call& call : import_calls )
+        {
+            auto it = placed_rvas.find( call.import->target_ea );
+            if ( it == placed_rvas.end() || !convert_local_call( call, target_module_view->module_base + it->second, plan ) )
+                vtil::logger::log<vtil::logger::CON_RED>( "\t** Failed to convert call @ RVA 0x%lx\r\n", call.call_rva );
+        }
+        if ( !target_module_view->commit() )
+        {
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Failed to commit the stubs\r\n" );
+            return 0;
+        }
+
+        // Finally, redirect the calls, all in one batch.
+        //
+        size_t redirected = plan.apply( *target_module_view, worker_count );
+        if ( !target_module_view->commit() )
+        {
+            vtil::logger::log<vtil::logger::CON_RED>( "!! Failed to commit the redirected calls\r\n" );
+            return 0;
+        }
+
+        return redirected;
+    }
+
     // Searches for a module where the provided remote ea is within the module's address space, then returns a module_view of that module.
     //
     std::optional<module_view> vmpdump::view_from_base( remote_ea_t base ) const
@@ -465,7 +719,52 @@ namespace vmpdump
 
         // Construct module_view.
         //
-        return { { process_id, it->second.first, base, it->second.second } };
+        return { { source, it->second.first, base, it->second.second, true } };
+    }
+
+    // Constructs an export-only view from the given remote module base.
+    //
+    std::optional<export_view> vmpdump::exports_from_base( remote_ea_t base ) const
+    {
+        // Find the module by base.
+        //
+        auto it = process_modules.find( base );
+
+        // Return empty {} if not found.
+        //
+        if ( it == process_modules.end() )
+            return {};
+
+        // Construct export_view.
+        //
+        return { { *source, it->second.first, base, it->second.second, export_db.get() } };
+    }
+
+    // Constructs export-only views for each of the given remote module bases on the worker pool,
+    // skipping the bases which are not modules.
+    //
+    std::map<remote_ea_t, export_view> vmpdump::exports_from_bases( const std::vector<remote_ea_t>& bases ) const
+    {
+        // Fetch and index every module's exports on the pool, each into its own slot.
+        //
+        std::vector<std::optional<export_view>> views( bases.size() );
+
+        work_stealing_pool pool( std::min<size_t>( worker_count ? worker_count : std::thread::hardware_concurrency(), std::max<size_t>( bases.size(), 1 ) ) );
+        for ( size_t i = 0; i < bases.size(); i++ )
+        {
+            pool.push( [ this, &bases, &views, i ] ()
+            {
+                if ( std::optional<export_view> view = exports_from_base( bases[ i ] ) )
+                    views[ i ].emplace( std::move( *view ) );
+            } );
+        }
+        pool.run();
+
+        std::map<remote_ea_t, export_view> result;
+        for ( size_t i = 0; i < bases.size(); i++ )
+            if ( views[ i ] )
+                result.emplace( bases[ i ], std::move( *views[ i ] ) );
+        return result;
     }
 
     // Retrieves the module base from the given remote ea.
@@ -487,109 +786,89 @@ namespace vmpdump
         return {};
     }
 
-    // Creates a vmpdump class from the given process id and target module name.
+    // Creates a vmpdump class from the given memory source and target module name.
     // If module_name is empty "", the process module is used.
-    // If the process cannot be opened for some reason or the module cannot be found, returns empty {}.
+    // If the module cannot be found, returns empty {}.
     //
-    std::unique_ptr<vmpdump> vmpdump::from_pid( uint32_t process_id, const std::string& module_name )
+    std::unique_ptr<vmpdump> vmpdump::from_source( std::shared_ptr<memory_source> source, const std::string& module_name )
     {
-        std::unique_ptr<vmpdump> result = {};
-
-        HMODULE process_modules[ 1024 ] = {};
-
-        // TODO: replace PROCESS_ALL_ACCESS with something more specific.
+        // Get the process image file name.
         //
-        HANDLE process_handle = OpenProcess( PROCESS_ALL_ACCESS, FALSE, process_id );
-        if ( process_handle == NULL )
+        std::string process_image_path = source->get_image_path();
+        if ( process_image_path.empty() )
             return {};
 
-        // Retrieves the module base address and size, in that order, in a pair.
+        // The path may be a Windows path from a capture, so split it by hand rather than by the host's conventions.
         //
-        auto get_module_info = [&]( HMODULE target_module ) -> std::pair<uintptr_t, size_t>
-        {
-            MODULEINFO info = {};
-            if ( !GetModuleInformation( process_handle, target_module, &info, sizeof( info ) ) )
-                return { 0, 0 };
+        std::string process_image_name = process_image_path.substr( process_image_path.find_last_of( "\\/" ) + 1 );
 
-            return { ( uintptr_t )info.lpBaseOfDll, info.SizeOfImage };
-        };
-
-        // Do ... While( 0 ) "loop" for easy error wrapping.
+        // Case-insensitively compares two module names.
         //
-        do
+        auto names_equal = [ ] ( const std::string& a, const std::string& b )
         {
-            // Try to get the process image file name.
-            //
-            char process_image_path[ MAX_PATH ] = {};
-            DWORD process_image_path_size = sizeof( process_image_path );
-            if ( !QueryFullProcessImageNameA( process_handle, 0, process_image_path, &process_image_path_size ) )
-                break;
-
-            const char* process_image_name = PathFindFileNameA( process_image_path );
+            return std::equal( a.begin(), a.end(), b.begin(), b.end(), [ ] ( char x, char y ) { return std::tolower( ( unsigned char )x ) == std::tolower( ( unsigned char )y ); } );
+        };
 
-            // Map of process modules, for later class construction.
-            //
-            std::map<remote_ea_t, std::pair<std::string, size_t>> process_modules_map;
+        // Map of process modules, for later class construction.
+        //
+        module_list_t process_modules_map = source->get_modules();
 
-            // Info of the target module.
-            //
-            std::string target_module_name;
-            std::pair<uintptr_t, size_t> target_module_info = {};
-            bool target_module_found = false;
+        // If we're looking for the process module, compare module name to image base name.
+        // Otherwise, compare the module name to the provided target module name in the argument.
+        //
+        for ( auto& [base, info] : process_modules_map )
+        {
+            auto& [curr_module_name, curr_module_size] = info;
 
-            // Enumerate through the process modules list.
-            //
-            DWORD process_modules_size;
-            if ( EnumProcessModules( process_handle, process_modules, sizeof( process_modules ), &process_modules_size ) )
+            if ( ( module_name.empty() && names_equal( curr_module_name, process_image_name ) ) || curr_module_name == module_name )
             {
-                // Loop through each module.
+                // Construct the object.
                 //
-                for ( int i = 0; i < ( process_modules_size / sizeof( HMODULE ) ); i++ )
-                {
-                    HMODULE curr_module = process_modules[ i ];
-
-                    // Get the module base address and size.
-                    //
-                    std::pair<uintptr_t, size_t> curr_module_info = get_module_info( curr_module );
-
-                    // Get the module name.
-                    //
-                    char module_base_name[ 64 ] = {};
-                    if ( GetModuleBaseNameA( process_handle, curr_module, module_base_name, sizeof( module_base_name ) ) )
-                    {
-                        // Add the module to the map.
-                        //
-                        process_modules_map.insert( { curr_module_info.first, { module_base_name, curr_module_info.second } } );
-
-                        // If we're looking for the process module, compare module name to image base name.
-                        // Otherwise, compare the module name to the provided target module name in the argument.
-                        //
-                        if ( !target_module_found
-                            && ( module_name.empty() && _stricmp( module_base_name, process_image_name ) == 0 )
-                            || ( std::string( module_base_name ) == module_name ) )
-                        {
-                            target_module_info = curr_module_info;
-                            target_module_name = module_base_name;
-                            target_module_found = true;
-                        }
-                    }
-                }
+                auto target_module_view = std::make_unique<module_view>( source, curr_module_name, base, curr_module_size, true );
+                return std::make_unique<vmpdump>( source, process_modules_map, std::move( target_module_view ), process_image_path );
             }
+        }
 
-            // Verify that we actually found the module.
-            //
-            if ( !target_module_found )
-                break;
+        // The module was not found.
+        //
+        return {};
+    }
 
-            // Construct the object.
-            //
-            result = std::make_unique<vmpdump>( process_id, process_modules_map, std::make_unique<module_view>( process_id, target_module_name, target_module_info.first, target_module_info.second ), std::string { process_image_path } );
-            
-        } while ( 0 );
+    // Creates a vmpdump class from the given process id and target module name.
+    // If module_name is empty "", the process module is used.
+    // If the process cannot be opened for some reason or the module cannot be found, returns empty {}.
+    //
+    std::unique_ptr<vmpdump> vmpdump::from_pid( uint32_t process_id, const std::string& module_name )
+    {
+#ifdef _WIN32
+        std::shared_ptr<process_memory_source> source = process_memory_source::open( process_id );
+        if ( !source )
+            return {};
 
-        // Close handle and return the constructed object.
+        return from_source( std::move( source ), module_name );
+#else
+        // Live processes are only supported on Windows.
         //
-        CloseHandle( process_handle );
-        return result;
+        return {};
+#endif
+    }
+
+    // Creates a vmpdump class from the capture at the given path and the target module name.
+    // The capture is either a minidump, or a manifest as described in file_source.hpp.
+    // If module_name is empty "", the process module is used.
+    // If the capture cannot be opened for some reason or the module cannot be found, returns empty {}.
+    //
+    std::unique_ptr<vmpdump> vmpdump::from_capture( const std::string& capture_path, const std::string& module_name )
+    {
+        // Minidumps are recognized by their signature.
+        //
+        if ( std::shared_ptr<minidump_memory_source> source = minidump_memory_source::open( capture_path ) )
+            return from_source( std::move( source ), module_name );
+
+        std::shared_ptr<file_memory_source> source = file_memory_source::open( capture_path );
+        if ( !source )
+            return {};
+
+        return from_source( std::move( source ), module_name );
     }
 }
@@ -1,28 +1,93 @@
 #pragma once
-#include <windows.h>
 #include <cstdint>
 #include <string>
 #include <optional>
 #include <memory>
 #include <vector>
 #include <map>
+#include <functional>
 #include "imports.hpp"
 #include "module_view.hpp"
+#include "export_view.hpp"
+#include "stub_cache.hpp"
+#include "stub_emulator.hpp"
+#include "stub_classifier.hpp"
+#include "stub_clusters.hpp"
+#include "stub_database.hpp"
+#include "code_cave_allocator.hpp"
+#include "patch_plan.hpp"
 
 namespace vmpdump
 {
+    // Flags controlling the behaviour of the import scanner.
+    //
+    enum scan_flags : uint32_t
+    {
+        // Linearly sweep each executable section on the calling thread.
+        //
+        scan_none = 0,
+
+        // Split the executable sections into chunks and sweep them on a work-stealing pool, yielding the same results as the serial sweep.
+        //
+        scan_parallel = 1 << 0,
+
+        // Only decode the E8 calls whose targets lie within a VMP section, found by a vectorized prefilter,
+        // instead of linearly sweeping every byte. Faster, but not exact.
+        //
+        scan_prefilter = 1 << 1,
+
+        // Resolve import stubs with the concrete emulator, only lifting the stubs it cannot handle.
+        //
+        scan_emulate = 1 << 2,
+
+        // Run the fast paths and the VTIL analysis on every stub they resolve, reporting any disagreement.
+        // The VTIL analysis is trusted.
+        //
+        scan_differential = 1 << 3,
+
+        // Match import stubs against the table of known stub shapes before analyzing them.
+        //
+        scan_classify = 1 << 4,
+
+        // Group candidate stubs by their normalized shape, and derive the analysis of most of each group's members
+        // from a few full analyses.
+        //
+        scan_cluster = 1 << 5,
+    };
+
+    // The size of a single chunk of code handed to a worker in parallel scans.
+    //
+    const size_t scan_chunk_size = 0x40000;
+
+    // The state of a linear sweep between two instructions, from which it can be continued.
+    //
+    struct sweep_state
+    {
+        // The rva the next instruction is decoded at.
+        //
+        uint64_t offset;
+
+        // The rva of the previously decoded instruction, if any.
+        //
+        std::optional<uint64_t> previous_rva;
+    };
+
     // The master class allowing for easy access to all dumper and import reconstruction functionality.
     //
     class vmpdump
     {
     public:
-        // The target process' id.
+        // The address space the modules are read from.
+        //
+        const std::shared_ptr<memory_source> source;
+
+        // The target process' id, or zero if the source is not a live process.
         //
         const uint32_t process_id;
         
         // A map of { module base, { module name, module size> }.
         //
-        const std::map<remote_ea_t, std::pair<std::string, size_t>> process_modules;
+        const module_list_t process_modules;
 
         // A view to the target module for dumping.
         //
@@ -32,6 +97,42 @@ namespace vmpdump
         //
         const std::string module_full_path;
 
+        // The number of workers used for parallel scans, or zero to use the hardware concurrency.
+        //
+        size_t worker_count = 0;
+
+        // The size of the chunks of code handed to the workers in parallel scans.
+        //
+        size_t chunk_size = scan_chunk_size;
+
+        // The cache of import stub analysis results for this run, shared between scan threads.
+        //
+        std::unique_ptr<stub_cache> analysis_cache;
+
+        // The concrete emulator used as a fast path for the stub analysis.
+        //
+        std::unique_ptr<stub_emulator> emulator;
+
+        // The classifier matching stubs against known shapes, used ahead of the other analyses.
+        //
+        std::unique_ptr<stub_classifier> classifier;
+
+        // The clusters of stub shapes, used to derive analyses instead of running them.
+        //
+        std::unique_ptr<stub_clusters> clusters;
+
+        // The persistent database of module exports, if any.
+        //
+        std::shared_ptr<export_database> export_db;
+
+        // The persistent database of stub analyses, if any.
+        //
+        std::shared_ptr<stub_database> stub_db;
+
+        // The allocator of code caves in the target module, for the stubs calls are dispatched through.
+        //
+        std::unique_ptr<code_cave_allocator> stub_caves;
+
         // Disallow construction + copy.
         //
         vmpdump() = delete;
@@ -49,36 +150,97 @@ namespace vmpdump
         bool scan_for_imports( uint64_t rva, size_t code_size, std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags = 0 );
 
         // Scans all executable sections of the image for any import calls and imports.
+        // Should a stub cluster's rule be dropped during the scan, the analyses derived from it are dropped as well, and the scan
+        // is repeated, as the results and even the sweep itself may depend on them.
         //
         bool scan_for_imports( std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags = 0 );
 
-        // Attempts to generate a stub in a code cave in the section of the call rva which jmps to the given thunk.
+        // Disassembles and analyzes the target of an E8 call as a VMP import stub.
+        // Results, including failures, are memoized per target for the lifetime of the instance.
+        //
+        std::optional<import_stub_analysis> analyze_call_target( uint64_t call_target_offset, uint32_t flags = 0 );
+
+        // Analyzes a disassembled candidate stream as a VMP import stub, with the analyses selected by the scan flags.
+        // lifted is set to whether the result was produced or confirmed by the VTIL analysis, rather than only by a heuristic.
+        //
+        std::optional<import_stub_analysis> analyze_stream( const compact_stream& stream, uint32_t flags, bool& lifted );
+
+        // Attempts to generate a stub in a code cave which jmps to the given thunk, or returns the one already generated.
         // Returns the stub rva.
         //
-        std::optional<uint32_t> generate_stub( uint32_t rva, remote_ea_t thunk );
+        std::optional<uint32_t> generate_stub( remote_ea_t thunk );
+
+        // Plans the conversion of the provided call to the VMP import stub to a direct import thunk call to the specified remote thunk ea,
+        // without patching the call itself. Any stub the call is dispatched through is generated immediately.
+        //
+        std::optional<call_patch> plan_local_call( const import_call& call, remote_ea_t thunk );
+
+        // Plans the conversion of the provided call to the VMP import stub to a direct import thunk call to the specified remote thunk ea,
+        // adding its patch to the plan. Fails if the call cannot be converted, or its patch overlaps one already planned.
+        //
+        bool convert_local_call( const import_call& call, remote_ea_t thunk, patch_plan& plan );
 
-        // Attempts to convert the provided call to the VMP import stub to a direct import thunk call to the specified remote thunk ea.
+        // Fixes the import calls in the running process instead of a dump. thunk_rvas maps each import's remote ea to the rva of
+        // the thunk appended for it, which is only used if that range is still zero padding; otherwise the thunks are moved into a cave.
+        // The thunks are written first, then any stubs, and only then are the calls redirected, so that no call is redirected to a
+        // thunk or stub which is not there yet. Returns the number of calls redirected.
         //
-        bool convert_local_call( const import_call& call, remote_ea_t thunk );
+        size_t fix_live( const std::vector<import_call>& import_calls, const std::map<remote_ea_t, uint32_t>& thunk_rvas );
 
         // Constructs a module_view from the given remote module base.
+        // Only the headers are fetched; the rest of the module is fetched as it is ensured.
         //
         std::optional<module_view> view_from_base( remote_ea_t base ) const;
 
+        // Constructs an export-only view from the given remote module base.
+        //
+        std::optional<export_view> exports_from_base( remote_ea_t base ) const;
+
+        // Constructs export-only views for each of the given remote module bases on the worker pool,
+        // skipping the bases which are not modules.
+        //
+        std::map<remote_ea_t, export_view> exports_from_bases( const std::vector<remote_ea_t>& bases ) const;
+
         // Retrieves the module base from the given remote ea.
         //
         std::optional<remote_ea_t> base_from_ea( remote_ea_t ea ) const;
 
+        // Creates a vmpdump class from the given memory source and target module name.
+        // If module_name is empty "", the process module is used.
+        // If the module cannot be found, returns empty {}.
+        //
+        static std::unique_ptr<vmpdump> from_source( std::shared_ptr<memory_source> source, const std::string& module_name = "" );
+
         // Creates a vmpdump class from the given process id and target module name.
         // If module_name is empty "", the process module is used.
         // If the process cannot be opened for some reason or the module cannot be found, returns empty {}.
+        // Only supported on Windows.
         //
         static std::unique_ptr<vmpdump> from_pid( uint32_t process_id, const std::string& module_name = "" );
+
+        // Creates a vmpdump class from the capture at the given path and the target module name.
+        // The capture is either a minidump, or a manifest as described in file_source.hpp.
+        // If module_name is empty "", the process module is used.
+        // If the capture cannot be opened for some reason or the module cannot be found, returns empty {}.
+        //
+        static std::unique_ptr<vmpdump> from_capture( const std::string& capture_path, const std::string& module_name = "" );
         
         // Constructor.
         //
-        vmpdump( uint32_t process_id, const std::map<remote_ea_t, std::pair<std::string, size_t>>& process_modules, std::unique_ptr<module_view> target_module_view, const std::string& module_full_path )
-            : process_id( process_id ), process_modules( process_modules ), target_module_view( std::move( target_module_view ) ), module_full_path( module_full_path )
+        vmpdump( std::shared_ptr<memory_source> source, const module_list_t& process_modules, std::unique_ptr<module_view> target_module_view, const std::string& module_full_path )
+            : source( source ), process_id( source->get_process_id() ), process_modules( process_modules ), target_module_view( std::move( target_module_view ) ), module_full_path( module_full_path ), analysis_cache( std::make_unique<stub_cache>() ), emulator( std::make_unique<stub_emulator>() ), classifier( std::make_unique<stub_classifier>() ), clusters( std::make_unique<stub_clusters>() ), stub_caves( std::make_unique<code_cave_allocator>( *this->target_module_view ) )
         {}
+
+    private:
+        // Scans all executable sections of the image for any import calls and imports, serially or in parallel.
+        //
+        bool scan_code_ranges( std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags );
+
+        // Linearly sweeps the code from the given state up to end_rva, allowing instructions to be decoded up to limit_rva, and
+        // leaves the state where the sweep stopped, so that it can be continued. If given, on_decoded is invoked with the rva of
+        // every instruction decoded once it was handled, and the sweep stops right after the instruction if it returns true.
+        //
+        bool scan_range( sweep_state& state, uint64_t end_rva, uint64_t limit_rva, std::map<uint64_t, resolved_import>& resolved_imports, std::vector<import_call>& import_calls, uint32_t flags,
+                         const std::function<bool( uint64_t rva )>& on_decoded = {} );
     };
 }
\ No newline at end of file